@@ -0,0 +1,64 @@
+#version 330 core
+
+in vec2 positionInClipSpace;
+
+out vec4 color;
+
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
+
+// the atmosphere at a lower resolution, with 0 in alpha where the ray ends on the planet
+// and 1 elsewhere, including where nothing was drawn
+uniform sampler2D atmosphereTexture;
+
+const float MAX = 10000.0;
+
+vec2 ray_vs_sphere(vec3 p, vec3 dir, float r) {
+    float b = dot(p, dir);
+    float c = dot(p, p) - r * r;
+
+    float d = b * b - c;
+    if(d < 0.0) {
+        return vec2(MAX, -MAX);
+    }
+    d = sqrt(d);
+
+    return vec2(-b - d, -b + d);
+}
+
+// Joint bilateral upsampling: of the four nearest low resolution samples, only those whose
+// rays end on the planet as the ray of this pixel does or not are interpolated, so that
+// the bright limb does not bleed into the planet and the dark planet not into the limb.
+// Outside the outer atmosphere boundary the pixels stay empty.
+void main() {
+    vec4 near = inverseViewProjectionMatrix * vec4(positionInClipSpace, -1.0, 1.0);
+    vec4 far = inverseViewProjectionMatrix * vec4(positionInClipSpace, 1.0, 1.0);
+    vec3 eye = cameraPositionInWorldSpace;
+    vec3 dir = normalize(far.xyz / far.w - near.xyz / near.w);
+    if(ray_vs_sphere(eye, dir, atmosphereRadius).x >= MAX) {
+        discard;
+    }
+    float passes = ray_vs_sphere(eye, dir, baseRadius).x < MAX ? 0.0 : 1.0;
+
+    ivec2 size = textureSize(atmosphereTexture, 0);
+    vec2 position = (positionInClipSpace * 0.5 + 0.5) * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 fraction = position - vec2(base);
+
+    vec3 sum = vec3(0.0);
+    float weights = 0.0;
+    for(int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec4 atmosphere = texelFetch(atmosphereTexture, clamp(base + offset, ivec2(0), size - 1), 0);
+        vec2 bilinear = mix(1.0 - fraction, fraction, vec2(offset));
+        float weight = bilinear.x * bilinear.y * (atmosphere.a == passes ? 1.0 : 0.0);
+        sum += weight * atmosphere.rgb;
+        weights += weight;
+    }
+
+    // where no neighbour matches, the nearest one is the best guess
+    if(weights <= 0.0) {
+        sum = texelFetch(atmosphereTexture, clamp(ivec2(floor(position + 0.5)), ivec2(0), size - 1), 0).rgb;
+        weights = 1.0;
+    }
+    color = vec4(sum / weights, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+
+out vec2 positionInClipSpace;
+
+// one triangle that covers the screen, on the far plane so that anything drawn before
+// hides it
+void main() {
+    positionInClipSpace = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(positionInClipSpace, 1.0, 1.0);
+}
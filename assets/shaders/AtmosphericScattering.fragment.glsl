@@ -5,11 +5,7 @@ in vec3 positionInWorldSpace;
 // Ouput data
 out vec4 color;
 
-uniform vec3 cameraPositionInWorldSpace;
-uniform vec3 lightDirectionInWorldSpace;
-uniform float atmosphereRadius;
-uniform float baseRadius;
-uniform float lightPower;
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
 
 // adapted code from: https://www.shadertoy.com/view/lslXDr
 // Written by GLtracy
@@ -30,11 +26,15 @@ float R_INNER = 50.0;
 float SCALE_H = 4.0 / (R - R_INNER);
 float SCALE_L = 1.0 / (R - R_INNER);
 
-const int NUM_OUT_SCATTER = 3;
-const float FNUM_OUT_SCATTER = 3.0;
-
-const int NUM_IN_SCATTER = 3;
-const float FNUM_IN_SCATTER = 3.0;
+// samples along the view ray and towards the light, set by the quality tier, see QualityGovernor.hpp;
+// constants in the program specialized for the tier
+#ifdef IN_SCATTER_SAMPLES
+const int outScatterSamples = OUT_SCATTER_SAMPLES;
+const int inScatterSamples = IN_SCATTER_SAMPLES;
+#else
+uniform int outScatterSamples;
+uniform int inScatterSamples;
+#endif
 
 // ray intersects sphere
 // e = -b +/- sqrt( b^2 - c )
@@ -80,11 +80,11 @@ float density(vec3 p) {
 }
 
 float optic(vec3 p, vec3 q) {
-    vec3 step = (q - p) / FNUM_OUT_SCATTER;
+    vec3 step = (q - p) / float(outScatterSamples);
     vec3 v = p + step * 0.5;
 
     float sum = 0.0;
-    for(int i = 0; i < NUM_OUT_SCATTER; i++) {
+    for(int i = 0; i < outScatterSamples; i++) {
         sum += density(v);
         v += step;
     }
@@ -94,13 +94,13 @@ float optic(vec3 p, vec3 q) {
 }
 
 vec3 in_scatter(vec3 o, vec3 dir, vec2 e, vec3 l) {
-    float len = (e.y - e.x) / FNUM_IN_SCATTER;
+    float len = (e.y - e.x) / float(inScatterSamples);
     vec3 step = dir * len;
     vec3 p = o + dir * e.x;
     vec3 v = p + dir * (len * 0.5);
 
     vec3 sum = vec3(0.0);
-    for(int i = 0; i < NUM_IN_SCATTER; i++) {
+    for(int i = 0; i < inScatterSamples; i++) {
         vec2 f = ray_vs_sphere(v, l, R);
         vec3 u = v + l * f.y;
 
@@ -136,5 +136,7 @@ void main() {
 
     I = 1.0 - exp(-0.2 * I);
 
-    color = vec4(I, 1.0);
+    // 0 where the ray ends on the planet, which AtmosphereUpsample.fragment.glsl needs to
+    // keep the planet silhouette sharp
+    color = vec4(I, f.x < MAX ? 0.0 : 1.0);
 }
@@ -1,13 +1,16 @@
 #version 330 core
 
-layout(location = 0) in vec3 vertexPositionInModelSpace;
+// a direction of the sphere, scaled to atmosphereRadius; see CompactSphereVertex in CompactVertex.hpp
+layout(location = 0) in vec2 vertexDirection;
 
 out vec3 positionInWorldSpace;
 
-uniform mat4 modelViewProjectionMatrix;
-uniform mat4 modelMatrix;
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
+
+#include "CompactVertex.glsl"
 
 void main() {
+    vec3 vertexPositionInModelSpace = atmosphereRadius * octahedralDirection(vertexDirection);
     positionInWorldSpace = (modelMatrix * vec4(vertexPositionInModelSpace, 1)).xyz;
     gl_Position = modelViewProjectionMatrix * vec4(vertexPositionInModelSpace, 1);
 }
@@ -0,0 +1,144 @@
+#version 330 core
+
+in vec3 positionInWorldSpace;
+
+// Ouput data
+out vec4 color;
+
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
+
+// optical depth from a radius to the outer sphere by the cosine against the zenith (x)
+// and the altitude in the atmosphere (y), see AtmosphereTables.hpp
+uniform sampler2D opticalDepthTable;
+
+// adapted code from: https://www.shadertoy.com/view/lslXDr
+// Written by GLtracy
+// The optical depths come from opticalDepthTable instead of being marched, which leaves
+// enough time for more in-scatter samples.
+
+// math const
+const float PI = 3.14159265359;
+const float MAX = 10000.0;
+
+// scatter const
+const float K_R = 0.166;
+const float K_M = 0.0025;
+float E = 14.3; 						// light intensity
+const vec3 C_R = vec3(0.3, 0.7, 1.0); 	// 1 / wavelength ^ 4
+const float G_M = -0.85;					// Mie g
+
+float R = 84.0;
+float R_INNER = 50.0;
+float SCALE_H = 4.0 / (R - R_INNER);
+float SCALE_L = 1.0 / (R - R_INNER);
+
+// samples along the view ray, set by the quality tier, see QualityGovernor.hpp;
+// constants in the program specialized for the tier
+#ifdef IN_SCATTER_SAMPLES
+const int inScatterSamples = IN_SCATTER_SAMPLES;
+#else
+uniform int inScatterSamples;
+#endif
+
+// ray intersects sphere
+// e = -b +/- sqrt( b^2 - c )
+vec2 ray_vs_sphere(vec3 p, vec3 dir, float r) {
+    float b = dot(p, dir);
+    float c = dot(p, p) - r * r;
+
+    float d = b * b - c;
+    if(d < 0.0) {
+        return vec2(MAX, -MAX);
+    }
+    d = sqrt(d);
+
+    return vec2(-b - d, -b + d);
+}
+
+// Mie
+// g : ( -0.75, -0.999 )
+//      3 * ( 1 - g^2 )               1 + c^2
+// F = ----------------- * -------------------------------
+//      2 * ( 2 + g^2 )     ( 1 + g^2 - 2 * g * c )^(3/2)
+float phase_mie(float g, float c, float cc) {
+    float gg = g * g;
+
+    float a = (1.0 - gg) * (1.0 + cc);
+
+    float b = 1.0 + gg - 2.0 * g * c;
+    b *= sqrt(b);
+    b *= 2.0 + gg;
+
+    return 1.5 * a / b;
+}
+
+// Reyleigh
+// g : 0
+// F = 3/4 * ( 1 + c^2 )
+float phase_reyleigh(float cc) {
+    return 0.75 * (1.0 + cc);
+}
+
+float density(vec3 p) {
+    return exp(-(length(p) - R_INNER) * SCALE_H);
+}
+
+// optical depth from p along dir up to the outer sphere, ignoring the planet
+float optical_depth(vec3 p, vec3 dir) {
+    vec2 size = vec2(textureSize(opticalDepthTable, 0));
+    float r = length(p);
+    vec2 coordinate = vec2(dot(p, dir) / r * 0.5 + 0.5, clamp((r - R_INNER) / (R - R_INNER), 0.0, 1.0));
+    return texture(opticalDepthTable, (coordinate * (size - 1.0) + 0.5) / size).r;
+}
+
+// The optical depth between p and v is the difference of the optical depths of both
+// to the outer sphere. Rays that end on the ground are looked up backwards, so that no
+// lookup passes through the planet.
+vec3 in_scatter(vec3 o, vec3 dir, vec2 e, vec3 l, bool hits_ground) {
+    float len = (e.y - e.x) / float(inScatterSamples);
+    vec3 step = dir * len;
+    vec3 p = o + dir * e.x;
+    vec3 v = p + dir * (len * 0.5);
+    float depth_p = hits_ground ? optical_depth(p, -dir) : optical_depth(p, dir);
+
+    vec3 sum = vec3(0.0);
+    for(int i = 0; i < inScatterSamples; i++) {
+        float depth_pv = hits_ground ? optical_depth(v, -dir) - depth_p : depth_p - optical_depth(v, dir);
+
+        float n = (max(depth_pv, 0.0) + optical_depth(v, l)) * (PI * 4.0);
+
+        sum += density(v) * exp(-n * (K_R * C_R + K_M));
+
+        v += step;
+    }
+    sum *= len * SCALE_L;
+
+    float c = dot(dir, -l);
+    float cc = c * c;
+
+    return sum * (K_R * C_R * phase_reyleigh(cc) + K_M * phase_mie(G_M, c, cc)) * E;
+}
+
+void main() {
+    R = atmosphereRadius;
+    R_INNER = baseRadius;
+    SCALE_H = 4.0 / (R - R_INNER);
+    SCALE_L = 1.0 / (R - R_INNER);
+    E = lightPower * 80;
+
+    vec3 eye = cameraPositionInWorldSpace;
+    vec3 dir = normalize(positionInWorldSpace - cameraPositionInWorldSpace);
+
+    vec2 e = ray_vs_sphere(eye, dir, atmosphereRadius);
+    vec2 f = ray_vs_sphere(eye, dir, baseRadius);
+    bool hits_ground = f.x < e.y && f.x > 0.0;
+    e.y = min(e.y, f.x);
+
+    vec3 I = in_scatter(eye, dir, e, normalize(-lightDirectionInWorldSpace), hits_ground);
+
+    I = 1.0 - exp(-0.2 * I);
+
+    // 0 where the ray ends on the planet, which AtmosphereUpsample.fragment.glsl needs to
+    // keep the planet silhouette sharp
+    color = vec4(I, hits_ground ? 0.0 : 1.0);
+}
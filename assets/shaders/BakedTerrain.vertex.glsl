@@ -0,0 +1,31 @@
+#version 330 core
+
+// Pass-through variant of TerrainGenerator.vertex.glsl for terrain that was displaced on the CPU
+
+// see CompactTerrainVertex in CompactVertex.hpp: octahedral directions, and the radius
+// between the lowest and the highest terrain
+layout(location = 0) in vec2 vertexDirection;
+layout(location = 1) in vec2 vertexNormal;
+layout(location = 2) in float vertexSlopeIn;
+layout(location = 3) in float vertexHeight;
+
+out vec3 positionInWorldSpace;
+out vec3 positionInModelSpace;
+out vec3 normalInCameraSpace;
+out vec3 lightDirectionInCameraSpace;
+out float vertexSlope;
+
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
+
+#include "CompactVertex.glsl"
+
+void main() {
+    float radius = mix(baseRadius - maxNegativeHeight, baseRadius + maxPositiveHeight, vertexHeight);
+    positionInModelSpace = radius * octahedralDirection(vertexDirection);
+    vertexSlope = vertexSlopeIn;
+
+    positionInWorldSpace = (modelMatrix * vec4(positionInModelSpace, 1)).xyz;
+    lightDirectionInCameraSpace = (viewMatrix * vec4(-lightDirectionInWorldSpace, 0)).xyz;
+    normalInCameraSpace = (viewMatrix * modelMatrix * vec4(octahedralDirection(vertexNormal), 0)).xyz;
+    gl_Position = modelViewProjectionMatrix * vec4(positionInModelSpace, 1);
+}
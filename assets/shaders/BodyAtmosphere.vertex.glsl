@@ -0,0 +1,33 @@
+#version 330 core
+
+// a direction of the unit sphere, scaled to atmosphereRadius; see CompactSphereVertex in CompactVertex.hpp
+layout(location = 0) in vec2 vertexDirection;
+// per instance, see BodyInstance in StarSystem.hpp
+layout(location = 3) in mat4 instanceModelMatrix;
+layout(location = 7) in vec4 instanceNoiseOffsetAndBaseRadius;
+layout(location = 8) in vec4 instanceHeights;
+
+// the fragment shader traces rays in model space, where the atmosphere is that of the planet
+out vec3 positionInModelSpace;
+flat out vec3 cameraPositionInModelSpace;
+flat out vec3 lightDirectionInModelSpace;
+flat out float bodyBaseRadius;
+flat out float bodyAtmosphereRadius;
+
+// FrameUniforms is injected, see SceneUniforms.hpp
+
+#include "CompactVertex.glsl"
+
+void main() {
+    bodyBaseRadius = instanceNoiseOffsetAndBaseRadius.w;
+    bodyAtmosphereRadius = instanceHeights.z;
+    positionInModelSpace = bodyAtmosphereRadius * octahedralDirection(vertexDirection);
+
+    // the model matrix is a rotation times a uniform scale, whose transpose inverts it up
+    // to the square of the scale
+    mat3 transposedModel = transpose(mat3(instanceModelMatrix));
+    float squaredScale = dot(instanceModelMatrix[0].xyz, instanceModelMatrix[0].xyz);
+    cameraPositionInModelSpace = transposedModel * (cameraPositionInWorldSpace - instanceModelMatrix[3].xyz) / squaredScale;
+    lightDirectionInModelSpace = normalize(transposedModel * lightDirectionInWorldSpace);
+    gl_Position = viewProjectionMatrix * instanceModelMatrix * vec4(positionInModelSpace, 1);
+}
@@ -0,0 +1,66 @@
+#version 330 core
+
+in vec3 positionInModelSpace;
+in vec3 normalInCameraSpace;
+in vec3 lightDirectionInCameraSpace;
+in float vertexSlope;
+// of the instance, see BodyTerrain.vertex.glsl
+flat in vec3 bodyNoiseOffset;
+flat in float bodyBaseRadius;
+flat in float bodyMaxPositiveHeight;
+
+out vec4 color;
+
+// FrameUniforms is injected, see SceneUniforms.hpp
+
+// the instance attribute that noise() reads, set first thing in main()
+vec3 noiseOffset = vec3(0);
+
+// the period and the gradient rotation of noise(); with SPECIALIZE_NOISE they are constants
+// of psrdnoise(), whose branches on them the compiler then decides
+#define NOISE_PERIOD 100.0
+#define NOISE_ALPHA 0.0
+
+#include "TerrainNoise.glsl"
+
+vec3 calculateLight(float power, vec3 color, vec3 lightDirectionInCameraSpace) {
+    vec3 n = normalize(normalInCameraSpace);
+    vec3 l = normalize(lightDirectionInCameraSpace);
+    return power * dot(n, l) * color;
+}
+
+vec4 diffuseColor() {
+    float height = length(positionInModelSpace);
+    vec3 gradient;
+    float heightCoordinate = clamp(map(height, bodyBaseRadius, bodyBaseRadius + bodyMaxPositiveHeight - 10, 0, 1), 0, 1) + 0.05 * noise(positionInModelSpace, gradient);
+    if(heightCoordinate <= 0.05 && vertexSlope <= 0.1) {
+        vec3 baseColor = vec3(0.33f, 0.47f, 0.63f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate <= 0.05 && vertexSlope <= 0.2) {
+        vec3 baseColor = vec3(0.39f, 0.6f, 0.84f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate <= 0.3 && vertexSlope <= 0.3) {
+        vec3 baseColor = vec3(1.0f, 0.92f, 0.7f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate <= 0.45 && vertexSlope <= 0.45) {
+        vec3 baseColor = vec3(1.0f, 0.88f, 0.39f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate > 0.6 && vertexSlope <= .5) {
+        vec3 baseColor = vec3(0.93f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate > 0.7) {
+        vec3 baseColor = vec3(0.96f, 0.99f, 1.0f);
+        return vec4(baseColor, 1);
+    } else if(heightCoordinate > 0.6) {
+        vec3 baseColor = vec3(0.52f);
+        return vec4(baseColor, 1);
+    }
+}
+
+void main() {
+    noiseOffset = bodyNoiseOffset;
+    vec4 materialDiffuseColor = diffuseColor();
+    vec4 materialAmbientColor = 0.03 * materialDiffuseColor;
+    vec3 diffuseLight = calculateLight(lightPower, lightColor, lightDirectionInCameraSpace);
+    color = materialAmbientColor + materialDiffuseColor * vec4(diffuseLight, 1);
+}
@@ -0,0 +1,60 @@
+#version 330 core
+
+// a direction of the unit sphere, scaled to baseRadius; see CompactSphereVertex in CompactVertex.hpp
+layout(location = 0) in vec2 vertexDirection;
+// per instance, see BodyInstance in StarSystem.hpp
+layout(location = 3) in mat4 instanceModelMatrix;
+layout(location = 7) in vec4 instanceNoiseOffsetAndBaseRadius;
+layout(location = 8) in vec4 instanceHeights;
+
+out vec3 positionInModelSpace;
+out vec3 normalInCameraSpace;
+out vec3 lightDirectionInCameraSpace;
+out float vertexSlope;
+flat out vec3 bodyNoiseOffset;
+flat out float bodyBaseRadius;
+flat out float bodyMaxPositiveHeight;
+
+// FrameUniforms is injected, see SceneUniforms.hpp
+
+#include "CompactVertex.glsl"
+
+// between the vertices of the unit sphere of the level drawn, see icosphereVertexSpacing()
+// in Icosphere.hpp
+uniform float unitVertexSpacing;
+
+// the instance attributes that the functions below read, set first thing in main()
+vec3 noiseOffset = vec3(0);
+float baseRadius = 1.0;
+float maxNegativeHeight = 0.0;
+float maxPositiveHeight = 0.0;
+
+// the period and the gradient rotation of noise(); with SPECIALIZE_NOISE they are constants
+// of psrdnoise(), whose branches on them the compiler then decides
+#define NOISE_PERIOD 200.0
+#define NOISE_ALPHA 1.0
+
+#include "TerrainNoise.glsl"
+
+// the terrain of the instance, whose vertices cannot show detail finer than their spacing
+#define TERRAIN_MODEL_MATRIX instanceModelMatrix
+#define TERRAIN_MIN_FOOTPRINT (unitVertexSpacing * baseRadius)
+
+#include "TerrainDisplacement.glsl"
+
+void main() {
+    noiseOffset = instanceNoiseOffsetAndBaseRadius.xyz;
+    baseRadius = instanceNoiseOffsetAndBaseRadius.w;
+    maxNegativeHeight = instanceHeights.x;
+    maxPositiveHeight = instanceHeights.y;
+    bodyNoiseOffset = noiseOffset;
+    bodyBaseRadius = baseRadius;
+    bodyMaxPositiveHeight = maxPositiveHeight;
+
+    vec3 normalInModelSpace;
+    positionInModelSpace = displacedPosition(baseRadius * octahedralDirection(vertexDirection), -maxNegativeHeight, maxPositiveHeight, normalInModelSpace, vertexSlope);
+
+    lightDirectionInCameraSpace = (viewMatrix * vec4(-lightDirectionInWorldSpace, 0)).xyz;
+    normalInCameraSpace = (viewMatrix * instanceModelMatrix * vec4(normalInModelSpace, 0)).xyz;
+    gl_Position = viewProjectionMatrix * instanceModelMatrix * vec4(positionInModelSpace, 1);
+}
@@ -0,0 +1,10 @@
+// The decoding of the vertices of CompactVertex.hpp, which the shaders #include.
+
+// the unit vector of an octahedral direction, see encodeOctahedral() in CompactVertex.hpp
+vec3 octahedralDirection(vec2 encoded) {
+    vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (direction.z < 0.0) {
+        direction.xy = (1.0 - abs(direction.yx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(direction);
+}
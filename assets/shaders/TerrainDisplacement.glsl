@@ -0,0 +1,64 @@
+// The displacement of the terrain shaders, which #include it after TerrainNoise.glsl and
+// after defining
+// - TERRAIN_MODEL_MATRIX, the model matrix of the terrain,
+// - TERRAIN_MIN_FOOTPRINT, the least footprint in model space that a vertex stands for, and
+// - TERRAIN_HEIGHTFIELD if they have the terrainHeightfield sampler and isHeightfieldSampled.
+// See TerrainBaker.hpp for its port to the CPU.
+
+vec3 orthogonal(vec3 vector) {
+    if(vector.x != 0 || vector.y != 0) {
+        return vec3(-vector.y, vector.x, 0);
+    } else if(vector.z != 0 || vector.y != 0) {
+        return vec3(0, -vector.z, vector.y);
+    } else {
+        return vec3(-vector.z, 0, vector.x);
+    }
+}
+
+void orthogonals(vec3 vector, out vec3 u, out vec3 v) {
+    u = orthogonal(vector);
+    v = cross(vector, u);
+}
+
+vec3 normal(vec3 position, vec3 gradient, float elevation, out float slope) {
+    vec3 unitPosition = normalize(position);
+    float radius = length(position);
+    vec3 u, v;
+    orthogonals(unitPosition, u, v);
+    mat3 jacobian;
+    jacobian[0] = (1 + elevation / radius) * vec3(1, 0, 0) + position.x / radius * (gradient - (elevation / (radius * radius)) * position);
+    jacobian[1] = (1 + elevation / radius) * vec3(0, 1, 0) + position.y / radius * (gradient - (elevation / (radius * radius)) * position);
+    jacobian[2] = (1 + elevation / radius) * vec3(0, 0, 1) + position.z / radius * (gradient - (elevation / (radius * radius)) * position);
+    vec3 u_tangent = normalize(u) * jacobian;
+    vec3 v_tangent = normalize(v) * jacobian;
+    vec3 normal = normalize(cross(u_tangent, v_tangent));
+    slope = length(gradient);
+    return normal;
+}
+
+#ifdef TERRAIN_HEIGHTFIELD
+// elevation and gradient from the baked heightfield instead of the noise
+float heightfieldElevation(vec3 position, out vec3 gradient) {
+    vec4 texel = textureLod(terrainHeightfield, position, 0.0);
+    gradient = texel.yzw;
+    return texel.x;
+}
+#endif
+
+// the size in model space of a pixel at the position, but no less than TERRAIN_MIN_FOOTPRINT
+float footprint(vec3 position) {
+    float distanceToCamera = distance((TERRAIN_MODEL_MATRIX * vec4(position, 1)).xyz, cameraPositionInWorldSpace);
+    return max(distanceToCamera / (projectionScale * length(TERRAIN_MODEL_MATRIX[0].xyz)), TERRAIN_MIN_FOOTPRINT);
+}
+
+vec3 displacedPosition(vec3 position, float minElevation, float maxElevation, out vec3 displacedNormal, out float slope) {
+    vec3 gradient;
+#ifdef TERRAIN_HEIGHTFIELD
+    float elevation = isHeightfieldSampled ? heightfieldElevation(position, gradient) : elevation(position, minElevation, maxElevation, terrainOctaves(footprint(position)), gradient);
+#else
+    float elevation = elevation(position, minElevation, maxElevation, terrainOctaves(footprint(position)), gradient);
+#endif
+    vec3 newPosition = position * (1 + elevation / length(position));
+    displacedNormal = normal(position, gradient, elevation, slope);
+    return newPosition;
+}
@@ -0,0 +1,51 @@
+#version 330 core
+
+// position within the patch in [0, 1]^2
+layout(location = 0) in vec2 patchCoordinate;
+
+out vec3 positionInWorldSpace;
+out vec3 positionInModelSpace;
+out vec3 normalInCameraSpace;
+out vec3 lightDirectionInCameraSpace;
+out float vertexSlope;
+
+// FrameUniforms and ObjectUniforms are injected, see SceneUniforms.hpp
+
+// the patch covers patchOrigin + s * patchAxisU + t * patchAxisV on the surface of the
+// cube [-1, 1]^3, which is projected onto the sphere
+uniform vec3 patchOrigin;
+uniform vec3 patchAxisU;
+uniform vec3 patchAxisV;
+
+// elevation in x and its gradient in yzw by direction, see TerrainHeightfield.hpp
+uniform samplerCube terrainHeightfield;
+// between the vertices of the finest patches, see QuadtreeTerrain::finestVertexSpacing()
+uniform float vertexSpacing;
+
+// the period and the gradient rotation of noise(); with SPECIALIZE_NOISE they are constants
+// of psrdnoise(), whose branches on them the compiler then decides
+#define NOISE_PERIOD 200.0
+#define NOISE_ALPHA 1.0
+
+#include "TerrainNoise.glsl"
+
+// the terrain of the planet; its footprints are bounded by the spacing of the finest
+// patches, the same for all of them, as neighboring patches with spacings of their own
+// would disagree on their shared edges
+#define TERRAIN_MODEL_MATRIX modelMatrix
+#define TERRAIN_MIN_FOOTPRINT vertexSpacing
+#define TERRAIN_HEIGHTFIELD
+
+#include "TerrainDisplacement.glsl"
+
+void main() {
+    vec3 cubePosition = patchOrigin + patchCoordinate.x * patchAxisU + patchCoordinate.y * patchAxisV;
+    vec3 vertexPositionInModelSpace = baseRadius * normalize(cubePosition);
+    vec3 normalInModelSpace;
+    positionInModelSpace = displacedPosition(vertexPositionInModelSpace, -maxNegativeHeight, maxPositiveHeight, normalInModelSpace, vertexSlope);
+
+    positionInWorldSpace = (modelMatrix * vec4(positionInModelSpace, 1)).xyz;
+    lightDirectionInCameraSpace = (viewMatrix * vec4(-lightDirectionInWorldSpace, 0)).xyz;
+    normalInCameraSpace = (viewMatrix * modelMatrix * vec4(normalInModelSpace, 0)).xyz;
+    gl_Position = modelViewProjectionMatrix * vec4(positionInModelSpace, 1);
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "SpscQueue.hpp"
+#include "ThreadPool.hpp"
+
+// Runs the most recently submitted job on a background thread. Submitting a job
+// cancels the one that is still pending or running, so at most one result is in
+// the making at any time. Finished results are handed to the consuming thread
+// through a lock-free queue that it polls once per frame.
+template <typename Result>
+class AsyncRegenerator
+{
+public:
+    using Job = std::function<std::optional<Result>(const CancellationToken &)>;
+
+private:
+    std::mutex jobMutex;
+    std::condition_variable jobAvailable;
+    std::optional<Job> pendingJob;
+    CancellationToken latestToken;
+    bool stopping = false;
+
+    SpscQueue<Result> results;
+    std::atomic<size_t> submittedJobs = 0;
+    std::atomic<size_t> finishedJobs = 0;
+    std::atomic<size_t> cancelledJobs = 0;
+
+    std::thread worker;
+
+    void work()
+    {
+        while (true)
+        {
+            Job job;
+            CancellationToken token;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobAvailable.wait(lock, [this]
+                                  { return stopping || pendingJob.has_value(); });
+                if (stopping)
+                {
+                    return;
+                }
+                job = std::move(*pendingJob);
+                pendingJob.reset();
+                token = latestToken;
+            }
+
+            std::optional<Result> result = job(token);
+            // under the lock, so that no result of a job arrives after cancel() returns
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (result.has_value() && !token.isCancelled() && results.tryPush(std::move(*result)))
+            {
+                finishedJobs++;
+            }
+            else
+            {
+                cancelledJobs++;
+                finishedJobs++;
+            }
+        }
+    }
+
+public:
+    AsyncRegenerator() : results(2), worker([this]
+                                            { work(); })
+    {
+    }
+
+    ~AsyncRegenerator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+            latestToken.cancel();
+        }
+        jobAvailable.notify_one();
+        worker.join();
+    }
+
+    AsyncRegenerator(const AsyncRegenerator &) = delete;
+    AsyncRegenerator &operator=(const AsyncRegenerator &) = delete;
+
+    void submit(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            latestToken.cancel();
+            latestToken = CancellationToken();
+            if (pendingJob.has_value())
+            {
+                cancelledJobs++;
+                finishedJobs++;
+            }
+            pendingJob = std::move(job);
+            submittedJobs++;
+        }
+        jobAvailable.notify_one();
+    }
+
+    // cancels the pending and the running job and drops the results that were not taken
+    // yet, for when the consumer got the result it wants elsewhere
+    void cancel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            latestToken.cancel();
+            if (pendingJob.has_value())
+            {
+                pendingJob.reset();
+                cancelledJobs++;
+                finishedJobs++;
+            }
+        }
+        Result result;
+        while (results.tryPop(result))
+        {
+        }
+    }
+
+    bool isBusy() const
+    {
+        return finishedJobs.load() != submittedJobs.load();
+    }
+
+    size_t numberOfCancelledJobs() const
+    {
+        return cancelledJobs.load();
+    }
+
+    // takes the newest finished result, dropping older ones that were not taken yet
+    bool tryTakeResult(Result &result)
+    {
+        bool hasResult = false;
+        while (results.tryPop(result))
+        {
+            hasResult = true;
+        }
+        return hasResult;
+    }
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+// The optical depth tables of AtmosphericScatteringTables.fragment.glsl, computed on the
+// CPU. They need no GL context, so that the CPU renderer reads the same tables.
+
+// the size of the tables that AtmosphereTables uploads
+const unsigned int OPTICAL_DEPTH_COSINE_SIZE = 256;
+const unsigned int OPTICAL_DEPTH_ALTITUDE_SIZE = 128;
+
+// Larger optical depths let no light through either, and capping them keeps the values
+// of rays through the planet finite.
+const float MAX_OPTICAL_DEPTH = 100;
+
+// The optical depth that optic() in AtmosphericScattering.fragment.glsl integrates, from a
+// point at the given radius along a ray with the given cosine against the zenith up to
+// the outer sphere. Like optic(), the ray ignores the planet.
+inline float opticalDepthToOuterSphere(float radius, float cosine, float innerRadius, float outerRadius, unsigned int samples)
+{
+    const float thickness = outerRadius - innerRadius;
+    const float scaleHeight = thickness / 4;
+    const float b = radius * cosine;
+    const float c = radius * radius - outerRadius * outerRadius;
+    const float length = -b + std::sqrt(std::max(0.0f, b * b - c));
+    const float step = length / samples;
+
+    float sum = 0;
+    for (unsigned int i = 0; i < samples && sum * step < MAX_OPTICAL_DEPTH * thickness; i++)
+    {
+        const float t = (i + 0.5f) * step;
+        const float sampleRadius = std::sqrt(radius * radius + t * t + 2 * t * b);
+        sum += std::exp(-(sampleRadius - innerRadius) / scaleHeight);
+    }
+    return std::min(sum * step / thickness, MAX_OPTICAL_DEPTH);
+}
+
+// Rows go from the inner to the outer radius and columns from a cosine of -1 to 1, with
+// the first and last texel centered on the ends.
+inline std::vector<float> computeOpticalDepthTable(unsigned int cosineSize, unsigned int altitudeSize, float innerRadius, float outerRadius, ThreadPool &threadPool)
+{
+    const unsigned int samples = 128;
+    std::vector<float> values(cosineSize * altitudeSize);
+    threadPool.parallelFor(altitudeSize, 1, [&](size_t begin, size_t end)
+                           {
+        for (size_t row = begin; row < end; row++)
+        {
+            float radius = innerRadius + (outerRadius - innerRadius) * row / (altitudeSize - 1);
+            for (unsigned int column = 0; column < cosineSize; column++)
+            {
+                float cosine = -1 + 2.0f * column / (cosineSize - 1);
+                values[row * cosineSize + column] = opticalDepthToOuterSphere(radius, cosine, innerRadius, outerRadius, samples);
+            }
+        } });
+    return values;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "AtmosphereOpticalDepth.hpp"
+#include "GlResources.hpp"
+#include "ThreadPool.hpp"
+
+// The texture unit that AtmosphericScatteringTables.fragment.glsl reads the tables from
+const GLuint ATMOSPHERE_TABLES_TEXTURE_UNIT = 0;
+
+// Lookup tables that replace the ray marching of optical depths in the atmosphere shader.
+// They only depend on the radii of the atmosphere and are rebuilt when those change.
+class AtmosphereTables
+{
+private:
+    GlFloatTexture opticalDepth;
+    float innerRadius = 0;
+    float outerRadius = 0;
+
+public:
+    AtmosphereTables() : opticalDepth(OPTICAL_DEPTH_COSINE_SIZE, OPTICAL_DEPTH_ALTITUDE_SIZE, NULL)
+    {
+    }
+
+    // returns whether the tables were rebuilt
+    bool update(float newInnerRadius, float newOuterRadius, ThreadPool &threadPool)
+    {
+        if (newInnerRadius == innerRadius && newOuterRadius == outerRadius)
+        {
+            return false;
+        }
+        innerRadius = newInnerRadius;
+        outerRadius = newOuterRadius;
+        opticalDepth.update(computeOpticalDepthTable(OPTICAL_DEPTH_COSINE_SIZE, OPTICAL_DEPTH_ALTITUDE_SIZE, innerRadius, outerRadius, threadPool).data());
+        return true;
+    }
+
+    void bind() const
+    {
+        opticalDepth.bind(ATMOSPHERE_TABLES_TEXTURE_UNIT);
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+struct TimingSummary
+{
+    size_t samples = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// nearest-rank percentiles
+TimingSummary summarizeTimings(std::vector<double> milliseconds)
+{
+    TimingSummary summary;
+    summary.samples = milliseconds.size();
+    if (milliseconds.empty())
+    {
+        return summary;
+    }
+    std::sort(milliseconds.begin(), milliseconds.end());
+    auto percentile = [&](double fraction)
+    {
+        size_t rank = (size_t)std::ceil(fraction * milliseconds.size());
+        return milliseconds[std::clamp<size_t>(rank, 1, milliseconds.size()) - 1];
+    };
+    for (double value : milliseconds)
+    {
+        summary.mean += value;
+    }
+    summary.mean /= milliseconds.size();
+    summary.p50 = percentile(0.5);
+    summary.p90 = percentile(0.9);
+    summary.p99 = percentile(0.99);
+    summary.max = milliseconds.back();
+    return summary;
+}
+
+void printTimingSummaryJson(FILE *file, const TimingSummary &summary)
+{
+    fprintf(file, "{\"samples\": %zu, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+            summary.samples, summary.mean, summary.p50, summary.p90, summary.p99, summary.max);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// binary PPM of the bound read framebuffer, flipped so that the first row is the top
+bool writeFramebufferPpm(const std::string &path, unsigned int width, unsigned int height)
+{
+    std::vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    for (unsigned int row = 0; row < height; row++)
+    {
+        fwrite(&pixels[(height - 1 - row) * width * 3], 1, width * 3, file);
+    }
+    fclose(file);
+    return true;
+}
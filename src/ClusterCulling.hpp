@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "CompactVertex.hpp"
+#include "Culling.hpp"
+#include "GlResources.hpp"
+
+// Culling of the clusters of a sphere mesh whose vertices are displaced along their
+// directions, such as the planet with its terrain. A cluster is bounded by the cone of the
+// directions of its vertices; with the radii that the displacement keeps to, the cone gives
+// both the horizon test, which drops the clusters on the far side of the sphere whatever
+// their normals, and a bounding sphere for the frustum test. The visible clusters are drawn
+// with a single multi-draw call.
+
+struct ClusterBounds
+{
+    glm::vec3 direction;
+    // cosine of the angle between direction and the farthest vertex direction
+    float minCosine;
+    float angularRadius;
+};
+
+// the sphere positions of the original mesh, before the vertices were chunked
+inline std::vector<ClusterBounds> sphereClusterBounds(const ChunkedIndices &chunked, const std::vector<glm::vec3> &positions)
+{
+    std::vector<ClusterBounds> bounds(chunked.clusters.size());
+    for (size_t c = 0; c < chunked.clusters.size(); c++)
+    {
+        const GlMeshChunk &cluster = chunked.clusters[c];
+        auto cornerDirection = [&](GLsizei i)
+        {
+            return glm::normalize(positions[chunked.sourceVertices[cluster.baseVertex + chunked.indices[cluster.firstIndex + i]]]);
+        };
+        glm::vec3 direction(0);
+        for (GLsizei i = 0; i < cluster.numberOfIndices; i++)
+        {
+            direction += cornerDirection(i);
+        }
+        direction = glm::normalize(direction);
+        float minCosine = 1;
+        for (GLsizei i = 0; i < cluster.numberOfIndices; i++)
+        {
+            minCosine = std::min(minCosine, glm::dot(direction, cornerDirection(i)));
+        }
+        bounds[c] = ClusterBounds{
+            .direction = direction,
+            .minCosine = minCosine,
+            .angularRadius = std::acos(glm::clamp(minCosine, -1.0f, 1.0f)),
+        };
+    }
+    return bounds;
+}
+
+// in the model space of the mesh
+struct ClusterCullingView
+{
+    glm::vec3 cameraPosition;
+    Frustum frustum;
+    // the displaced surface lies between these radii; minRadius also serves as the horizon occluder
+    float minRadius;
+    float maxRadius;
+};
+
+struct ClusterCullingStatistics
+{
+    unsigned int clusters = 0;
+    unsigned int horizonCulledClusters = 0;
+    unsigned int frustumCulledClusters = 0;
+    unsigned int drawnClusters = 0;
+    size_t drawnTriangles = 0;
+    // ranges of adjacent drawn clusters in the multi-draw
+    unsigned int drawRanges = 0;
+
+    void add(const ClusterCullingStatistics &other)
+    {
+        clusters += other.clusters;
+        horizonCulledClusters += other.horizonCulledClusters;
+        frustumCulledClusters += other.frustumCulledClusters;
+        drawnClusters += other.drawnClusters;
+        drawnTriangles += other.drawnTriangles;
+        drawRanges += other.drawRanges;
+    }
+};
+
+// fills draw with the ranges of the clusters that may be visible, and drawnClusters, if
+// given, with their indices
+inline ClusterCullingStatistics cullClusters(const ClusterCullingView &view, const ChunkedIndices &chunked, const std::vector<ClusterBounds> &bounds,
+                                             GlMultiDraw &draw, std::vector<unsigned int> *drawnClusters = NULL)
+{
+    ClusterCullingStatistics statistics;
+    statistics.clusters = chunked.clusters.size();
+    draw.clear();
+    if (drawnClusters != NULL)
+    {
+        drawnClusters->clear();
+    }
+    for (size_t c = 0; c < chunked.clusters.size(); c++)
+    {
+        const ClusterBounds &cluster = bounds[c];
+        if (isBeyondHorizon(view.cameraPosition, view.minRadius, cluster.direction, cluster.angularRadius, view.maxRadius))
+        {
+            statistics.horizonCulledClusters++;
+            continue;
+        }
+        if (!view.frustum.intersectsSphere(cluster.direction * view.maxRadius, shellBoundingRadius(view.minRadius, view.maxRadius, cluster.minCosine)))
+        {
+            statistics.frustumCulledClusters++;
+            continue;
+        }
+        statistics.drawnClusters++;
+        statistics.drawnTriangles += chunked.clusters[c].numberOfIndices / 3;
+        draw.add(chunked.clusters[c], sizeof(uint16_t));
+        if (drawnClusters != NULL)
+        {
+            drawnClusters->push_back(c);
+        }
+    }
+    statistics.drawRanges = draw.counts.size();
+    return statistics;
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "GlResources.hpp"
+#include "Icosphere.hpp"
+#include "MeshOptimizer.hpp"
+#include "TerrainBaker.hpp"
+#include "ThreadPool.hpp"
+
+// Compact vertex layouts for the sphere meshes. Every sphere vertex is a unit direction
+// times a radius, so a vertex stores the direction in octahedral form as two 16-bit snorm
+// values and, for baked terrain, the radius as a 16-bit unorm height between the lowest and
+// highest possible terrain. The shaders decode them with octahedralDirection() of
+// CompactVertex.glsl, which has to change with encodeOctahedral().
+
+// Folds the lower half of the octahedron over the upper one, see "A Survey of Efficient
+// Representations for Independent Unit Vectors" by Cigolle et al.
+inline glm::i16vec2 encodeOctahedral(glm::vec3 direction)
+{
+    direction /= std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+    glm::vec2 encoded(direction.x, direction.y);
+    if (direction.z < 0)
+    {
+        const glm::vec2 signs(encoded.x >= 0 ? 1 : -1, encoded.y >= 0 ? 1 : -1);
+        encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * signs;
+    }
+    return glm::i16vec2(glm::round(glm::clamp(encoded, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline uint16_t encodeUnorm16(float value, float min, float max)
+{
+    return (uint16_t)std::lround(std::clamp((value - min) / (max - min), 0.0f, 1.0f) * 65535.0f);
+}
+
+// the vertex of a sphere with the radius given by the shader
+struct CompactSphereVertex
+{
+    glm::i16vec2 direction;
+};
+
+static_assert(sizeof(CompactSphereVertex) == 4);
+
+inline std::vector<GlVertexAttribute> compactSphereVertexAttributes()
+{
+    return {
+        GlVertexAttribute{0, 2, GL_SHORT, GL_TRUE, offsetof(CompactSphereVertex, direction)},
+    };
+}
+
+// BakedTerrainVertex in 12 instead of 28 bytes
+struct CompactTerrainVertex
+{
+    glm::i16vec2 direction;
+    glm::i16vec2 normal;
+    uint16_t height;
+    // half float
+    uint16_t slope;
+};
+
+static_assert(sizeof(CompactTerrainVertex) == 12);
+
+inline std::vector<GlVertexAttribute> compactTerrainVertexAttributes()
+{
+    return {
+        GlVertexAttribute{0, 2, GL_SHORT, GL_TRUE, offsetof(CompactTerrainVertex, direction)},
+        GlVertexAttribute{1, 2, GL_SHORT, GL_TRUE, offsetof(CompactTerrainVertex, normal)},
+        GlVertexAttribute{2, 1, GL_HALF_FLOAT, GL_FALSE, offsetof(CompactTerrainVertex, slope)},
+        GlVertexAttribute{3, 1, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(CompactTerrainVertex, height)},
+    };
+}
+
+// The triangles of a mesh split into chunks of at most 65536 vertices each, in their
+// original order. Each chunk has its own copy of the vertices it shares with the chunks
+// before it, and indices relative to its first vertex. The chunks are further divided into
+// clusters of trianglesPerCluster consecutive triangles, which for an icosphere are the
+// triangles that subdividing one coarser triangle gave, and can be culled on their own.
+struct ChunkedIndices
+{
+    // the vertex of the original mesh that each vertex of the chunked mesh copies
+    std::vector<unsigned int> sourceVertices;
+    std::vector<uint16_t> indices;
+    std::vector<GlMeshChunk> chunks;
+    std::vector<GlMeshChunk> clusters;
+};
+
+// 4^4 triangles of an icosphere subdivided at least four times
+const size_t DEFAULT_TRIANGLES_PER_CLUSTER = 256;
+
+inline ChunkedIndices splitIntoChunks(const std::vector<unsigned int> &indices, size_t numberOfVertices,
+                                      size_t trianglesPerCluster = DEFAULT_TRIANGLES_PER_CLUSTER)
+{
+    const size_t maxVerticesPerChunk = 65536;
+    ChunkedIndices chunked;
+    chunked.indices.reserve(indices.size());
+    chunked.sourceVertices.reserve(numberOfVertices);
+
+    // the chunk that last used each vertex, and its index there
+    std::vector<unsigned int> vertexChunks(numberOfVertices, UINT_MAX);
+    std::vector<uint16_t> chunkIndices(numberOfVertices);
+    GlMeshChunk chunk{0, 0, 0};
+    for (size_t corner = 0; corner < indices.size(); corner += 3)
+    {
+        // clusters never cross chunks, and each triangle may bring three new vertices
+        if (corner / 3 % trianglesPerCluster == 0)
+        {
+            if (chunked.sourceVertices.size() - chunk.baseVertex + 3 * trianglesPerCluster > maxVerticesPerChunk)
+            {
+                chunked.chunks.push_back(chunk);
+                chunk = GlMeshChunk{(GLint)chunked.sourceVertices.size(), chunked.indices.size(), 0};
+            }
+            chunked.clusters.push_back(GlMeshChunk{chunk.baseVertex, chunked.indices.size(), 0});
+        }
+        const unsigned int chunkId = chunked.chunks.size();
+        for (size_t i = corner; i < corner + 3; i++)
+        {
+            const unsigned int vertex = indices[i];
+            if (vertexChunks[vertex] != chunkId)
+            {
+                vertexChunks[vertex] = chunkId;
+                chunkIndices[vertex] = chunked.sourceVertices.size() - chunk.baseVertex;
+                chunked.sourceVertices.push_back(vertex);
+            }
+            chunked.indices.push_back(chunkIndices[vertex]);
+        }
+        chunk.numberOfIndices += 3;
+        chunked.clusters.back().numberOfIndices += 3;
+    }
+    chunked.chunks.push_back(chunk);
+    return chunked;
+}
+
+// Reorders the triangles within each cluster for the vertex cache and then the vertices of
+// each chunk in the order of use. Each chunk keeps its set of vertices, so chunks are
+// independent and are processed in parallel.
+inline MeshOptimization optimizeChunks(ChunkedIndices &chunked, ThreadPool &threadPool)
+{
+    std::vector<MeshOptimization> optimizations(chunked.chunks.size());
+    threadPool.parallelFor(chunked.chunks.size(), 1, [&](size_t begin, size_t end)
+                           {
+        for (size_t c = begin; c < end; c++)
+        {
+            const GlMeshChunk &chunk = chunked.chunks[c];
+            const size_t endVertex = c + 1 < chunked.chunks.size() ? chunked.chunks[c + 1].baseVertex : chunked.sourceVertices.size();
+            const size_t numberOfVertices = endVertex - chunk.baseVertex;
+            uint16_t *indices = &chunked.indices[chunk.firstIndex];
+            optimizations[c].before = analyzeVertexCache(indices, chunk.numberOfIndices, numberOfVertices);
+
+            // each cluster with its vertices numbered from zero, which keeps the optimization
+            // linear in the number of its triangles
+            const uint16_t unassigned = UINT16_MAX;
+            std::vector<uint16_t> localVertices(numberOfVertices, unassigned);
+            std::vector<uint16_t> clusterVertices;
+            std::vector<uint16_t> clusterIndices;
+            for (const GlMeshChunk &cluster : chunked.clusters)
+            {
+                if (cluster.baseVertex != chunk.baseVertex)
+                {
+                    continue;
+                }
+                uint16_t *corners = &chunked.indices[cluster.firstIndex];
+                clusterVertices.clear();
+                clusterIndices.resize(cluster.numberOfIndices);
+                for (GLsizei i = 0; i < cluster.numberOfIndices; i++)
+                {
+                    if (localVertices[corners[i]] == unassigned)
+                    {
+                        localVertices[corners[i]] = clusterVertices.size();
+                        clusterVertices.push_back(corners[i]);
+                    }
+                    clusterIndices[i] = localVertices[corners[i]];
+                }
+                optimizeVertexCache(clusterIndices.data(), clusterIndices.size(), clusterVertices.size());
+                for (GLsizei i = 0; i < cluster.numberOfIndices; i++)
+                {
+                    corners[i] = clusterVertices[clusterIndices[i]];
+                }
+                for (uint16_t vertex : clusterVertices)
+                {
+                    localVertices[vertex] = unassigned;
+                }
+            }
+
+            const std::vector<unsigned int> order = optimizeVertexFetch(indices, chunk.numberOfIndices, numberOfVertices);
+            unsigned int *sourceVertices = &chunked.sourceVertices[chunk.baseVertex];
+            const std::vector<unsigned int> previousSourceVertices(sourceVertices, sourceVertices + numberOfVertices);
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                sourceVertices[i] = previousSourceVertices[order[i]];
+            }
+            optimizations[c].after = analyzeVertexCache(indices, chunk.numberOfIndices, numberOfVertices);
+        } });
+
+    MeshOptimization optimization;
+    for (const MeshOptimization &chunkOptimization : optimizations)
+    {
+        optimization.add(chunkOptimization);
+    }
+    return optimization;
+}
+
+inline GlMesh compactSphereMesh(const Mesh &sphere, const ChunkedIndices &chunked)
+{
+    std::vector<CompactSphereVertex> vertices(chunked.sourceVertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        vertices[i].direction = encodeOctahedral(sphere.indexed_vertices[chunked.sourceVertices[i]]);
+    }
+    return GlMesh(vertices, compactSphereVertexAttributes(), chunked.indices, chunked.chunks);
+}
+
+inline GlMesh compactSphereMesh(const Mesh &sphere, ThreadPool &threadPool)
+{
+    ChunkedIndices chunked = splitIntoChunks(sphere.indices, sphere.indexed_vertices.size());
+    optimizeChunks(chunked, threadPool);
+    return compactSphereMesh(sphere, chunked);
+}
+
+// the radii of the baked vertices lie between minRadius and maxRadius
+inline std::vector<CompactTerrainVertex> compactTerrainVertices(const std::vector<BakedTerrainVertex> &bakedVertices, const ChunkedIndices &chunked,
+                                                                float minRadius, float maxRadius)
+{
+    std::vector<CompactTerrainVertex> vertices(chunked.sourceVertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const BakedTerrainVertex &vertex = bakedVertices[chunked.sourceVertices[i]];
+        vertices[i] = CompactTerrainVertex{
+            .direction = encodeOctahedral(vertex.position),
+            .normal = encodeOctahedral(vertex.normal),
+            .height = encodeUnorm16(glm::length(vertex.position), minRadius, maxRadius),
+            .slope = glm::packHalf1x16(vertex.slope),
+        };
+    }
+    return vertices;
+}
+
+// GPU memory of meshes, next to what the same meshes took with float vertices and 32-bit indices
+struct MeshMemory
+{
+    size_t bytes = 0;
+    size_t uncompressedBytes = 0;
+
+    void add(const GlMesh &mesh, size_t meshUncompressedBytes)
+    {
+        bytes += mesh.getBytes();
+        uncompressedBytes += meshUncompressedBytes;
+    }
+
+    void add(const MeshMemory &memory)
+    {
+        bytes += memory.bytes;
+        uncompressedBytes += memory.uncompressedBytes;
+    }
+};
+
+template <typename Vertex>
+size_t uncompressedMeshBytes(const Mesh &sphere)
+{
+    return sphere.indexed_vertices.size() * sizeof(Vertex) + sphere.indices.size() * sizeof(unsigned int);
+}
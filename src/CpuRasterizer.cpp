@@ -0,0 +1,49 @@
+#include "CpuRasterizer.hpp"
+#include "CpuRasterizerKernel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_RASTERIZER_X86 1
+#else
+#define CPU_RASTERIZER_X86 0
+#endif
+
+void rasterizeTriangle(const CpuRasterTile &tile, const CpuRasterTriangle &triangle, SimdInstructionSet instructionSet)
+{
+#if CPU_RASTERIZER_X86
+    if (instructionSet == SimdInstructionSet::Avx2)
+    {
+        rasterizeTriangleAvx2(tile, triangle);
+        return;
+    }
+    if (instructionSet == SimdInstructionSet::Sse41)
+    {
+        rasterizeTriangleSse41(tile, triangle);
+        return;
+    }
+#endif
+    for (int y = triangle.minY; y <= triangle.maxY; y++)
+    {
+        const float centerY = y + 0.5f;
+        const float row0 = triangle.edgeB[0] * centerY + triangle.edgeC[0];
+        const float row1 = triangle.edgeB[1] * centerY + triangle.edgeC[1];
+        const float row2 = triangle.edgeB[2] * centerY + triangle.edgeC[2];
+        const float rowDepth = triangle.depthB * centerY + triangle.depthC;
+        float *depths = tile.depths + size_t(y - tile.minY) * tile.stride - tile.minX;
+        unsigned int *triangles = tile.triangles + size_t(y - tile.minY) * tile.stride - tile.minX;
+        for (int x = triangle.minX; x <= triangle.maxX; x++)
+        {
+            const float centerX = x + 0.5f;
+            const float depth = triangle.depthA * centerX + rowDepth;
+            const bool isCloser = (triangle.edgeA[0] * centerX + row0 >= 0) & (triangle.edgeA[1] * centerX + row1 >= 0) &
+                                  (triangle.edgeA[2] * centerX + row2 >= 0) & (depth > depths[x]);
+            depths[x] = isCloser ? depth : depths[x];
+            triangles[x] = isCloser ? triangle.index : triangles[x];
+        }
+    }
+}
+
+void rasterizeTriangle(const CpuRasterTile &tile, const CpuRasterTriangle &triangle)
+{
+    static const SimdInstructionSet instructionSet = supportedSimdInstructionSet();
+    rasterizeTriangle(tile, triangle, instructionSet);
+}
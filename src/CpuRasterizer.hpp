@@ -0,0 +1,43 @@
+#pragma once
+
+#include "TerrainNoise.hpp"
+
+// The widest span that a kernel rasterizes at once; visibility buffers are padded by it
+// so that a span may run past the end of their last row.
+const unsigned int CPU_RASTER_MAX_SPAN = 8;
+
+// The visibility buffer of a tile: the closest 1 / w and its triangle per pixel, in rows
+// of stride pixels from the pixel at (minX, minY) of the image.
+struct CpuRasterTile
+{
+    float *depths;
+    unsigned int *triangles;
+    unsigned int stride;
+    int minX;
+    int minY;
+};
+
+// A front facing triangle within a tile, with edge functions a * x + b * y + c that are
+// nonnegative inside of it and 1 / w as depthA * x + depthB * y + depthC, over the image
+// coordinates of the pixel centers. minX to maxX and minY to maxY are the pixels of the
+// tile that it may cover.
+struct CpuRasterTriangle
+{
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    unsigned int index;
+    int minX;
+    int maxX;
+    int minY;
+    int maxY;
+};
+
+// Writes the triangle to the pixels that it covers where it is closer than what they
+// hold, in spans of 4 or 8 pixels of a row with the SSE4.1 or AVX2 kernel and a pixel at
+// a time otherwise. A span keeps the values that it finds past the end of a row.
+void rasterizeTriangle(const CpuRasterTile &tile, const CpuRasterTriangle &triangle);
+void rasterizeTriangle(const CpuRasterTile &tile, const CpuRasterTriangle &triangle, SimdInstructionSet instructionSet);
@@ -0,0 +1,54 @@
+#include "CpuRasterizerKernel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <immintrin.h>
+
+namespace
+{
+    struct Float8
+    {
+        static const size_t width = 8;
+        __m256 v;
+
+        Float8() = default;
+        Float8(__m256 v) : v(v) {}
+        Float8(float s) : v(_mm256_set1_ps(s)) {}
+        Float8(unsigned int bits) : v(_mm256_castsi256_ps(_mm256_set1_epi32((int)bits))) {}
+
+        static Float8 load(const float *p)
+        {
+            return _mm256_loadu_ps(p);
+        }
+
+        static Float8 loadBits(const unsigned int *p)
+        {
+            return _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)p));
+        }
+
+        void store(float *p) const
+        {
+            _mm256_storeu_ps(p, v);
+        }
+
+        void storeBits(unsigned int *p) const
+        {
+            _mm256_storeu_si256((__m256i *)p, _mm256_castps_si256(v));
+        }
+    };
+
+    inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+    inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Float8 operator&(Float8 a, Float8 b) { return _mm256_and_ps(a.v, b.v); }
+    inline Float8 less(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline Float8 greaterEqual(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline Float8 greater(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline Float8 select(Float8 mask, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+}
+
+void rasterizeTriangleAvx2(const CpuRasterTile &tile, const CpuRasterTriangle &triangle)
+{
+    rasterizeTriangleSpans<Float8>(tile, triangle);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+// Span kernel shared by the SSE4.1 and AVX2 translation units of the rasterizer, written
+// against a vector type Float as in TerrainNoiseKernel.hpp. Besides arithmetic
+// operators, set1 through its float constructor and load/store, Float provides
+// loadBits/storeBits and a constructor from unsigned int bits for the triangle indices,
+// the free functions less, greaterEqual, greater and select, and & on masks. The edge
+// and depth tests of a span are masks rather than branches.
+
+#include "CpuRasterizer.hpp"
+
+void rasterizeTriangleSse41(const CpuRasterTile &tile, const CpuRasterTriangle &triangle);
+void rasterizeTriangleAvx2(const CpuRasterTile &tile, const CpuRasterTriangle &triangle);
+
+template <typename Float>
+inline void rasterizeTriangleSpans(const CpuRasterTile &tile, const CpuRasterTriangle &triangle)
+{
+    static const float laneCenters[CPU_RASTER_MAX_SPAN] = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f};
+    static_assert(Float::width <= CPU_RASTER_MAX_SPAN);
+    const Float offsets = Float::load(laneCenters);
+    const Float a0(triangle.edgeA[0]), a1(triangle.edgeA[1]), a2(triangle.edgeA[2]);
+    const Float depthA(triangle.depthA);
+    const Float zero(0.0f);
+    const Float end(float(triangle.maxX + 1));
+    const Float index(triangle.index);
+    for (int y = triangle.minY; y <= triangle.maxY; y++)
+    {
+        const float centerY = y + 0.5f;
+        const Float row0(triangle.edgeB[0] * centerY + triangle.edgeC[0]);
+        const Float row1(triangle.edgeB[1] * centerY + triangle.edgeC[1]);
+        const Float row2(triangle.edgeB[2] * centerY + triangle.edgeC[2]);
+        const Float rowDepth(triangle.depthB * centerY + triangle.depthC);
+        const size_t rowOffset = size_t(y - tile.minY) * tile.stride;
+        for (int spanX = triangle.minX; spanX <= triangle.maxX; spanX += (int)Float::width)
+        {
+            const Float x = Float(float(spanX)) + offsets;
+            const size_t offset = rowOffset + (spanX - tile.minX);
+            const Float depths = Float::load(tile.depths + offset);
+            const Float depth = depthA * x + rowDepth;
+            const Float isCloser = less(x, end) & greaterEqual(a0 * x + row0, zero) & greaterEqual(a1 * x + row1, zero) &
+                                   greaterEqual(a2 * x + row2, zero) & greater(depth, depths);
+            select(isCloser, depth, depths).store(tile.depths + offset);
+            select(isCloser, index, Float::loadBits(tile.triangles + offset)).storeBits(tile.triangles + offset);
+        }
+    }
+}
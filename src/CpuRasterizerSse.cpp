@@ -0,0 +1,54 @@
+#include "CpuRasterizerKernel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <smmintrin.h>
+
+namespace
+{
+    struct Float4
+    {
+        static const size_t width = 4;
+        __m128 v;
+
+        Float4() = default;
+        Float4(__m128 v) : v(v) {}
+        Float4(float s) : v(_mm_set1_ps(s)) {}
+        Float4(unsigned int bits) : v(_mm_castsi128_ps(_mm_set1_epi32((int)bits))) {}
+
+        static Float4 load(const float *p)
+        {
+            return _mm_loadu_ps(p);
+        }
+
+        static Float4 loadBits(const unsigned int *p)
+        {
+            return _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p));
+        }
+
+        void store(float *p) const
+        {
+            _mm_storeu_ps(p, v);
+        }
+
+        void storeBits(unsigned int *p) const
+        {
+            _mm_storeu_si128((__m128i *)p, _mm_castps_si128(v));
+        }
+    };
+
+    inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+    inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+    inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+    inline Float4 less(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline Float4 greaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline Float4 greater(Float4 a, Float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_blendv_ps(b.v, a.v, mask.v); }
+}
+
+void rasterizeTriangleSse41(const CpuRasterTile &tile, const CpuRasterTriangle &triangle)
+{
+    rasterizeTriangleSpans<Float4>(tile, triangle);
+}
+
+#endif
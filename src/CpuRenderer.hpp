@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AtmosphereOpticalDepth.hpp"
+#include "CpuRasterizer.hpp"
+#include "TerrainBaker.hpp"
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+
+// A CPU port of what render() draws for the planet, for preview images on machines without
+// a GPU: the baked terrain shaded as TerrainGenerator.fragment.glsl shades it, in front of
+// the atmosphere of AtmosphericScatteringTables.fragment.glsl. The image is split into
+// tiles and the front facing triangles are binned to the tiles whose pixel centers they
+// may cover. Each tile is rasterized into a visibility buffer of its own by the SIMD span
+// kernels of CpuRasterizer.hpp, and then every pixel is shaded once: with the terrain of
+// the closest triangle, or with the light scattered in along its ray through the
+// atmosphere. The threads of the pool claim the tiles one at a time from a shared
+// counter, those with the most triangles first, so that the cheap tiles at the end even
+// out the load; there are no per-thread queues to steal from.
+
+const unsigned int CPU_RENDER_TILE_SIZE = 32;
+
+struct CpuRenderView
+{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::vec3 cameraPosition;
+    glm::vec3 lightDirection;
+    glm::vec3 lightColor;
+    float lightPower;
+};
+
+// The optical depth tables of an atmosphere, as AtmosphereTables uploads them.
+struct CpuAtmosphere
+{
+    float innerRadius;
+    float outerRadius;
+    std::vector<float> opticalDepth;
+};
+
+inline CpuAtmosphere cpuAtmosphere(float innerRadius, float outerRadius, ThreadPool &threadPool)
+{
+    return CpuAtmosphere{
+        .innerRadius = innerRadius,
+        .outerRadius = outerRadius,
+        .opticalDepth = computeOpticalDepthTable(OPTICAL_DEPTH_COSINE_SIZE, OPTICAL_DEPTH_ALTITUDE_SIZE, innerRadius, outerRadius, threadPool),
+    };
+}
+
+// In the units of Planet in ProceduralPlanets.cpp; the atmosphere starts at the base radius.
+struct CpuRenderPlanet
+{
+    // baked with bakeTerrain(), as triangles of indices
+    const std::vector<BakedTerrainVertex> *vertices;
+    const std::vector<unsigned int> *indices;
+    const CpuAtmosphere *atmosphere;
+    glm::mat4 modelMatrix;
+    glm::vec3 noiseOffset;
+    float maxPositiveHeight;
+    // along each view ray through the atmosphere, see QualityTier
+    unsigned int inScatterSamples;
+};
+
+// RGB with rows from the top
+struct CpuImage
+{
+    unsigned int width;
+    unsigned int height;
+    std::vector<uint8_t> pixels;
+};
+
+inline bool writeImagePpm(const std::string &path, const CpuImage &image)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", image.width, image.height);
+    const bool written = fwrite(image.pixels.data(), 1, image.pixels.size(), file) == image.pixels.size();
+    return fclose(file) == 0 && written;
+}
+
+struct CpuRenderStatistics
+{
+    double transformMilliseconds = 0;
+    double binningMilliseconds = 0;
+    // rasterizing and shading the tiles
+    double tilesMilliseconds = 0;
+    // front facing triangles that cover a pixel center, summed over the tiles they go to
+    size_t binnedTriangles = 0;
+    // one per pixel, resolved by rasterization where it hits the terrain
+    size_t rays = 0;
+
+    double milliseconds() const
+    {
+        return transformMilliseconds + binningMilliseconds + tilesMilliseconds;
+    }
+
+    double raysPerSecond() const
+    {
+        return rays / std::max(1e-9, milliseconds() / 1000);
+    }
+};
+
+// The functions below port the fragment shaders.
+
+// diffuseColor() of TerrainGenerator.fragment.glsl, which returns nothing for some
+// combinations of height and slope; llvmpipe gives those the color of its last branch
+inline glm::vec3 cpuTerrainDiffuseColor(float height, float slope, float colorNoise, float baseRadius, float maxPositiveHeight)
+{
+    const float heightCoordinate = glm::clamp((height - baseRadius) / (maxPositiveHeight - 10), 0.0f, 1.0f) + 0.05f * colorNoise;
+    if (heightCoordinate <= 0.05f && slope <= 0.1f)
+        return glm::vec3(0.33f, 0.47f, 0.63f);
+    else if (heightCoordinate <= 0.05f && slope <= 0.2f)
+        return glm::vec3(0.39f, 0.6f, 0.84f);
+    else if (heightCoordinate <= 0.3f && slope <= 0.3f)
+        return glm::vec3(1.0f, 0.92f, 0.7f);
+    else if (heightCoordinate <= 0.45f && slope <= 0.45f)
+        return glm::vec3(1.0f, 0.88f, 0.39f);
+    else if (heightCoordinate > 0.6f && slope <= .5f)
+        return glm::vec3(0.93f);
+    else if (heightCoordinate > 0.7f)
+        return glm::vec3(0.96f, 0.99f, 1.0f);
+    return glm::vec3(0.52f);
+}
+
+// the ray parameters where the ray enters and leaves the sphere around the origin, or
+// (MAX, -MAX) if it misses it, as ray_vs_sphere()
+inline glm::vec2 cpuRayVsSphere(glm::vec3 origin, glm::vec3 direction, float radius)
+{
+    const float b = glm::dot(origin, direction);
+    const float c = glm::dot(origin, origin) - radius * radius;
+    const float d = b * b - c;
+    if (d < 0)
+    {
+        return glm::vec2(10000, -10000);
+    }
+    return glm::vec2(-b - std::sqrt(d), -b + std::sqrt(d));
+}
+
+// optical_depth() of AtmosphericScatteringTables.fragment.glsl, filtered like its texture
+inline float cpuOpticalDepth(const CpuAtmosphere &atmosphere, glm::vec3 position, glm::vec3 direction)
+{
+    const float radius = glm::length(position);
+    const float u = (glm::dot(position, direction) / radius * 0.5f + 0.5f) * (OPTICAL_DEPTH_COSINE_SIZE - 1);
+    const float v = glm::clamp((radius - atmosphere.innerRadius) / (atmosphere.outerRadius - atmosphere.innerRadius), 0.0f, 1.0f) * (OPTICAL_DEPTH_ALTITUDE_SIZE - 1);
+    const unsigned int column = std::min((unsigned int)std::max(u, 0.0f), OPTICAL_DEPTH_COSINE_SIZE - 2);
+    const unsigned int row = std::min((unsigned int)v, OPTICAL_DEPTH_ALTITUDE_SIZE - 2);
+    const float s = glm::clamp(u - column, 0.0f, 1.0f);
+    const float t = v - row;
+    const float *texels = &atmosphere.opticalDepth[row * OPTICAL_DEPTH_COSINE_SIZE + column];
+    const float bottom = texels[0] + s * (texels[1] - texels[0]);
+    const float top = texels[OPTICAL_DEPTH_COSINE_SIZE] + s * (texels[OPTICAL_DEPTH_COSINE_SIZE + 1] - texels[OPTICAL_DEPTH_COSINE_SIZE]);
+    return bottom + t * (top - bottom);
+}
+
+// main() of AtmosphericScatteringTables.fragment.glsl for a ray from the camera; black
+// where the ray misses the atmosphere, which the shader does not draw
+inline glm::vec3 cpuAtmosphereColor(const CpuAtmosphere &atmosphere, unsigned int inScatterSamples, const CpuRenderView &view, glm::vec3 direction)
+{
+    const float pi = 3.14159265359f;
+    const float kR = 0.166f;
+    const float kM = 0.0025f;
+    const glm::vec3 cR(0.3f, 0.7f, 1.0f);
+    const float gM = -0.85f;
+    const float thickness = atmosphere.outerRadius - atmosphere.innerRadius;
+    const float scaleH = 4 / thickness;
+    const float scaleL = 1 / thickness;
+    const glm::vec3 eye = view.cameraPosition;
+
+    glm::vec2 e = cpuRayVsSphere(eye, direction, atmosphere.outerRadius);
+    if (e.x > e.y)
+    {
+        return glm::vec3(0);
+    }
+    const glm::vec2 f = cpuRayVsSphere(eye, direction, atmosphere.innerRadius);
+    const bool hitsGround = f.x < e.y && f.x > 0;
+    e.y = std::min(e.y, f.x);
+
+    const glm::vec3 l = glm::normalize(-view.lightDirection);
+    const float len = (e.y - e.x) / inScatterSamples;
+    const glm::vec3 p = eye + direction * e.x;
+    glm::vec3 v = p + direction * (len * 0.5f);
+    const float depthP = hitsGround ? cpuOpticalDepth(atmosphere, p, -direction) : cpuOpticalDepth(atmosphere, p, direction);
+    const glm::vec3 extinction = kR * cR + kM;
+    glm::vec3 sum(0);
+    for (unsigned int i = 0; i < inScatterSamples; i++)
+    {
+        const float depthPv = hitsGround ? cpuOpticalDepth(atmosphere, v, -direction) - depthP : depthP - cpuOpticalDepth(atmosphere, v, direction);
+        const float n = (std::max(depthPv, 0.0f) + cpuOpticalDepth(atmosphere, v, l)) * (pi * 4);
+        sum += std::exp(-(glm::length(v) - atmosphere.innerRadius) * scaleH) * glm::exp(-n * extinction);
+        v += direction * len;
+    }
+    sum *= len * scaleL;
+
+    const float c = glm::dot(direction, -l);
+    const float cc = c * c;
+    const float gg = gM * gM;
+    float b = 1 + gg - 2 * gM * c;
+    b *= std::sqrt(b) * (2 + gg);
+    const float phaseMie = 1.5f * (1 - gg) * (1 + cc) / b;
+    const float phaseRayleigh = 0.75f * (1 + cc);
+    const glm::vec3 scattered = sum * (kR * cR * phaseRayleigh + kM * phaseMie) * (view.lightPower * 80);
+    return 1.0f - glm::exp(-0.2f * scattered);
+}
+
+inline uint8_t cpuUnorm8(float value)
+{
+    return (uint8_t)std::lround(glm::clamp(value, 0.0f, 1.0f) * 255);
+}
+
+// Renders into image, whose width and height are set. The pixels that no triangle covers
+// get the atmosphere.
+inline CpuRenderStatistics renderPlanetOnCpu(const CpuRenderPlanet &planet, const CpuRenderView &view, CpuImage &image, ThreadPool &threadPool)
+{
+    struct ScreenVertex
+    {
+        // in pixels, with rows from the top
+        float x;
+        float y;
+        // of the clip position; 0 behind the near plane
+        float inverseW;
+    };
+
+    // E(x, y) = a x + b y + c is positive to the left of the edge from one vertex to the
+    // next, so all three are on the front faces' inside
+    struct EdgeFunction
+    {
+        float a;
+        float b;
+        float c;
+
+        EdgeFunction(const ScreenVertex &from, const ScreenVertex &to)
+            : a(to.y - from.y), b(from.x - to.x), c(-from.x * (to.y - from.y) - from.y * (from.x - to.x))
+        {
+        }
+
+        float operator()(float x, float y) const
+        {
+            return a * x + b * y + c;
+        }
+    };
+
+    const std::vector<BakedTerrainVertex> &vertices = *planet.vertices;
+    const std::vector<unsigned int> &indices = *planet.indices;
+    const CpuAtmosphere &atmosphere = *planet.atmosphere;
+    const unsigned int width = image.width;
+    const unsigned int height = image.height;
+    image.pixels.resize(size_t(width) * height * 3);
+    CpuRenderStatistics statistics;
+    statistics.rays = size_t(width) * height;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    auto lap = [&start]()
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const double milliseconds = std::chrono::duration<double, std::milli>(now - start).count();
+        start = now;
+        return milliseconds;
+    };
+
+    const glm::mat4 viewProjectionMatrix = view.projectionMatrix * view.viewMatrix;
+    const glm::mat4 modelViewProjectionMatrix = viewProjectionMatrix * planet.modelMatrix;
+    std::vector<ScreenVertex> screenVertices(vertices.size());
+    threadPool.parallelFor(vertices.size(), [&](size_t begin, size_t end)
+                           {
+        for (size_t i = begin; i < end; i++)
+        {
+            const glm::vec4 clip = modelViewProjectionMatrix * glm::vec4(vertices[i].position, 1);
+            // the triangles that cross the near plane are dropped instead of clipped,
+            // which only shows with the camera within the terrain
+            if (clip.w < 1e-3f)
+            {
+                screenVertices[i] = ScreenVertex{0, 0, 0};
+                continue;
+            }
+            screenVertices[i] = ScreenVertex{
+                .x = (clip.x / clip.w * 0.5f + 0.5f) * width,
+                .y = (0.5f - clip.y / clip.w * 0.5f) * height,
+                .inverseW = 1 / clip.w,
+            };
+        } });
+    statistics.transformMilliseconds = lap();
+
+    // each chunk of triangles bins into bins of its own, which keeps the order of the
+    // triangles within each tile
+    const unsigned int tilesX = (width + CPU_RENDER_TILE_SIZE - 1) / CPU_RENDER_TILE_SIZE;
+    const unsigned int tilesY = (height + CPU_RENDER_TILE_SIZE - 1) / CPU_RENDER_TILE_SIZE;
+    const unsigned int tiles = tilesX * tilesY;
+    const size_t triangles = indices.size() / 3;
+    const size_t binningChunks = std::max<size_t>(1, std::min<size_t>(triangles / 1024, 4 * (threadPool.size() + 1)));
+    const size_t trianglesPerChunk = (triangles + binningChunks - 1) / binningChunks;
+    std::vector<std::vector<unsigned int>> bins(binningChunks * tiles);
+    threadPool.parallelFor(binningChunks, 1, [&](size_t beginChunk, size_t endChunk)
+                           {
+        for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
+        {
+            std::vector<unsigned int> *chunkBins = &bins[chunk * tiles];
+            for (size_t triangle = chunk * trianglesPerChunk; triangle < std::min(triangles, (chunk + 1) * trianglesPerChunk); triangle++)
+            {
+                const ScreenVertex &v0 = screenVertices[indices[3 * triangle]];
+                const ScreenVertex &v1 = screenVertices[indices[3 * triangle + 1]];
+                const ScreenVertex &v2 = screenVertices[indices[3 * triangle + 2]];
+                if (v0.inverseW == 0 || v1.inverseW == 0 || v2.inverseW == 0 || EdgeFunction(v0, v1)(v2.x, v2.y) <= 0)
+                {
+                    continue;
+                }
+                // the pixels whose centers lie within the bounding box
+                const int minX = std::max(0, (int)std::ceil(std::min({v0.x, v1.x, v2.x}) - 0.5f));
+                const int maxX = std::min((int)width - 1, (int)std::floor(std::max({v0.x, v1.x, v2.x}) - 0.5f));
+                const int minY = std::max(0, (int)std::ceil(std::min({v0.y, v1.y, v2.y}) - 0.5f));
+                const int maxY = std::min((int)height - 1, (int)std::floor(std::max({v0.y, v1.y, v2.y}) - 0.5f));
+                if (minX > maxX || minY > maxY)
+                {
+                    continue;
+                }
+                for (int tileY = minY / CPU_RENDER_TILE_SIZE; tileY <= maxY / (int)CPU_RENDER_TILE_SIZE; tileY++)
+                {
+                    for (int tileX = minX / CPU_RENDER_TILE_SIZE; tileX <= maxX / (int)CPU_RENDER_TILE_SIZE; tileX++)
+                    {
+                        chunkBins[tileY * tilesX + tileX].push_back(triangle);
+                    }
+                }
+            }
+        } });
+
+    std::vector<size_t> tileTriangles(tiles, 0);
+    for (size_t chunk = 0; chunk < binningChunks; chunk++)
+    {
+        for (unsigned int tile = 0; tile < tiles; tile++)
+        {
+            tileTriangles[tile] += bins[chunk * tiles + tile].size();
+        }
+    }
+    statistics.binnedTriangles = std::accumulate(tileTriangles.begin(), tileTriangles.end(), size_t(0));
+    std::vector<unsigned int> tileOrder(tiles);
+    std::iota(tileOrder.begin(), tileOrder.end(), 0);
+    std::stable_sort(tileOrder.begin(), tileOrder.end(), [&](unsigned int a, unsigned int b)
+                     { return tileTriangles[a] > tileTriangles[b]; });
+    statistics.binningMilliseconds = lap();
+
+    const glm::mat4 inverseViewProjectionMatrix = glm::inverse(viewProjectionMatrix);
+    const glm::mat3 normalMatrix(planet.modelMatrix);
+    const glm::vec3 lightDirection = glm::normalize(-view.lightDirection);
+    threadPool.parallelFor(tiles, 1, [&](size_t beginTile, size_t endTile)
+                           {
+        const unsigned int stride = CPU_RENDER_TILE_SIZE;
+        float depths[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE + CPU_RASTER_MAX_SPAN];
+        unsigned int closestTriangles[CPU_RENDER_TILE_SIZE * CPU_RENDER_TILE_SIZE + CPU_RASTER_MAX_SPAN];
+        for (size_t orderIndex = beginTile; orderIndex < endTile; orderIndex++)
+        {
+            const unsigned int tile = tileOrder[orderIndex];
+            const int tileMinX = (tile % tilesX) * CPU_RENDER_TILE_SIZE;
+            const int tileMinY = (tile / tilesX) * CPU_RENDER_TILE_SIZE;
+            const int tileMaxX = std::min(tileMinX + (int)CPU_RENDER_TILE_SIZE, (int)width) - 1;
+            const int tileMaxY = std::min(tileMinY + (int)CPU_RENDER_TILE_SIZE, (int)height) - 1;
+            std::fill(std::begin(depths), std::end(depths), 0.0f);
+            std::fill(std::begin(closestTriangles), std::end(closestTriangles), UINT_MAX);
+            const CpuRasterTile rasterTile{
+                .depths = depths,
+                .triangles = closestTriangles,
+                .stride = stride,
+                .minX = tileMinX,
+                .minY = tileMinY,
+            };
+
+            for (size_t chunk = 0; chunk < binningChunks; chunk++)
+            {
+                for (unsigned int triangle : bins[chunk * tiles + tile])
+                {
+                    const ScreenVertex &v0 = screenVertices[indices[3 * triangle]];
+                    const ScreenVertex &v1 = screenVertices[indices[3 * triangle + 1]];
+                    const ScreenVertex &v2 = screenVertices[indices[3 * triangle + 2]];
+                    const EdgeFunction e0(v1, v2), e1(v2, v0), e2(v0, v1);
+                    const float area = e2(v2.x, v2.y);
+                    // 1 / w is linear in screen space
+                    const CpuRasterTriangle rasterTriangle{
+                        .edgeA = {e0.a, e1.a, e2.a},
+                        .edgeB = {e0.b, e1.b, e2.b},
+                        .edgeC = {e0.c, e1.c, e2.c},
+                        .depthA = (e0.a * v0.inverseW + e1.a * v1.inverseW + e2.a * v2.inverseW) / area,
+                        .depthB = (e0.b * v0.inverseW + e1.b * v1.inverseW + e2.b * v2.inverseW) / area,
+                        .depthC = (e0.c * v0.inverseW + e1.c * v1.inverseW + e2.c * v2.inverseW) / area,
+                        .index = triangle,
+                        .minX = std::max(tileMinX, (int)std::ceil(std::min({v0.x, v1.x, v2.x}) - 0.5f)),
+                        .maxX = std::min(tileMaxX, (int)std::floor(std::max({v0.x, v1.x, v2.x}) - 0.5f)),
+                        .minY = std::max(tileMinY, (int)std::ceil(std::min({v0.y, v1.y, v2.y}) - 0.5f)),
+                        .maxY = std::min(tileMaxY, (int)std::floor(std::max({v0.y, v1.y, v2.y}) - 0.5f)),
+                    };
+                    rasterizeTriangle(rasterTile, rasterTriangle);
+                }
+            }
+
+            for (int y = tileMinY; y <= tileMaxY; y++)
+            {
+                for (int x = tileMinX; x <= tileMaxX; x++)
+                {
+                    const unsigned int triangle = closestTriangles[(y - tileMinY) * stride + (x - tileMinX)];
+                    const float centerX = x + 0.5f;
+                    const float centerY = y + 0.5f;
+                    glm::vec3 color;
+                    if (triangle == UINT_MAX)
+                    {
+                        const glm::vec4 farPoint = inverseViewProjectionMatrix * glm::vec4(2 * centerX / width - 1, 1 - 2 * centerY / height, 1, 1);
+                        const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - view.cameraPosition);
+                        color = cpuAtmosphereColor(atmosphere, planet.inScatterSamples, view, direction);
+                    }
+                    else
+                    {
+                        // perspective correct barycentric coordinates
+                        const unsigned int *corners = &indices[3 * triangle];
+                        const ScreenVertex &v0 = screenVertices[corners[0]];
+                        const ScreenVertex &v1 = screenVertices[corners[1]];
+                        const ScreenVertex &v2 = screenVertices[corners[2]];
+                        glm::vec3 weights(EdgeFunction(v1, v2)(centerX, centerY) * v0.inverseW,
+                                          EdgeFunction(v2, v0)(centerX, centerY) * v1.inverseW,
+                                          EdgeFunction(v0, v1)(centerX, centerY) * v2.inverseW);
+                        weights /= weights.x + weights.y + weights.z;
+                        const BakedTerrainVertex &a = vertices[corners[0]];
+                        const BakedTerrainVertex &b = vertices[corners[1]];
+                        const BakedTerrainVertex &c = vertices[corners[2]];
+                        const glm::vec3 position = weights.x * a.position + weights.y * b.position + weights.z * c.position;
+                        const glm::vec3 normal = glm::normalize(normalMatrix * (weights.x * a.normal + weights.y * b.normal + weights.z * c.normal));
+                        const float slope = weights.x * a.slope + weights.y * b.slope + weights.z * c.slope;
+
+                        glm::vec3 gradient;
+                        const float colorNoise = psrdnoise(position + planet.noiseOffset, glm::vec3(100), 0, gradient);
+                        const glm::vec3 diffuseColor = cpuTerrainDiffuseColor(glm::length(position), slope, colorNoise, atmosphere.innerRadius, planet.maxPositiveHeight);
+                        const glm::vec3 diffuseLight = view.lightPower * glm::dot(normal, lightDirection) * view.lightColor;
+                        color = 0.03f * diffuseColor + diffuseColor * diffuseLight;
+                    }
+                    uint8_t *pixel = &image.pixels[(size_t(y) * width + x) * 3];
+                    pixel[0] = cpuUnorm8(color.r);
+                    pixel[1] = cpuUnorm8(color.g);
+                    pixel[2] = cpuUnorm8(color.b);
+                }
+            }
+        } });
+    statistics.tilesMilliseconds = lap();
+    return statistics;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // planes point inwards; extracted from the rows of the (model-)view-projection matrix
+    static Frustum fromMatrix(const glm::mat4 &matrix)
+    {
+        const glm::vec4 row0(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+        const glm::vec4 row1(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+        const glm::vec4 row2(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+        const glm::vec4 row3(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0;
+        frustum.planes[1] = row3 - row0;
+        frustum.planes[2] = row3 + row1;
+        frustum.planes[3] = row3 - row1;
+        frustum.planes[4] = row3 + row2;
+        frustum.planes[5] = row3 - row2;
+        for (glm::vec4 &plane : frustum.planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool intersectsSphere(glm::vec3 center, float radius) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Whether every point within angularRadius of the given unit direction and at most
+// maxRadius from the origin is hidden behind a sphere of occluderRadius around the
+// origin, as seen from cameraPosition. A point at radius maxRadius is visible up to
+// acos(occluderRadius / cameraDistance) + acos(occluderRadius / maxRadius) away from
+// the camera direction.
+inline bool isBeyondHorizon(glm::vec3 cameraPosition, float occluderRadius, glm::vec3 direction, float angularRadius, float maxRadius)
+{
+    const float cameraDistance = glm::length(cameraPosition);
+    if (cameraDistance <= occluderRadius || maxRadius <= occluderRadius)
+    {
+        return false;
+    }
+    const float horizonAngle = std::acos(occluderRadius / cameraDistance) + std::acos(occluderRadius / maxRadius);
+    const float angle = std::acos(glm::clamp(glm::dot(direction, cameraPosition / cameraDistance), -1.0f, 1.0f));
+    return angle - angularRadius > horizonAngle;
+}
+
+// The radius of a sphere around direction * maxRadius that holds every point between
+// minRadius and maxRadius whose direction lies within the cone around direction with the
+// given cosine of its angular radius. The farthest points are on the rim of the cone or
+// straight below the center.
+inline float shellBoundingRadius(float minRadius, float maxRadius, float minCosine)
+{
+    const float innerDistance = maxRadius - minRadius;
+    const float rimDistanceAtMinRadius = std::sqrt(std::max(0.0f, minRadius * minRadius + maxRadius * maxRadius - 2 * minRadius * maxRadius * minCosine));
+    const float rimDistanceAtMaxRadius = maxRadius * std::sqrt(std::max(0.0f, 2 - 2 * minCosine));
+    return std::max({innerDistance, rimDistanceAtMinRadius, rimDistanceAtMaxRadius});
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// An OpenGL 3.3 core context without any window, for rendering into framebuffer objects.
+// Prefers Mesa's surfaceless platform, which needs neither a display server nor a GPU
+// (LIBGL_ALWAYS_SOFTWARE=1 selects the software rasterizer), and falls back to the
+// default display with a 1x1 pbuffer.
+class EglContext
+{
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static EGLDisplay platformDisplay()
+    {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (clientExtensions != NULL && std::string(clientExtensions).find("EGL_MESA_platform_surfaceless") != std::string::npos)
+        {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay != NULL)
+            {
+                return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            }
+        }
+#endif
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+public:
+    EglContext()
+    {
+        display = platformDisplay();
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            fprintf(stderr, "Failed to initialize EGL\n");
+            throw -1;
+        }
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE};
+        EGLConfig config;
+        EGLint numberOfConfigs = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &numberOfConfigs) || numberOfConfigs == 0 || !eglBindAPI(EGL_OPENGL_API))
+        {
+            eglTerminate(display);
+            fprintf(stderr, "No EGL config supports desktop OpenGL\n");
+            throw -1;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT)
+        {
+            eglTerminate(display);
+            fprintf(stderr, "Failed to create an OpenGL 3.3 core context\n");
+            throw -1;
+        }
+
+        const char *displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (displayExtensions == NULL || std::string(displayExtensions).find("EGL_KHR_surfaceless_context") == std::string::npos)
+        {
+            const EGLint surfaceAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+        }
+        if (!eglMakeCurrent(display, surface, surface, context))
+        {
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+            fprintf(stderr, "Failed to make the EGL context current\n");
+            throw -1;
+        }
+    }
+
+    ~EglContext()
+    {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE)
+        {
+            eglDestroySurface(display, surface);
+        }
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    EglContext(const EglContext &) = delete;
+    EglContext &operator=(const EglContext &) = delete;
+};
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <GL/glew.h>
+
+// An image sequence if the path has a single %d or %u directive, which may have flags and
+// a width such as %05u, for the number of the frame; otherwise a raw video stream.
+inline bool isFrameSequencePattern(const std::string &path)
+{
+    const size_t directive = path.find('%');
+    if (directive == std::string::npos || path.find('%', directive + 1) != std::string::npos)
+    {
+        return false;
+    }
+    const size_t conversion = path.find_first_not_of("0123456789", directive + 1);
+    return conversion != std::string::npos && (path[conversion] == 'd' || path[conversion] == 'u');
+}
+
+struct FrameCaptureStatistics
+{
+    // the frames that capture() was called for
+    unsigned long offeredFrames = 0;
+    unsigned long writtenFrames = 0;
+    // for lack of a free buffer, because the GPU or the writer fell behind, or of another size
+    unsigned long droppedFrames = 0;
+    unsigned long failedFrames = 0;
+    uint64_t bytesWritten = 0;
+    // spent in capture() on the render thread
+    double captureMilliseconds = 0;
+};
+
+// Records the frames of the bound read framebuffer without stalling the render thread.
+// Each frame is read into the next of a ring of pixel buffer objects, behind a fence; the
+// buffers whose fences have passed are mapped a few frames later and handed to a writer
+// thread, which writes them straight from the mapping, and are unmapped once it is done.
+// When the buffer that a frame would go to is still being read or written, the frame is
+// dropped and counted rather than waited for. The frames are written as PPM images, top
+// row first, named after their numbers among the offered frames, or appended to a raw
+// stream of RGB24 frames, which for example ffmpeg reads with -f rawvideo -pixel_format
+// rgb24 -video_size WIDTHxHEIGHT.
+class FrameCapture
+{
+private:
+    static const unsigned int FRAMES_IN_FLIGHT = 4;
+
+    enum class SlotState
+    {
+        Free,
+        // the fence follows the readback
+        Reading,
+        // mapped and queued for or with the writer
+        Writing,
+    };
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsync fence = 0;
+        SlotState state = SlotState::Free;
+        const uint8_t *pixels = NULL;
+        unsigned long frame = 0;
+        // set by the writer, after which the render thread unmaps the buffer
+        std::atomic<bool> isWritten = false;
+    };
+
+    std::string path;
+    bool isSequence;
+    unsigned int width;
+    unsigned int height;
+    size_t frameBytes;
+    Slot slots[FRAMES_IN_FLIGHT];
+    // the oldest of the slots in use, and the next one to read into
+    unsigned int nextSlot = 0;
+    bool isFinished = false;
+
+    std::mutex writeMutex;
+    std::condition_variable writeAvailable;
+    std::deque<unsigned int> writeQueue;
+    bool stopping = false;
+    FILE *stream = NULL;
+
+    unsigned long offeredFrames = 0;
+    unsigned long droppedFrames = 0;
+    double captureMilliseconds = 0;
+    std::atomic<unsigned long> writtenFrames = 0;
+    std::atomic<unsigned long> failedFrames = 0;
+    std::atomic<uint64_t> bytesWritten = 0;
+
+    std::thread writer;
+
+    bool writeRows(FILE *file, const uint8_t *pixels)
+    {
+        // GL reads the bottom row first
+        const size_t rowBytes = size_t(width) * 3;
+        for (unsigned int row = 0; row < height; row++)
+        {
+            if (fwrite(pixels + (height - 1 - row) * rowBytes, 1, rowBytes, file) != rowBytes)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool writeFrame(const Slot &slot)
+    {
+        if (!isSequence)
+        {
+            if (stream == NULL)
+            {
+                stream = fopen(path.c_str(), "wb");
+            }
+            return stream != NULL && writeRows(stream, slot.pixels);
+        }
+
+        char framePath[4096];
+        snprintf(framePath, sizeof(framePath), path.c_str(), (unsigned int)slot.frame);
+        FILE *file = fopen(framePath, "wb");
+        if (file == NULL)
+        {
+            return false;
+        }
+        fprintf(file, "P6\n%u %u\n255\n", width, height);
+        const bool written = writeRows(file, slot.pixels);
+        return fclose(file) == 0 && written;
+    }
+
+    void write()
+    {
+        while (true)
+        {
+            unsigned int slotIndex;
+            {
+                std::unique_lock<std::mutex> lock(writeMutex);
+                writeAvailable.wait(lock, [this]
+                                    { return stopping || !writeQueue.empty(); });
+                if (writeQueue.empty())
+                {
+                    break;
+                }
+                slotIndex = writeQueue.front();
+                writeQueue.pop_front();
+            }
+
+            Slot &slot = slots[slotIndex];
+            if (writeFrame(slot))
+            {
+                writtenFrames++;
+                bytesWritten += frameBytes;
+            }
+            else if (failedFrames++ == 0)
+            {
+                fprintf(stderr, "Failed to write captured frames to %s\n", path.c_str());
+            }
+            slot.isWritten.store(true, std::memory_order_release);
+        }
+        if (stream != NULL && fclose(stream) != 0)
+        {
+            failedFrames++;
+        }
+        stream = NULL;
+    }
+
+    void queueWrite(unsigned int slotIndex)
+    {
+        Slot &slot = slots[slotIndex];
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        slot.pixels = (const uint8_t *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (slot.pixels == NULL)
+        {
+            failedFrames++;
+            slot.state = SlotState::Free;
+            return;
+        }
+        slot.state = SlotState::Writing;
+        slot.isWritten.store(false, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            writeQueue.push_back(slotIndex);
+        }
+        writeAvailable.notify_one();
+    }
+
+    // Unmaps the buffers that the writer is done with and queues those whose readback has
+    // finished, oldest first to keep the order of the frames. With timeout 0 it only
+    // polls the fences; the frame flushes that follow each capture submit them.
+    void advance(GLuint64 timeoutNanoseconds)
+    {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            Slot &slot = slots[(nextSlot + i) % FRAMES_IN_FLIGHT];
+            if (slot.state == SlotState::Writing && slot.isWritten.load(std::memory_order_acquire))
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                slot.pixels = NULL;
+                slot.state = SlotState::Free;
+            }
+        }
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            const unsigned int slotIndex = (nextSlot + i) % FRAMES_IN_FLIGHT;
+            Slot &slot = slots[slotIndex];
+            if (slot.state != SlotState::Reading)
+            {
+                continue;
+            }
+            const GLenum status = glClientWaitSync(slot.fence, timeoutNanoseconds > 0 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeoutNanoseconds);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            {
+                break;
+            }
+            queueWrite(slotIndex);
+        }
+    }
+
+public:
+    FrameCapture(const std::string &path, unsigned int width, unsigned int height)
+        : path(path), isSequence(isFrameSequencePattern(path)), width(width), height(height), frameBytes(size_t(width) * height * 3),
+          writer([this]
+                 { write(); })
+    {
+        for (Slot &slot : slots)
+        {
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    ~FrameCapture()
+    {
+        finish();
+        for (Slot &slot : slots)
+        {
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // after rendering a frame of the given size into the bound read framebuffer, before
+    // swapping it; other sizes are dropped
+    void capture(unsigned int frameWidth, unsigned int frameHeight)
+    {
+        if (isFinished)
+        {
+            return;
+        }
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        advance(0);
+        Slot &slot = slots[nextSlot];
+        if (slot.state != SlotState::Free || frameWidth != width || frameHeight != height)
+        {
+            droppedFrames++;
+        }
+        else
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            slot.frame = offeredFrames;
+            slot.state = SlotState::Reading;
+            nextSlot = (nextSlot + 1) % FRAMES_IN_FLIGHT;
+        }
+        offeredFrames++;
+        captureMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // waits for the frames in flight to be written; later frames are ignored
+    void finish()
+    {
+        if (isFinished)
+        {
+            return;
+        }
+        isFinished = true;
+        advance(GLuint64(10) * 1000 * 1000 * 1000);
+        {
+            std::lock_guard<std::mutex> lock(writeMutex);
+            stopping = true;
+        }
+        writeAvailable.notify_one();
+        writer.join();
+        for (Slot &slot : slots)
+        {
+            if (slot.state == SlotState::Writing)
+            {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            else if (slot.state == SlotState::Reading)
+            {
+                glDeleteSync(slot.fence);
+                droppedFrames++;
+            }
+            slot.state = SlotState::Free;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    FrameCaptureStatistics getStatistics() const
+    {
+        return FrameCaptureStatistics{
+            .offeredFrames = offeredFrames,
+            .writtenFrames = writtenFrames,
+            .droppedFrames = droppedFrames,
+            .failedFrames = failedFrames,
+            .bytesWritten = bytesWritten,
+            .captureMilliseconds = captureMilliseconds,
+        };
+    }
+
+    const std::string &getPath() const
+    {
+        return path;
+    }
+
+    bool isImageSequence() const
+    {
+        return isSequence;
+    }
+
+    unsigned int getWidth() const
+    {
+        return width;
+    }
+
+    unsigned int getHeight() const
+    {
+        return height;
+    }
+};
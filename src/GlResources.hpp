@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <GL/glew.h>
 #include <fstream>
@@ -49,12 +50,30 @@ private:
     unsigned int bufferId;
 
 public:
-    GlVertexBuffer(const std::vector<glm::vec3> &vertices)
+    template <typename Vertex>
+    GlVertexBuffer(const std::vector<Vertex> &vertices)
     {
         glGenBuffers(1, &bufferId);
         glBindBuffer(GL_ARRAY_BUFFER, bufferId);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
     }
+
+    // Replaces the buffer contents, which must have the size given at construction. The
+    // old storage is orphaned first so that frames still reading it do not stall the upload.
+    template <typename Vertex>
+    void update(const std::vector<Vertex> &vertices)
+    {
+        update(&vertices[0], vertices.size() * sizeof(Vertex));
+    }
+
+    // the same from memory that is not a vector, for example a mapped file
+    void update(const void *vertices, size_t size)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices);
+    }
+
     ~GlVertexBuffer()
     {
         glDeleteBuffers(1, &bufferId);
@@ -72,6 +91,7 @@ public:
     {
         if (this != &buffer)
         {
+            glDeleteBuffers(1, &bufferId);
             bufferId = buffer.bufferId;
             buffer.bufferId = 0;
         }
@@ -90,11 +110,13 @@ private:
     unsigned int bufferId;
 
 public:
-    GlElementBuffer(const std::vector<unsigned int> &indices)
+    // 16-bit indices as uint16_t, 32-bit ones as unsigned int
+    template <typename Index>
+    GlElementBuffer(const std::vector<Index> &indices)
     {
         glGenBuffers(1, &bufferId);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferId);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(Index), &indices[0], GL_STATIC_DRAW);
     }
     ~GlElementBuffer()
     {
@@ -113,6 +135,7 @@ public:
     {
         if (this != &buffer)
         {
+            glDeleteBuffers(1, &bufferId);
             bufferId = buffer.bufferId;
             buffer.bufferId = 0;
         }
@@ -125,19 +148,156 @@ public:
     }
 };
 
+class GlVertexArrayObject
+{
+    GLuint vertexArrayId;
+
+public:
+    // leaves the new vertex array bound, so that buffers created right after it are
+    // attached to it rather than to whichever vertex array was bound before
+    GlVertexArrayObject()
+    {
+        glGenVertexArrays(1, &vertexArrayId);
+        glBindVertexArray(vertexArrayId);
+    }
+
+    ~GlVertexArrayObject()
+    {
+        glDeleteVertexArrays(1, &vertexArrayId);
+    }
+
+    GlVertexArrayObject(const GlVertexArrayObject &) = delete;
+    GlVertexArrayObject &operator=(const GlVertexArrayObject &) = delete;
+
+    GlVertexArrayObject(GlVertexArrayObject &&vertexArray) : vertexArrayId(vertexArray.vertexArrayId)
+    {
+        vertexArray.vertexArrayId = 0;
+    }
+
+    GlVertexArrayObject &operator=(GlVertexArrayObject &&vertexArray)
+    {
+        if (this != &vertexArray)
+        {
+            glDeleteVertexArrays(1, &vertexArrayId);
+            vertexArrayId = vertexArray.vertexArrayId;
+            vertexArray.vertexArrayId = 0;
+        }
+        return *this;
+    }
+
+    GLuint id() const
+    {
+        return vertexArrayId;
+    }
+};
+
+struct GlVertexAttribute
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+// Attaches per-instance attributes from the buffer, starting at the given byte offset, to
+// the vertex array; they advance once per instance of an instanced draw instead of once
+// per vertex.
+template <typename Instance>
+void attachInstanceAttributes(const GlVertexArrayObject &vertexArray, GLuint buffer, const std::vector<GlVertexAttribute> &attributes, size_t offset = 0)
+{
+    glBindVertexArray(vertexArray.id());
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (const GlVertexAttribute &attribute : attributes)
+    {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(Instance), (const void *)(offset + attribute.offset));
+        glVertexAttribDivisor(attribute.location, 1);
+    }
+    glBindVertexArray(0);
+}
+
+template <typename Index>
+constexpr GLenum glIndexType()
+{
+    static_assert(sizeof(Index) == 2 || sizeof(Index) == 4, "indices are 16 or 32 bits");
+    return sizeof(Index) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// A range of the indices of a mesh that is drawn on its own, with its indices relative to
+// baseVertex. This lets meshes of more vertices than 16 bits address use 16-bit indices.
+struct GlMeshChunk
+{
+    GLint baseVertex;
+    size_t firstIndex;
+    GLsizei numberOfIndices;
+};
+
+// ranges of the indices of a mesh that a single glMultiDrawElementsBaseVertex draws
+struct GlMultiDraw
+{
+    std::vector<GLsizei> counts;
+    // in bytes
+    std::vector<GLvoid *> offsets;
+    std::vector<GLint> baseVertices;
+
+    void clear()
+    {
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+    }
+
+    // extends the last range if the given one follows right after it
+    void add(const GlMeshChunk &range, size_t indexSize)
+    {
+        const size_t offset = range.firstIndex * indexSize;
+        if (!counts.empty() && baseVertices.back() == range.baseVertex && (size_t)offsets.back() + counts.back() * indexSize == offset)
+        {
+            counts.back() += range.numberOfIndices;
+            return;
+        }
+        counts.push_back(range.numberOfIndices);
+        offsets.push_back((GLvoid *)offset);
+        baseVertices.push_back(range.baseVertex);
+    }
+};
+
 class GlMesh
 {
 private:
+    GlVertexArrayObject vertexArray;
     GlVertexBuffer vertexBuffer;
     GlElementBuffer elementBuffer;
     unsigned int numberOfElements;
+    GLenum indexType;
+    size_t indexSize;
+    std::vector<GlMeshChunk> chunks;
+    size_t bytes;
 
 public:
-    GlMesh(const std::vector<glm::vec3> &vertices, const std::vector<unsigned int> &indices)
+    // without chunks, the whole mesh is a single one
+    template <typename Vertex, typename Index>
+    GlMesh(const std::vector<Vertex> &vertices, const std::vector<GlVertexAttribute> &attributes, const std::vector<Index> &indices,
+           std::vector<GlMeshChunk> meshChunks = {})
         : vertexBuffer(vertices),
           elementBuffer(indices),
-          numberOfElements(indices.size())
+          numberOfElements(indices.size()),
+          indexType(glIndexType<Index>()),
+          indexSize(sizeof(Index)),
+          chunks(std::move(meshChunks)),
+          bytes(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(Index))
     {
+        if (chunks.empty())
+        {
+            chunks.push_back(GlMeshChunk{0, 0, (GLsizei)indices.size()});
+        }
+        for (const GlVertexAttribute &attribute : attributes)
+        {
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(Vertex), (const void *)attribute.offset);
+        }
+        glBindVertexArray(0);
     }
 
     GlMesh(const GlMesh &) = delete;
@@ -146,11 +306,49 @@ public:
     GlMesh(GlMesh &&mesh) = default;
     GlMesh &operator=(GlMesh &&mesh) = default;
 
+    // binds the vertex array and draws every chunk
+    void draw() const
+    {
+        glBindVertexArray(vertexArray.id());
+        for (const GlMeshChunk &chunk : chunks)
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, chunk.numberOfIndices, indexType, (void *)(chunk.firstIndex * indexSize), chunk.baseVertex);
+        }
+    }
+
+    // binds the vertex array and draws the given ranges, whose offsets are for this index type
+    void draw(const GlMultiDraw &ranges) const
+    {
+        glBindVertexArray(vertexArray.id());
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, const_cast<GLsizei *>(ranges.counts.data()), indexType,
+                                      const_cast<GLvoid **>(ranges.offsets.data()), ranges.counts.size(), const_cast<GLint *>(ranges.baseVertices.data()));
+    }
+
+    void drawInstanced(size_t numberOfInstances) const
+    {
+        glBindVertexArray(vertexArray.id());
+        for (const GlMeshChunk &chunk : chunks)
+        {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, chunk.numberOfIndices, indexType, (void *)(chunk.firstIndex * indexSize),
+                                              numberOfInstances, chunk.baseVertex);
+        }
+    }
+
+    const GlVertexArrayObject &getVertexArray() const
+    {
+        return vertexArray;
+    }
+
     const GlVertexBuffer &getVertexBuffer() const
     {
         return vertexBuffer;
     }
 
+    GlVertexBuffer &getVertexBuffer()
+    {
+        return vertexBuffer;
+    }
+
     const GlElementBuffer &getElementBuffer() const
     {
         return elementBuffer;
@@ -160,6 +358,274 @@ public:
     {
         return numberOfElements;
     }
+
+    // GPU memory of the vertices and indices
+    size_t getBytes() const
+    {
+        return bytes;
+    }
+};
+
+// A single-channel float texture for lookup tables, filtered linearly and clamped at
+// the edges so that the outermost texels hold the values at the ends of the range.
+class GlFloatTexture
+{
+private:
+    GLuint textureId = 0;
+    unsigned int width;
+    unsigned int height;
+
+public:
+    GlFloatTexture(unsigned int width, unsigned int height, const float *values)
+        : width(width), height(height)
+    {
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, values);
+    }
+
+    ~GlFloatTexture()
+    {
+        glDeleteTextures(1, &textureId);
+    }
+
+    GlFloatTexture(const GlFloatTexture &) = delete;
+    GlFloatTexture &operator=(const GlFloatTexture &) = delete;
+
+    GlFloatTexture(GlFloatTexture &&texture) : textureId(texture.textureId), width(texture.width), height(texture.height)
+    {
+        texture.textureId = 0;
+    }
+
+    GlFloatTexture &operator=(GlFloatTexture &&texture)
+    {
+        if (this != &texture)
+        {
+            glDeleteTextures(1, &textureId);
+            textureId = texture.textureId;
+            width = texture.width;
+            height = texture.height;
+            texture.textureId = 0;
+        }
+        return *this;
+    }
+
+    // values must hold width * height floats, row by row
+    void update(const float *values)
+    {
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED, GL_FLOAT, values);
+    }
+
+    void bind(GLuint unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+    }
+
+    GLuint id() const
+    {
+        return textureId;
+    }
+};
+
+// A cube map of float data, filtered linearly and across faces, for values that are
+// looked up by direction from the center of a sphere.
+class GlCubeMapTexture
+{
+private:
+    GLuint textureId = 0;
+    unsigned int resolution;
+    GLenum format;
+
+public:
+    // internalFormat stores the data that update() takes in format, with one float per channel
+    GlCubeMapTexture(unsigned int resolution, GLenum internalFormat, GLenum format)
+        : resolution(resolution), format(format)
+    {
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, resolution, resolution, 0, format, GL_FLOAT, NULL);
+        }
+    }
+
+    ~GlCubeMapTexture()
+    {
+        glDeleteTextures(1, &textureId);
+    }
+
+    GlCubeMapTexture(const GlCubeMapTexture &) = delete;
+    GlCubeMapTexture &operator=(const GlCubeMapTexture &) = delete;
+
+    GlCubeMapTexture(GlCubeMapTexture &&texture) : textureId(texture.textureId), resolution(texture.resolution), format(texture.format)
+    {
+        texture.textureId = 0;
+    }
+
+    GlCubeMapTexture &operator=(GlCubeMapTexture &&texture)
+    {
+        if (this != &texture)
+        {
+            glDeleteTextures(1, &textureId);
+            textureId = texture.textureId;
+            resolution = texture.resolution;
+            format = texture.format;
+            texture.textureId = 0;
+        }
+        return *this;
+    }
+
+    // values must hold resolution * resolution texels, row by row
+    void update(unsigned int face, const float *values)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, resolution, resolution, format, GL_FLOAT, values);
+    }
+
+    void bind(GLuint unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+    }
+
+    unsigned int getResolution() const
+    {
+        return resolution;
+    }
+
+    GLuint id() const
+    {
+        return textureId;
+    }
+};
+
+// An offscreen render target with a color and a depth renderbuffer.
+class GlFramebuffer
+{
+private:
+    GLuint framebufferId = 0;
+    GLuint colorRenderbufferId = 0;
+    GLuint depthRenderbufferId = 0;
+
+public:
+    // leaves the new framebuffer bound
+    GlFramebuffer(unsigned int width, unsigned int height)
+    {
+        glGenRenderbuffers(1, &colorRenderbufferId);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbufferId);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthRenderbufferId);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbufferId);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+        glGenFramebuffers(1, &framebufferId);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbufferId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbufferId);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            throw -1;
+        }
+    }
+
+    ~GlFramebuffer()
+    {
+        glDeleteFramebuffers(1, &framebufferId);
+        glDeleteRenderbuffers(1, &colorRenderbufferId);
+        glDeleteRenderbuffers(1, &depthRenderbufferId);
+    }
+
+    GlFramebuffer(const GlFramebuffer &) = delete;
+    GlFramebuffer &operator=(const GlFramebuffer &) = delete;
+
+    GLuint id() const
+    {
+        return framebufferId;
+    }
+};
+
+// An offscreen render target whose color goes into a texture that later passes read with
+// texelFetch. It has no depth buffer.
+class GlTextureFramebuffer
+{
+private:
+    GLuint framebufferId = 0;
+    GLuint textureId = 0;
+    unsigned int width;
+    unsigned int height;
+
+public:
+    // leaves the previously bound framebuffer bound
+    GlTextureFramebuffer(unsigned int width, unsigned int height, GLenum internalFormat)
+        : width(width), height(height)
+    {
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+
+        GLint previousFramebuffer = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGenFramebuffers(1, &framebufferId);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
+        bool isComplete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        if (!isComplete)
+        {
+            glDeleteFramebuffers(1, &framebufferId);
+            glDeleteTextures(1, &textureId);
+            throw -1;
+        }
+    }
+
+    ~GlTextureFramebuffer()
+    {
+        glDeleteFramebuffers(1, &framebufferId);
+        glDeleteTextures(1, &textureId);
+    }
+
+    GlTextureFramebuffer(const GlTextureFramebuffer &) = delete;
+    GlTextureFramebuffer &operator=(const GlTextureFramebuffer &) = delete;
+
+    void bindTexture(GLuint unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+    }
+
+    GLuint id() const
+    {
+        return framebufferId;
+    }
+
+    unsigned int getWidth() const
+    {
+        return width;
+    }
+
+    unsigned int getHeight() const
+    {
+        return height;
+    }
 };
 
 struct GlShader
@@ -211,6 +677,43 @@ struct GlShaderProgram
 {
 private:
     GLuint programId;
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // resolves the locations of all active uniforms outside of uniform blocks once,
+    // so that drawing never has to look them up by name
+    void cacheUniformLocations()
+    {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            return;
+        }
+
+        GLint numberOfUniforms = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &numberOfUniforms);
+        glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+        std::vector<char> name(maxNameLength + 1);
+        for (GLint i = 0; i < numberOfUniforms; i++)
+        {
+            GLsizei nameLength;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(programId, i, name.size(), &nameLength, &size, &type, name.data());
+            std::string uniformName(name.data(), nameLength);
+            GLint location = glGetUniformLocation(programId, uniformName.c_str());
+            if (location < 0)
+            {
+                continue;
+            }
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            {
+                uniformName.resize(uniformName.size() - 3);
+            }
+            uniformLocations[uniformName] = location;
+        }
+    }
 
 public:
     GlShaderProgram(const std::vector<GlShader> &shaders)
@@ -220,14 +723,31 @@ public:
         {
             glAttachShader(programId, shader.id());
         }
+        // lets binary() return the program as linked, some drivers otherwise defer optimizations
+        if (glProgramParameteri != NULL)
+        {
+            glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
         glLinkProgram(programId);
+        cacheUniformLocations();
+    }
+
+    // from the output of binary(); the driver may reject it, which leaves the program unlinked
+    GlShaderProgram(GLenum binaryFormat, const std::vector<char> &binary)
+    {
+        programId = glCreateProgram();
+        glProgramBinary(programId, binaryFormat, binary.data(), binary.size());
+        // a format the driver no longer supports also raises GL_INVALID_ENUM
+        glGetError();
+        cacheUniformLocations();
     }
 
     GlShaderProgram(const GlShaderProgram &) = delete;
     GlShaderProgram operator=(const GlShaderProgram &) = delete;
 
     GlShaderProgram(GlShaderProgram &&program)
-        : programId(program.programId)
+        : programId(program.programId),
+          uniformLocations(std::move(program.uniformLocations))
 
     {
         program.programId = 0;
@@ -238,6 +758,7 @@ public:
         if (this != &other)
         {
             programId = other.programId;
+            uniformLocations = std::move(other.uniformLocations);
             other.programId = 0;
         }
         return *this;
@@ -252,14 +773,135 @@ public:
     {
         return programId;
     }
+
+    bool isLinked() const
+    {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // the linked program in a driver-specific format, empty if the driver has none
+    std::vector<char> binary(GLenum &binaryFormat) const
+    {
+        GLint length = 0;
+        glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+        std::vector<char> programBinary(length);
+        if (length > 0)
+        {
+            GLsizei writtenLength = 0;
+            glGetProgramBinary(programId, length, &writtenLength, &binaryFormat, programBinary.data());
+            programBinary.resize(writtenLength);
+        }
+        return programBinary;
+    }
+
+    // -1 for uniforms that the program does not use
+    GLint uniformLocation(const std::string &name) const
+    {
+        auto location = uniformLocations.find(name);
+        return location == uniformLocations.end() ? -1 : location->second;
+    }
+
+    // connects the named uniform block, if the program has one, to a buffer binding point
+    void bindUniformBlock(const std::string &blockName, GLuint binding) const
+    {
+        GLuint blockIndex = glGetUniformBlockIndex(programId, blockName.c_str());
+        if (blockIndex != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(programId, blockIndex, binding);
+        }
+    }
 };
 
-GlShader loadShader(GLenum shaderType, std::string path)
+// appends the shader at the path to the source, with the files that its #include "FILE"
+// lines name, relative to its own directory, in place of those lines. Each included file
+// is numbered as a source string of its own, the one after lastSourceString, which the
+// compiler's messages give with the line number, though Mesa reports 0 for all of them; a
+// comment before it names the file for compileShader(), and a #line directive after it
+// resumes the lines of the shader.
+void appendShaderSource(const std::string &path, unsigned int sourceString, unsigned int &lastSourceString, std::string &source)
 {
     std::ifstream shaderStream(path);
-    std::string shaderCode((std::istreambuf_iterator<char>(shaderStream)),
-                           (std::istreambuf_iterator<char>()));
+    if (!shaderStream)
+    {
+        fprintf(stderr, "Failed to read the shader %s\n", path.c_str());
+        return;
+    }
+    const size_t directoryEnd = path.find_last_of('/');
+    const std::string directory = directoryEnd == std::string::npos ? "" : path.substr(0, directoryEnd + 1);
+    const std::string directive = "#include \"";
+
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(shaderStream, line))
+    {
+        lineNumber++;
+        const size_t nameEnd = line.rfind('"');
+        if (line.compare(0, directive.size(), directive) == 0 && nameEnd > directive.size())
+        {
+            const std::string includedPath = directory + line.substr(directive.size(), nameEnd - directive.size());
+            const unsigned int includedSourceString = ++lastSourceString;
+            source += "// source string " + std::to_string(includedSourceString) + ": " + includedPath + "\n";
+            source += "#line 1 " + std::to_string(includedSourceString) + "\n";
+            appendShaderSource(includedPath, includedSourceString, lastSourceString, source);
+            source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceString) + "\n";
+            continue;
+        }
+        source += line + "\n";
+    }
+}
+
+// the shader as source string 0, see appendShaderSource()
+std::string readShaderSource(const std::string &path)
+{
+    std::string source;
+    unsigned int lastSourceString = 0;
+    appendShaderSource(path, 0, lastSourceString, source);
+    return source;
+}
+
+// a #define NAME VALUE line, or #define NAME for an empty value
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+typedef std::vector<ShaderDefine> ShaderDefines;
+
+// inserts the defines, and then the prelude of declarations that several shaders share,
+// after the #version line, which has to stay the first directive, or before the first line
+// of a shader without one; a #line directive after them keeps the line numbers of the
+// compiler's messages those of the file
+std::string injectShaderDefines(const std::string &source, const ShaderDefines &defines, const std::string &prelude = "")
+{
+    if (defines.empty() && prelude.empty())
+    {
+        return source;
+    }
+    std::string lines;
+    for (const ShaderDefine &define : defines)
+    {
+        lines += "#define " + define.name + (define.value.empty() ? "" : " " + define.value) + "\n";
+    }
+    lines += prelude;
+    const size_t version = source.find("#version");
+    if (version == std::string::npos)
+    {
+        return lines + "#line 1\n" + source;
+    }
+    lines += "#line 2\n";
+    const size_t endOfLine = source.find('\n', version);
+    if (endOfLine == std::string::npos)
+    {
+        return source + "\n" + lines;
+    }
+    return source.substr(0, endOfLine + 1) + lines + source.substr(endOfLine + 1);
+}
 
+GlShader compileShader(GLenum shaderType, const std::string &shaderCode)
+{
     GLint Result = GL_FALSE;
     int InfoLogLength;
 
@@ -272,11 +914,22 @@ GlShader loadShader(GLenum shaderType, std::string path)
         std::vector<char> shaderErrorMessage(InfoLogLength + 1);
         glGetShaderInfoLog(shader.id(), InfoLogLength, NULL, &shaderErrorMessage[0]);
         printf("%s\n", &shaderErrorMessage[0]);
+        // the files of the source strings that the messages refer to, see appendShaderSource()
+        const std::string sourceStringComment = "// source string ";
+        for (size_t start = shaderCode.find(sourceStringComment); start != std::string::npos; start = shaderCode.find(sourceStringComment, start + 1))
+        {
+            printf("%s\n", shaderCode.substr(start + 3, shaderCode.find('\n', start) - start - 3).c_str());
+        }
     }
 
     return shader;
 }
 
+GlShader loadShader(GLenum shaderType, std::string path, const ShaderDefines &defines = {}, const std::string &prelude = "")
+{
+    return compileShader(shaderType, injectShaderDefines(readShaderSource(path), defines, prelude));
+}
+
 GlShaderProgram
 createVertexFragmentShaderProgram(GlShader vertexShader, GlShader fragmentShader)
 {
@@ -300,27 +953,6 @@ createVertexFragmentShaderProgram(GlShader vertexShader, GlShader fragmentShader
     return shaderProgram;
 }
 
-class GlVertexArrayObject
-{
-    GLuint vertexArrayId;
-
-public:
-    GlVertexArrayObject()
-    {
-        glGenVertexArrays(1, &vertexArrayId);
-    }
-
-    ~GlVertexArrayObject()
-    {
-        glDeleteVertexArrays(1, &vertexArrayId);
-    }
-
-    GLuint id() const
-    {
-        return vertexArrayId;
-    }
-};
-
 struct Glfw
 {
     Glfw()
@@ -351,6 +983,8 @@ struct Glew
         {
             throw initResult;
         }
+        // glewInit queries GL_EXTENSIONS the compatibility way, which core profiles reject
+        glGetError();
     }
 };
 
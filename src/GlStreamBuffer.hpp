@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// GLEW 1.9 predates ARB_buffer_storage (core in OpenGL 4.4), so the entry point is looked
+// up with the loader of the context.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void(APIENTRY *GlBufferStorageFunction)(GLenum target, GLsizeiptr size, const GLvoid *data, GLbitfield flags);
+
+inline GlBufferStorageFunction &glBufferStorageFunction()
+{
+    static GlBufferStorageFunction function = NULL;
+    return function;
+}
+
+// Looks up glBufferStorage with the given loader, such as glfwGetProcAddress or
+// eglGetProcAddress, if the context has it; returns whether it does. Without it, stream
+// buffers fall back to orphaning.
+template <typename GetProcAddress>
+bool loadBufferStorage(GetProcAddress getProcAddress)
+{
+    GLint majorVersion = 0, minorVersion = 0, numberOfExtensions = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+    bool isSupported = majorVersion > 4 || (majorVersion == 4 && minorVersion >= 4);
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numberOfExtensions);
+    for (GLint i = 0; i < numberOfExtensions && !isSupported; i++)
+    {
+        isSupported = strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0;
+    }
+    glBufferStorageFunction() = isSupported ? (GlBufferStorageFunction)getProcAddress("glBufferStorage") : NULL;
+    return glBufferStorageFunction() != NULL;
+}
+
+struct GlBufferPoolStatistics
+{
+    bool isPersistent = false;
+    // buffer objects generated, handed out again from the pool and deleted
+    unsigned long allocations = 0;
+    unsigned long reuses = 0;
+    unsigned long deletions = 0;
+    // handed out and not released yet
+    size_t liveBuffers = 0;
+    size_t liveBytes = 0;
+    // released and waiting to be handed out again
+    size_t pooledBuffers = 0;
+    size_t pooledBytes = 0;
+    // by the stream buffers of the pool
+    uint64_t streamedBytes = 0;
+    unsigned long streamWrites = 0;
+    // writes that had to wait for the GPU to finish reading their region
+    unsigned long fenceWaits = 0;
+    unsigned long orphans = 0;
+};
+
+// Storage of a buffer pool. Persistent storage stays mapped for writing as long as it lives.
+struct GlPooledBuffer
+{
+    GLuint id = 0;
+    size_t capacity = 0;
+    uint8_t *mapping = NULL;
+    // after the last commands that used it, or 0
+    GLsync fence = 0;
+};
+
+// Recycles buffer objects of power of two sizes, so that buffers that are replaced or
+// resized do not generate and delete buffer objects over and over. Buffers are stored
+// persistently mapped with ARB_buffer_storage if loadBufferStorage() found it, and as
+// mutable GL_STREAM_DRAW storage otherwise. A released buffer may still be read by
+// commands in flight, so it keeps a fence that acquire() waits for. Above maxPooledBytes
+// released buffers are deleted instead.
+class GlBufferPool
+{
+private:
+    static const unsigned int MIN_SIZE_CLASS = 12;
+
+    bool isPersistent;
+    size_t maxPooledBytes;
+    std::vector<std::vector<GlPooledBuffer>> pooled;
+    GlBufferPoolStatistics statistics;
+
+    static unsigned int sizeClass(size_t size)
+    {
+        unsigned int sizeClass = MIN_SIZE_CLASS;
+        while ((size_t(1) << sizeClass) < size)
+        {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    void deleteBuffer(GlPooledBuffer &buffer)
+    {
+        if (buffer.fence != 0)
+        {
+            glDeleteSync(buffer.fence);
+        }
+        // deleting a buffer unmaps it
+        glDeleteBuffers(1, &buffer.id);
+        statistics.deletions++;
+    }
+
+public:
+    explicit GlBufferPool(size_t maxPooledBytes = size_t(64) << 20)
+        : isPersistent(glBufferStorageFunction() != NULL), maxPooledBytes(maxPooledBytes)
+    {
+        statistics.isPersistent = isPersistent;
+    }
+
+    ~GlBufferPool()
+    {
+        for (std::vector<GlPooledBuffer> &buffers : pooled)
+        {
+            for (GlPooledBuffer &buffer : buffers)
+            {
+                deleteBuffer(buffer);
+            }
+        }
+    }
+
+    GlBufferPool(const GlBufferPool &) = delete;
+    GlBufferPool &operator=(const GlBufferPool &) = delete;
+
+    bool isPersistentlyMapped() const
+    {
+        return isPersistent;
+    }
+
+    // of at least the given size, ready to be written
+    GlPooledBuffer acquire(size_t size)
+    {
+        const unsigned int bufferClass = sizeClass(size);
+        GlPooledBuffer buffer;
+        if (bufferClass < pooled.size() && !pooled[bufferClass].empty())
+        {
+            buffer = pooled[bufferClass].back();
+            pooled[bufferClass].pop_back();
+            statistics.pooledBuffers--;
+            statistics.pooledBytes -= buffer.capacity;
+            statistics.reuses++;
+            if (buffer.fence != 0)
+            {
+                if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                {
+                    statistics.fenceWaits++;
+                    glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                }
+                glDeleteSync(buffer.fence);
+                buffer.fence = 0;
+            }
+        }
+        else
+        {
+            buffer.capacity = size_t(1) << bufferClass;
+            glGenBuffers(1, &buffer.id);
+            // a binding point that no vertex array or draw depends on
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id);
+            if (isPersistent)
+            {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorageFunction()(GL_COPY_WRITE_BUFFER, buffer.capacity, NULL, flags);
+                buffer.mapping = (uint8_t *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, buffer.capacity, flags);
+            }
+            else
+            {
+                glBufferData(GL_COPY_WRITE_BUFFER, buffer.capacity, NULL, GL_STREAM_DRAW);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            statistics.allocations++;
+        }
+        statistics.liveBuffers++;
+        statistics.liveBytes += buffer.capacity;
+        return buffer;
+    }
+
+    // after the last commands that use the buffer were issued
+    void release(GlPooledBuffer buffer)
+    {
+        if (buffer.id == 0)
+        {
+            return;
+        }
+        statistics.liveBuffers--;
+        statistics.liveBytes -= buffer.capacity;
+        if (statistics.pooledBytes + buffer.capacity > maxPooledBytes)
+        {
+            deleteBuffer(buffer);
+            return;
+        }
+        if (buffer.fence != 0)
+        {
+            glDeleteSync(buffer.fence);
+        }
+        buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        const unsigned int bufferClass = sizeClass(buffer.capacity);
+        if (pooled.size() <= bufferClass)
+        {
+            pooled.resize(bufferClass + 1);
+        }
+        pooled[bufferClass].push_back(buffer);
+        statistics.pooledBuffers++;
+        statistics.pooledBytes += buffer.capacity;
+    }
+
+    // for the stream buffers of the pool
+    void countWrite(size_t bytes, bool hasWaited, bool hasOrphaned)
+    {
+        statistics.streamedBytes += bytes;
+        statistics.streamWrites++;
+        statistics.fenceWaits += hasWaited ? 1 : 0;
+        statistics.orphans += hasOrphaned ? 1 : 0;
+    }
+
+    const GlBufferPoolStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+};
+
+// A buffer for data that is written anew every frame, such as instances or uniforms. With
+// persistent mapping, the buffer is split into REGIONS regions that writes go through in
+// turn, and each write copies straight into the mapping; a fence after the commands that
+// read a region guards it from being overwritten before the GPU is done with it. Without,
+// each write orphans the storage and uploads into the new one. Writes return the offset of
+// their data in the buffer, to bind or point attributes at. A write larger than a region
+// moves to a larger buffer from the pool.
+class GlStreamBuffer
+{
+private:
+    static const unsigned int REGIONS = 3;
+
+    GlBufferPool *pool;
+    GlPooledBuffer buffer;
+    // a multiple of alignment
+    size_t regionSize = 0;
+    size_t alignment;
+    unsigned int region = 0;
+    GLsync regionFences[REGIONS] = {};
+
+    void deleteFences()
+    {
+        for (GLsync &fence : regionFences)
+        {
+            if (fence != 0)
+            {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+    }
+
+    void grow(size_t size)
+    {
+        deleteFences();
+        pool->release(buffer);
+        regionSize = (size + alignment - 1) / alignment * alignment;
+        buffer = pool->acquire(REGIONS * regionSize);
+        // the size class may leave room for larger regions
+        regionSize = buffer.capacity / REGIONS / alignment * alignment;
+        region = 0;
+    }
+
+public:
+    // alignment: of the offsets that writes return, such as GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    GlStreamBuffer(GlBufferPool &pool, size_t initialSize, size_t alignment = 16)
+        : pool(&pool), alignment(alignment)
+    {
+        grow(initialSize);
+    }
+
+    ~GlStreamBuffer()
+    {
+        if (pool != NULL)
+        {
+            deleteFences();
+            pool->release(buffer);
+        }
+    }
+
+    GlStreamBuffer(const GlStreamBuffer &) = delete;
+    GlStreamBuffer &operator=(const GlStreamBuffer &) = delete;
+
+    GlStreamBuffer(GlStreamBuffer &&stream)
+        : pool(stream.pool), buffer(stream.buffer), regionSize(stream.regionSize), alignment(stream.alignment), region(stream.region)
+    {
+        std::copy(stream.regionFences, stream.regionFences + REGIONS, regionFences);
+        std::fill(stream.regionFences, stream.regionFences + REGIONS, (GLsync)0);
+        stream.pool = NULL;
+        stream.buffer = GlPooledBuffer();
+    }
+
+    GlStreamBuffer &operator=(GlStreamBuffer &&stream)
+    {
+        if (this != &stream)
+        {
+            if (pool != NULL)
+            {
+                deleteFences();
+                pool->release(buffer);
+            }
+            pool = stream.pool;
+            buffer = stream.buffer;
+            regionSize = stream.regionSize;
+            alignment = stream.alignment;
+            region = stream.region;
+            std::copy(stream.regionFences, stream.regionFences + REGIONS, regionFences);
+            std::fill(stream.regionFences, stream.regionFences + REGIONS, (GLsync)0);
+            stream.pool = NULL;
+            stream.buffer = GlPooledBuffer();
+        }
+        return *this;
+    }
+
+    // Call after the commands that read the previous write were issued; those of a frame
+    // are, when the next frame writes again.
+    template <typename Element>
+    size_t write(const std::vector<Element> &elements)
+    {
+        return write(elements.data(), elements.size() * sizeof(Element));
+    }
+
+    size_t write(const void *data, size_t size)
+    {
+        if (size > regionSize)
+        {
+            grow(size);
+        }
+        if (!pool->isPersistentlyMapped())
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.id);
+            glBufferData(GL_COPY_WRITE_BUFFER, buffer.capacity, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            pool->countWrite(size, false, true);
+            return 0;
+        }
+
+        // the commands issued since the last write are the ones that read its region
+        if (regionFences[region] != 0)
+        {
+            glDeleteSync(regionFences[region]);
+        }
+        regionFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % REGIONS;
+        bool hasWaited = false;
+        if (regionFences[region] != 0)
+        {
+            if (glClientWaitSync(regionFences[region], 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                hasWaited = true;
+                glClientWaitSync(regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            }
+            glDeleteSync(regionFences[region]);
+            regionFences[region] = 0;
+        }
+        memcpy(buffer.mapping + region * regionSize, data, size);
+        pool->countWrite(size, hasWaited, false);
+        return region * regionSize;
+    }
+
+    GLuint id() const
+    {
+        return buffer.id;
+    }
+};
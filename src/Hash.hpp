@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const uint64_t FNV1A64_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = FNV1A64_OFFSET_BASIS)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t fnv1a64(const std::string &data, uint64_t hash = FNV1A64_OFFSET_BASIS)
+{
+    return fnv1a64(data.data(), data.size(), hash);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+struct Mesh
+{
+    std::vector<unsigned int> indices;
+    std::vector<glm::vec3> indexed_vertices;
+};
+
+static const double theta = 0.5 * (1.0 + sqrt(5.0));
+static const glm::vec3 ICOSAHEDRON_VERTICES[12] = {
+    glm::vec3(-1, theta, 0),
+    glm::vec3(1, theta, 0),
+    glm::vec3(-1, -theta, 0),
+    glm::vec3(1, -theta, 0),
+
+    glm::vec3(0, -1, theta),
+    glm::vec3(0, 1, theta),
+    glm::vec3(0, -1, -theta),
+    glm::vec3(0, 1, -theta),
+
+    glm::vec3(theta, 0, -1),
+    glm::vec3(theta, 0, 1),
+    glm::vec3(-theta, 0, -1),
+    glm::vec3(-theta, 0, 1)};
+
+static const unsigned int ICOSAHEDRON_INDICES[60] = {
+    0, 11, 5,
+    0, 5, 1,
+    0, 1, 7,
+    0, 7, 10,
+    0, 10, 11,
+
+    1, 5, 9,
+    5, 11, 4,
+    11, 10, 2,
+    10, 7, 6,
+    7, 1, 8,
+
+    3, 9, 4,
+    3, 4, 2,
+    3, 2, 6,
+    3, 6, 8,
+    3, 8, 9,
+
+    4, 9, 5,
+    2, 4, 11,
+    6, 2, 10,
+    8, 6, 7,
+    9, 8, 1};
+
+inline size_t icosphereTriangleCount(unsigned int subdivisions)
+{
+    return size_t(20) << (2 * subdivisions);
+}
+
+inline size_t icosphereEdgeCount(unsigned int subdivisions)
+{
+    return size_t(30) << (2 * subdivisions);
+}
+
+inline size_t icosphereVertexCount(unsigned int subdivisions)
+{
+    return (size_t(10) << (2 * subdivisions)) + 2;
+}
+
+// the length of the longest edges, which subdividing halves; those of the icosahedron
+// span 1.0515 times its circumradius
+inline float icosphereVertexSpacing(float radius, unsigned int subdivisions)
+{
+    return radius * 1.0515f / float(1u << subdivisions);
+}
+
+// Every subdivision pass splits each edge at its midpoint and each triangle into four.
+// Edges are kept in a table alongside the triangles so that the midpoint of an edge is
+// created exactly once, at index (previous vertex count + edge id). All vertex, index and
+// edge ids of a pass follow in closed form from the previous pass, which lets edges and
+// triangles be processed independently across the thread pool.
+inline Mesh generateSphere(float radius, unsigned int subdivisions, ThreadPool &threadPool)
+{
+    Mesh sphere;
+    sphere.indexed_vertices.resize(icosphereVertexCount(subdivisions));
+
+    std::vector<glm::uvec2> edges;
+    std::vector<unsigned int> triangleEdges;
+    std::vector<glm::uvec2> subdividedEdges;
+    std::vector<unsigned int> subdividedTriangleEdges;
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> subdividedIndices;
+
+    const size_t finalEdgeCount = icosphereEdgeCount(subdivisions > 0 ? subdivisions - 1 : 0);
+    const size_t finalTriangleCount = icosphereTriangleCount(subdivisions);
+    edges.reserve(finalEdgeCount);
+    subdividedEdges.reserve(finalEdgeCount);
+    triangleEdges.reserve(3 * finalTriangleCount / 4);
+    subdividedTriangleEdges.reserve(3 * finalTriangleCount / 4);
+    indices.reserve(3 * finalTriangleCount);
+    subdividedIndices.reserve(3 * finalTriangleCount);
+
+    for (int i = 0; i < 12; i++)
+    {
+        sphere.indexed_vertices[i] = glm::normalize(ICOSAHEDRON_VERTICES[i]) * radius;
+    }
+
+    indices.assign(ICOSAHEDRON_INDICES, ICOSAHEDRON_INDICES + 60);
+    triangleEdges.resize(60);
+    for (unsigned int i = 0; i < 60; i++)
+    {
+        const unsigned int a = ICOSAHEDRON_INDICES[i];
+        const unsigned int b = ICOSAHEDRON_INDICES[i - i % 3 + (i + 1) % 3];
+        const glm::uvec2 edge(glm::min(a, b), glm::max(a, b));
+        size_t edgeIndex = 0;
+        while (edgeIndex < edges.size() && edges[edgeIndex] != edge)
+        {
+            edgeIndex++;
+        }
+        if (edgeIndex == edges.size())
+        {
+            edges.push_back(edge);
+        }
+        triangleEdges[i] = edgeIndex;
+    }
+
+    size_t vertexCount = 12;
+    for (unsigned int s = 0; s < subdivisions; s++)
+    {
+        const bool isLastPass = s + 1 == subdivisions;
+        const size_t edgeCount = edges.size();
+        const size_t triangleCount = indices.size() / 3;
+        const unsigned int firstMidpoint = vertexCount;
+
+        subdividedIndices.resize(12 * triangleCount);
+        if (!isLastPass)
+        {
+            subdividedEdges.resize(2 * edgeCount + 3 * triangleCount);
+            subdividedTriangleEdges.resize(12 * triangleCount);
+        }
+
+        threadPool.parallelFor(edgeCount, [&](size_t begin, size_t end)
+                               {
+            for (size_t e = begin; e < end; e++)
+            {
+                const glm::uvec2 edge = edges[e];
+                const unsigned int midpoint = firstMidpoint + e;
+                const glm::vec3 ab = sphere.indexed_vertices[edge.x] + sphere.indexed_vertices[edge.y];
+                sphere.indexed_vertices[midpoint] = glm::normalize(ab) * radius;
+                if (!isLastPass)
+                {
+                    subdividedEdges[2 * e] = glm::uvec2(edge.x, midpoint);
+                    subdividedEdges[2 * e + 1] = glm::uvec2(midpoint, edge.y);
+                }
+            } });
+
+        threadPool.parallelFor(triangleCount, [&](size_t begin, size_t end)
+                               {
+            for (size_t t = begin; t < end; t++)
+            {
+                const unsigned int aIndex = indices[3 * t];
+                const unsigned int bIndex = indices[3 * t + 1];
+                const unsigned int cIndex = indices[3 * t + 2];
+
+                const unsigned int abEdge = triangleEdges[3 * t];
+                const unsigned int bcEdge = triangleEdges[3 * t + 1];
+                const unsigned int caEdge = triangleEdges[3 * t + 2];
+
+                const unsigned int abIndex = firstMidpoint + abEdge;
+                const unsigned int bcIndex = firstMidpoint + bcEdge;
+                const unsigned int caIndex = firstMidpoint + caEdge;
+
+                unsigned int *subdivided = &subdividedIndices[12 * t];
+                subdivided[0] = aIndex;
+                subdivided[1] = abIndex;
+                subdivided[2] = caIndex;
+
+                subdivided[3] = bIndex;
+                subdivided[4] = bcIndex;
+                subdivided[5] = abIndex;
+
+                subdivided[6] = cIndex;
+                subdivided[7] = caIndex;
+                subdivided[8] = bcIndex;
+
+                subdivided[9] = abIndex;
+                subdivided[10] = bcIndex;
+                subdivided[11] = caIndex;
+
+                if (isLastPass)
+                {
+                    continue;
+                }
+
+                // half of a split edge that touches the given end point
+                auto half = [&](unsigned int edge, unsigned int vertex)
+                {
+                    return edges[edge].x == vertex ? 2 * edge : 2 * edge + 1;
+                };
+                const unsigned int interiorEdge = 2 * edgeCount + 3 * t;
+
+                unsigned int *subdividedEdgeIds = &subdividedTriangleEdges[12 * t];
+                subdividedEdgeIds[0] = half(abEdge, aIndex);
+                subdividedEdgeIds[1] = interiorEdge + 2;
+                subdividedEdgeIds[2] = half(caEdge, aIndex);
+
+                subdividedEdgeIds[3] = half(bcEdge, bIndex);
+                subdividedEdgeIds[4] = interiorEdge;
+                subdividedEdgeIds[5] = half(abEdge, bIndex);
+
+                subdividedEdgeIds[6] = half(caEdge, cIndex);
+                subdividedEdgeIds[7] = interiorEdge + 1;
+                subdividedEdgeIds[8] = half(bcEdge, cIndex);
+
+                subdividedEdgeIds[9] = interiorEdge;
+                subdividedEdgeIds[10] = interiorEdge + 1;
+                subdividedEdgeIds[11] = interiorEdge + 2;
+
+                subdividedEdges[interiorEdge] = glm::uvec2(abIndex, bcIndex);
+                subdividedEdges[interiorEdge + 1] = glm::uvec2(bcIndex, caIndex);
+                subdividedEdges[interiorEdge + 2] = glm::uvec2(caIndex, abIndex);
+            } });
+
+        vertexCount += edgeCount;
+        indices.swap(subdividedIndices);
+        edges.swap(subdividedEdges);
+        triangleEdges.swap(subdividedTriangleEdges);
+    }
+
+    sphere.indices.swap(indices);
+    return sphere;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// What the controls ask for during one frame, whether they come from the keyboard or
+// from a script.
+struct InputState
+{
+    bool rotateUp = false;
+    bool rotateDown = false;
+    bool rotateLeft = false;
+    bool rotateRight = false;
+    bool zoomIn = false;
+    bool zoomOut = false;
+    bool newPlanet = false;
+    bool toggleBakedTerrain = false;
+    bool toggleTerrainLod = false;
+    bool toggleAtmosphereTables = false;
+    bool cycleAtmosphereResolution = false;
+    bool toggleHeightfield = false;
+};
+
+struct InputScriptStep
+{
+    unsigned int frames;
+    InputState input;
+};
+
+// A sequence of inputs, each held for a number of frames. In the text form every line
+// reads "<frames> <input>...", where the inputs are up, down, left, right, zoom-in,
+// zoom-out, new-planet, toggle-baked, toggle-lod, toggle-atmosphere-tables,
+// cycle-atmosphere-resolution and toggle-heightfield; '#' starts a comment. The script repeats once it runs out.
+struct InputScript
+{
+    std::vector<InputScriptStep> steps;
+
+    InputState inputAt(unsigned int frame) const
+    {
+        unsigned int length = 0;
+        for (const InputScriptStep &step : steps)
+        {
+            length += step.frames;
+        }
+        if (length == 0)
+        {
+            return InputState();
+        }
+
+        frame %= length;
+        for (const InputScriptStep &step : steps)
+        {
+            if (frame < step.frames)
+            {
+                return step.input;
+            }
+            frame -= step.frames;
+        }
+        return InputState();
+    }
+};
+
+// orbits the planet, dives towards the surface and climbs back out
+InputScript defaultInputScript()
+{
+    InputState orbit;
+    orbit.rotateRight = true;
+
+    InputState dive = orbit;
+    dive.zoomIn = true;
+
+    InputState skim;
+    skim.rotateUp = true;
+
+    InputState climb = orbit;
+    climb.zoomOut = true;
+
+    return InputScript{
+        .steps = {
+            {120, orbit},
+            {120, dive},
+            {120, skim},
+            {120, climb},
+        },
+    };
+}
+
+bool parseInputName(const std::string &name, InputState &input)
+{
+    if (name == "up")
+        input.rotateUp = true;
+    else if (name == "down")
+        input.rotateDown = true;
+    else if (name == "left")
+        input.rotateLeft = true;
+    else if (name == "right")
+        input.rotateRight = true;
+    else if (name == "zoom-in")
+        input.zoomIn = true;
+    else if (name == "zoom-out")
+        input.zoomOut = true;
+    else if (name == "new-planet")
+        input.newPlanet = true;
+    else if (name == "toggle-baked")
+        input.toggleBakedTerrain = true;
+    else if (name == "toggle-lod")
+        input.toggleTerrainLod = true;
+    else if (name == "toggle-atmosphere-tables")
+        input.toggleAtmosphereTables = true;
+    else if (name == "cycle-atmosphere-resolution")
+        input.cycleAtmosphereResolution = true;
+    else if (name == "toggle-heightfield")
+        input.toggleHeightfield = true;
+    else
+        return false;
+    return true;
+}
+
+InputScript loadInputScript(const std::string &path)
+{
+    std::ifstream scriptStream(path);
+    if (!scriptStream)
+    {
+        fprintf(stderr, "Failed to open input script %s\n", path.c_str());
+        throw -1;
+    }
+
+    InputScript script;
+    std::string line;
+    unsigned int lineNumber = 0;
+    while (std::getline(scriptStream, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream lineStream(line);
+        InputScriptStep step{.frames = 0, .input = InputState()};
+        if (!(lineStream >> step.frames))
+        {
+            continue;
+        }
+        std::string name;
+        while (lineStream >> name)
+        {
+            if (!parseInputName(name, step.input))
+            {
+                fprintf(stderr, "%s:%u: unknown input '%s'\n", path.c_str(), lineNumber, name.c_str());
+                throw -1;
+            }
+        }
+        script.steps.push_back(step);
+    }
+    return script;
+}
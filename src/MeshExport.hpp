@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TerrainBaker.hpp"
+
+// Writers of baked planets as binary meshes that other tools open: PLY and binary glTF
+// (GLB). Both keep the vertex layout of BakedTerrainVertex apart from the slope and write
+// straight from the baked vertices, without building the whole file in memory. They
+// return whether the file was written completely.
+
+enum class MeshExportFormat
+{
+    Ply,
+    Glb,
+};
+
+inline const char *meshExportExtension(MeshExportFormat format)
+{
+    return format == MeshExportFormat::Ply ? "ply" : "glb";
+}
+
+// positions and normals of a run of vertices, interleaved as both formats store them
+inline void packPositionsAndNormals(const BakedTerrainVertex *vertices, size_t count, std::vector<float> &packed)
+{
+    packed.resize(6 * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        packed[6 * i + 0] = vertices[i].position.x;
+        packed[6 * i + 1] = vertices[i].position.y;
+        packed[6 * i + 2] = vertices[i].position.z;
+        packed[6 * i + 3] = vertices[i].normal.x;
+        packed[6 * i + 4] = vertices[i].normal.y;
+        packed[6 * i + 5] = vertices[i].normal.z;
+    }
+}
+
+inline bool writeVertices(FILE *file, const std::vector<BakedTerrainVertex> &vertices)
+{
+    const size_t blockSize = 4096;
+    std::vector<float> packed;
+    for (size_t begin = 0; begin < vertices.size(); begin += blockSize)
+    {
+        const size_t count = std::min(blockSize, vertices.size() - begin);
+        packPositionsAndNormals(&vertices[begin], count, packed);
+        if (fwrite(packed.data(), sizeof(float), packed.size(), file) != packed.size())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// binary_little_endian, which is the byte order of every platform the planets are built on
+inline bool writePly(const std::string &path, const std::vector<BakedTerrainVertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool isWritten = fprintf(file,
+                             "ply\n"
+                             "format binary_little_endian 1.0\n"
+                             "element vertex %zu\n"
+                             "property float x\n"
+                             "property float y\n"
+                             "property float z\n"
+                             "property float nx\n"
+                             "property float ny\n"
+                             "property float nz\n"
+                             "element face %zu\n"
+                             "property list uchar uint vertex_indices\n"
+                             "end_header\n",
+                             vertices.size(), indices.size() / 3) > 0;
+    isWritten = isWritten && writeVertices(file, vertices);
+
+    // each face is its vertex count followed by three indices, 13 bytes without padding
+    const size_t facesPerBlock = 4096;
+    std::vector<unsigned char> faces(13 * facesPerBlock);
+    for (size_t begin = 0; isWritten && begin < indices.size() / 3; begin += facesPerBlock)
+    {
+        const size_t count = std::min(facesPerBlock, indices.size() / 3 - begin);
+        for (size_t i = 0; i < count; i++)
+        {
+            faces[13 * i] = 3;
+            memcpy(&faces[13 * i + 1], &indices[3 * (begin + i)], 3 * sizeof(unsigned int));
+        }
+        isWritten = fwrite(faces.data(), 13, count, file) == count;
+    }
+    return fclose(file) == 0 && isWritten;
+}
+
+// A single mesh with one triangle list, positions and normals interleaved in one buffer
+// view and the indices in another. The JSON chunk is padded with spaces to a multiple of
+// four bytes, as the GLB container requires.
+inline bool writeGlb(const std::string &path, const std::vector<BakedTerrainVertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    glm::vec3 minPosition(INFINITY), maxPosition(-INFINITY);
+    for (const BakedTerrainVertex &vertex : vertices)
+    {
+        minPosition = glm::min(minPosition, vertex.position);
+        maxPosition = glm::max(maxPosition, vertex.position);
+    }
+
+    const size_t vertexBytes = vertices.size() * 6 * sizeof(float);
+    const size_t indexBytes = indices.size() * sizeof(unsigned int);
+    const size_t binaryBytes = vertexBytes + indexBytes;
+
+    char json[2048];
+    int jsonLength = snprintf(json, sizeof(json),
+                              "{\"asset\":{\"version\":\"2.0\",\"generator\":\"procedural-planets\"},"
+                              "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+                              "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],"
+                              "\"buffers\":[{\"byteLength\":%zu}],"
+                              "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu,\"byteStride\":24,\"target\":34962},"
+                              "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}],"
+                              "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\","
+                              "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+                              "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\"},"
+                              "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}]}",
+                              binaryBytes, vertexBytes, vertexBytes, indexBytes, vertices.size(),
+                              minPosition.x, minPosition.y, minPosition.z, maxPosition.x, maxPosition.y, maxPosition.z,
+                              vertices.size(), indices.size());
+    if (jsonLength < 0 || jsonLength + 3 >= (int)sizeof(json))
+    {
+        return false;
+    }
+    while (jsonLength % 4 != 0)
+    {
+        json[jsonLength++] = ' ';
+    }
+
+    // vertices and indices are multiples of four bytes, so the binary chunk needs no padding
+    const uint32_t header[3] = {0x46546C67, 2, uint32_t(12 + 8 + jsonLength + 8 + binaryBytes)};
+    const uint32_t jsonChunk[2] = {uint32_t(jsonLength), 0x4E4F534A};
+    const uint32_t binaryChunk[2] = {uint32_t(binaryBytes), 0x004E4942};
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool isWritten = fwrite(header, sizeof(header), 1, file) == 1 &&
+                     fwrite(jsonChunk, sizeof(jsonChunk), 1, file) == 1 &&
+                     fwrite(json, 1, jsonLength, file) == size_t(jsonLength) &&
+                     fwrite(binaryChunk, sizeof(binaryChunk), 1, file) == 1 &&
+                     writeVertices(file, vertices) &&
+                     fwrite(indices.data(), sizeof(unsigned int), indices.size(), file) == indices.size();
+    return fclose(file) == 0 && isWritten;
+}
+
+inline bool writeMesh(MeshExportFormat format, const std::string &path, const std::vector<BakedTerrainVertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    return format == MeshExportFormat::Ply ? writePly(path, vertices, indices) : writeGlb(path, vertices, indices);
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Icosphere.hpp"
+
+// Reordering of triangle lists for the post-transform vertex cache, which lets the GPU
+// reuse the shaded result of a vertex for the triangles after it, and of vertices for
+// fetching them in the order that the triangles use them. Both keep the set of triangles
+// and their winding. The functions take 32-bit as well as 16-bit indices, and work on a
+// range of an index list so that the chunks of a mesh can be processed on their own.
+//
+// There is no ordering for overdraw. The displaced terrain is not convex, but with its
+// back faces culled, as renderPlanet() draws the planet sphere, its front faces rarely
+// overlap: from 24 views of a baked planet, from afar to grazing ones just above the
+// mountains, 1.005 fragments pass the depth test per covered pixel. Sorting the runs of
+// the vertex cache order as Sander et al. do, outer ones first or last, left that
+// unchanged and raised the ACMR from 0.72 to 0.75.
+
+struct VertexCacheStatistics
+{
+    size_t triangles = 0;
+    size_t referencedVertices = 0;
+    // vertex shader invocations
+    size_t misses = 0;
+
+    // average cache miss ratio: invocations per triangle, 0.5 at best for large meshes
+    double acmr() const
+    {
+        return triangles == 0 ? 0 : double(misses) / triangles;
+    }
+
+    // average transformed vertex ratio: invocations per vertex, 1 at best
+    double atvr() const
+    {
+        return referencedVertices == 0 ? 0 : double(misses) / referencedVertices;
+    }
+
+    void add(const VertexCacheStatistics &statistics)
+    {
+        triangles += statistics.triangles;
+        referencedVertices += statistics.referencedVertices;
+        misses += statistics.misses;
+    }
+};
+
+// simulates a FIFO cache of the given size, as found in common hardware
+template <typename Index>
+VertexCacheStatistics analyzeVertexCache(const Index *indices, size_t numberOfIndices, size_t numberOfVertices, unsigned int cacheSize = 16)
+{
+    VertexCacheStatistics statistics;
+    statistics.triangles = numberOfIndices / 3;
+    std::vector<size_t> insertedAt(numberOfVertices, 0);
+    for (size_t i = 0; i < numberOfIndices; i++)
+    {
+        const Index index = indices[i];
+        statistics.referencedVertices += insertedAt[index] == 0;
+        // a vertex is in the cache while fewer than cacheSize misses came after its own
+        if (insertedAt[index] == 0 || statistics.misses - insertedAt[index] >= cacheSize)
+        {
+            statistics.misses++;
+            insertedAt[index] = statistics.misses;
+        }
+    }
+    return statistics;
+}
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": triangles are emitted greedily by
+// the score of their vertices, which favours vertices that were used recently and vertices
+// with few triangles left, modelled on an LRU cache of 32 entries.
+template <typename Index>
+void optimizeVertexCache(Index *indices, size_t numberOfIndices, size_t numberOfVertices)
+{
+    const int cacheSize = 32;
+    const size_t numberOfTriangles = numberOfIndices / 3;
+    if (numberOfTriangles == 0)
+    {
+        return;
+    }
+
+    // tabulated by cache position + 1 and by the number of remaining triangles
+    const unsigned int maxTabulatedTriangles = 16;
+    float cacheScores[cacheSize + 1];
+    float valenceScores[maxTabulatedTriangles + 1];
+    cacheScores[0] = 0;
+    for (int position = 0; position < cacheSize; position++)
+    {
+        // the triangle that was just added gains nothing from using its vertices again
+        cacheScores[position + 1] = position < 3 ? 0.75f : std::pow(1.0f - float(position - 3) / (cacheSize - 3), 1.5f);
+    }
+    valenceScores[0] = -1;
+    for (unsigned int triangles = 1; triangles <= maxTabulatedTriangles; triangles++)
+    {
+        valenceScores[triangles] = 2.0f / std::sqrt(float(triangles));
+    }
+    auto vertexScore = [&](int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+        {
+            return -1.0f;
+        }
+        return cacheScores[cachePosition + 1] + valenceScores[std::min(remainingTriangles, maxTabulatedTriangles)];
+    };
+
+    // the triangles of each vertex, of which the first remainingTriangles are not emitted yet
+    std::vector<unsigned int> triangleOffsets(numberOfVertices + 1, 0);
+    for (size_t corner = 0; corner < numberOfIndices; corner++)
+    {
+        triangleOffsets[indices[corner] + 1]++;
+    }
+    for (size_t vertex = 0; vertex < numberOfVertices; vertex++)
+    {
+        triangleOffsets[vertex + 1] += triangleOffsets[vertex];
+    }
+    std::vector<unsigned int> vertexTriangles(numberOfIndices);
+    std::vector<unsigned int> remainingTriangles(numberOfVertices, 0);
+    for (size_t corner = 0; corner < numberOfIndices; corner++)
+    {
+        const Index vertex = indices[corner];
+        vertexTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]++] = corner / 3;
+    }
+
+    std::vector<int> cachePositions(numberOfVertices, -1);
+    std::vector<float> vertexScores(numberOfVertices);
+    for (size_t vertex = 0; vertex < numberOfVertices; vertex++)
+    {
+        vertexScores[vertex] = vertexScore(-1, remainingTriangles[vertex]);
+    }
+    std::vector<bool> isEmitted(numberOfTriangles, false);
+
+    std::vector<Index> optimized;
+    optimized.reserve(numberOfIndices);
+    std::vector<Index> cache, nextCache;
+    cache.reserve(cacheSize + 3);
+    nextCache.reserve(cacheSize + 3);
+    size_t nextUnemitted = 0;
+    size_t bestTriangle = 0;
+    while (true)
+    {
+        isEmitted[bestTriangle] = true;
+        const Index *corners = &indices[3 * bestTriangle];
+        optimized.insert(optimized.end(), corners, corners + 3);
+
+        nextCache.assign(corners, corners + 3);
+        for (Index vertex : cache)
+        {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+            {
+                nextCache.push_back(vertex);
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            const Index vertex = corners[i];
+            unsigned int *triangles = &vertexTriangles[triangleOffsets[vertex]];
+            unsigned int *emitted = std::find(triangles, triangles + remainingTriangles[vertex], (unsigned int)bestTriangle);
+            std::swap(*emitted, triangles[--remainingTriangles[vertex]]);
+        }
+        for (size_t position = 0; position < nextCache.size(); position++)
+        {
+            const Index vertex = nextCache[position];
+            cachePositions[vertex] = position < size_t(cacheSize) ? position : -1;
+            vertexScores[vertex] = vertexScore(cachePositions[vertex], remainingTriangles[vertex]);
+        }
+
+        // the best triangle among those around the cached vertices, whose scores changed
+        float bestScore = -1;
+        for (Index vertex : nextCache)
+        {
+            const unsigned int *triangles = &vertexTriangles[triangleOffsets[vertex]];
+            for (unsigned int i = 0; i < remainingTriangles[vertex]; i++)
+            {
+                const unsigned int triangle = triangles[i];
+                const float score = vertexScores[indices[3 * triangle]] + vertexScores[indices[3 * triangle + 1]] + vertexScores[indices[3 * triangle + 2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = triangle;
+                }
+            }
+        }
+        nextCache.resize(std::min(nextCache.size(), size_t(cacheSize)));
+        std::swap(cache, nextCache);
+
+        if (bestScore < 0)
+        {
+            // the cache has no triangles left around it: continue with the first one not emitted
+            while (nextUnemitted < numberOfTriangles && isEmitted[nextUnemitted])
+            {
+                nextUnemitted++;
+            }
+            if (nextUnemitted == numberOfTriangles)
+            {
+                break;
+            }
+            bestTriangle = nextUnemitted;
+        }
+    }
+    std::copy(optimized.begin(), optimized.end(), indices);
+}
+
+// Renumbers the vertices in the order that the indices first use them and returns the
+// vertex that each new one was before; vertices without triangles are dropped.
+template <typename Index>
+std::vector<unsigned int> optimizeVertexFetch(Index *indices, size_t numberOfIndices, size_t numberOfVertices)
+{
+    const unsigned int unassigned = ~0u;
+    std::vector<unsigned int> newIndices(numberOfVertices, unassigned);
+    std::vector<unsigned int> sourceVertices;
+    sourceVertices.reserve(numberOfVertices);
+    for (size_t i = 0; i < numberOfIndices; i++)
+    {
+        const Index index = indices[i];
+        if (newIndices[index] == unassigned)
+        {
+            newIndices[index] = sourceVertices.size();
+            sourceVertices.push_back(index);
+        }
+        indices[i] = newIndices[index];
+    }
+    return sourceVertices;
+}
+
+template <typename Vertex>
+void remapVertices(std::vector<Vertex> &vertices, const std::vector<unsigned int> &sourceVertices)
+{
+    std::vector<Vertex> remapped(sourceVertices.size());
+    for (size_t i = 0; i < sourceVertices.size(); i++)
+    {
+        remapped[i] = vertices[sourceVertices[i]];
+    }
+    vertices.swap(remapped);
+}
+
+struct MeshOptimization
+{
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+
+    void add(const MeshOptimization &optimization)
+    {
+        before.add(optimization.before);
+        after.add(optimization.after);
+    }
+};
+
+// both passes on a generated mesh, before it is uploaded or baked
+inline MeshOptimization optimizeMesh(Mesh &mesh)
+{
+    std::vector<unsigned int> &indices = mesh.indices;
+    MeshOptimization optimization;
+    optimization.before = analyzeVertexCache(indices.data(), indices.size(), mesh.indexed_vertices.size());
+    optimizeVertexCache(indices.data(), indices.size(), mesh.indexed_vertices.size());
+    remapVertices(mesh.indexed_vertices, optimizeVertexFetch(indices.data(), indices.size(), mesh.indexed_vertices.size()));
+    optimization.after = analyzeVertexCache(indices.data(), indices.size(), mesh.indexed_vertices.size());
+    return optimization;
+}
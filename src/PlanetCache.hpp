@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Hash.hpp"
+
+// Everything the baked data of a planet depends on. The seed is the one that the planet
+// was generated with; the noise offset follows from it and the planets before.
+struct PlanetDescription
+{
+    uint32_t seed;
+    glm::vec3 noiseOffset;
+    float baseRadius;
+    float maxDepth;
+    float maxHeight;
+    uint32_t sphereSubdivisions;
+    uint32_t heightfieldResolution;
+};
+
+// The step from the noise offset of the previous planet to the one generated with the given
+// seed. The planet that a seed generates from the start planet has this as its noise offset.
+inline glm::vec3 planetNoiseOffsetStep(uint32_t seed)
+{
+    std::mt19937 planetGenerator(seed);
+    float phi = std::uniform_real_distribution<>(0.0f, 3.14f)(planetGenerator);
+    float theta = std::uniform_real_distribution<>(-1.57f, 1.57f)(planetGenerator);
+    return 0.5f * glm::vec3(glm::sin(theta) * glm::cos(phi), glm::sin(theta) * glm::sin(phi), glm::cos(phi));
+}
+
+// field by field, so that padding does not enter the hash
+inline uint64_t planetId(const PlanetDescription &description)
+{
+    uint64_t hash = fnv1a64(&description.seed, sizeof(description.seed));
+    hash = fnv1a64(&description.noiseOffset[0], 3 * sizeof(float), hash);
+    hash = fnv1a64(&description.baseRadius, sizeof(float), hash);
+    hash = fnv1a64(&description.maxDepth, sizeof(float), hash);
+    hash = fnv1a64(&description.maxHeight, sizeof(float), hash);
+    hash = fnv1a64(&description.sphereSubdivisions, sizeof(uint32_t), hash);
+    return fnv1a64(&description.heightfieldResolution, sizeof(uint32_t), hash);
+}
+
+// A read-only mapping of a whole file, empty if the file cannot be mapped.
+class MappedFile
+{
+private:
+    const char *mapping = NULL;
+    size_t mappingSize = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE fileMapping = NULL;
+#endif
+
+    void unmap()
+    {
+#ifdef _WIN32
+        if (mapping != NULL)
+            UnmapViewOfFile(mapping);
+        if (fileMapping != NULL)
+            CloseHandle(fileMapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        fileMapping = NULL;
+#else
+        if (mapping != NULL)
+            munmap((void *)mapping, mappingSize);
+#endif
+        mapping = NULL;
+        mappingSize = 0;
+    }
+
+public:
+    explicit MappedFile(const std::string &path)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            unmap();
+            return;
+        }
+        fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        mapping = fileMapping == NULL ? NULL : (const char *)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        if (mapping == NULL)
+        {
+            unmap();
+            return;
+        }
+        mappingSize = size.QuadPart;
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+        {
+            return;
+        }
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+        {
+            void *address = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address != MAP_FAILED)
+            {
+                mapping = (const char *)address;
+                mappingSize = status.st_size;
+            }
+        }
+        // the mapping stays valid without the descriptor
+        close(descriptor);
+#endif
+    }
+
+    ~MappedFile()
+    {
+        unmap();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) : mapping(other.mapping), mappingSize(other.mappingSize)
+    {
+#ifdef _WIN32
+        file = other.file;
+        fileMapping = other.fileMapping;
+        other.file = INVALID_HANDLE_VALUE;
+        other.fileMapping = NULL;
+#endif
+        other.mapping = NULL;
+        other.mappingSize = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&other)
+    {
+        if (this != &other)
+        {
+            unmap();
+            mapping = other.mapping;
+            mappingSize = other.mappingSize;
+#ifdef _WIN32
+            file = other.file;
+            fileMapping = other.fileMapping;
+            other.file = INVALID_HANDLE_VALUE;
+            other.fileMapping = NULL;
+#endif
+            other.mapping = NULL;
+            other.mappingSize = 0;
+        }
+        return *this;
+    }
+
+    bool isMapped() const
+    {
+        return mapping != NULL;
+    }
+
+    const char *data() const
+    {
+        return mapping;
+    }
+
+    size_t size() const
+    {
+        return mappingSize;
+    }
+};
+
+enum class PlanetCacheEntryKind : uint32_t
+{
+    // CompactTerrainVertex for each vertex of the chunked planet sphere
+    BakedTerrain = 1,
+    // the elevation faces of a TerrainHeightfield, then its color noise faces
+    Heightfield = 2,
+};
+
+struct PlanetCacheStatistics
+{
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    unsigned int stores = 0;
+    unsigned int evictions = 0;
+};
+
+// An entry of the planet cache as it lies in memory: the payload is read in place.
+struct PlanetCacheEntry
+{
+    MappedFile file;
+    const char *payload;
+    size_t payloadSize;
+};
+
+// Keeps the baked data of planets on disk, one file per planet ID and kind of data. A file
+// is a header followed by the payload in the layout that the GL uploads take, so loading
+// maps the file and hands the payload to the upload without parsing or copying. Files whose
+// version or size do not match are treated as missing. When the files exceed the size cap
+// after a store, the least recently used ones are deleted; using a file touches its
+// modification time. Stores may come from several threads.
+class PlanetCache
+{
+private:
+    static const uint32_t VERSION = 4;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t planetId;
+        uint32_t kind;
+        uint32_t padding;
+        uint64_t payloadSize;
+    };
+    static_assert(sizeof(FileHeader) == 32, "payloads start 16-byte aligned");
+
+    std::string directory;
+    bool isEnabled;
+    uint64_t maxBytes;
+    std::mutex storeMutex;
+    std::atomic<unsigned int> hits = 0;
+    std::atomic<unsigned int> misses = 0;
+    std::atomic<unsigned int> stores = 0;
+    std::atomic<unsigned int> evictions = 0;
+
+    static bool isMagic(const FileHeader &header)
+    {
+        return header.magic[0] == 'P' && header.magic[1] == 'P' && header.magic[2] == 'L' && header.magic[3] == 'N';
+    }
+
+    std::string pathFor(uint64_t planetId, PlanetCacheEntryKind kind) const
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "%016llx-%u.planet", (unsigned long long)planetId, (unsigned int)kind);
+        return directory + "/" + name;
+    }
+
+    // deletes the least recently used files until the rest fits the cap, except the newest
+    void evict()
+    {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+        uint64_t totalBytes = 0;
+        std::error_code error;
+        for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (entry.path().extension() != ".planet")
+            {
+                continue;
+            }
+            totalBytes += entry.file_size(error);
+            files.push_back({entry.last_write_time(error), entry.path()});
+        }
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i + 1 < files.size() && totalBytes > maxBytes; i++)
+        {
+            const uint64_t size = std::filesystem::file_size(files[i].second, error);
+            if (std::filesystem::remove(files[i].second, error))
+            {
+                totalBytes -= size;
+                evictions++;
+            }
+        }
+    }
+
+public:
+    // an empty directory disables the cache
+    PlanetCache(const std::string &directory, uint64_t maxBytes) : directory(directory), isEnabled(!directory.empty()), maxBytes(maxBytes)
+    {
+        std::error_code error;
+        if (isEnabled && !std::filesystem::create_directories(directory, error) && error)
+        {
+            fprintf(stderr, "Failed to create the planet cache %s, baking all planets\n", directory.c_str());
+            isEnabled = false;
+        }
+    }
+
+    PlanetCache(const PlanetCache &) = delete;
+    PlanetCache &operator=(const PlanetCache &) = delete;
+
+    // expectedPayloadSize guards against entries of planets with other dimensions
+    std::optional<PlanetCacheEntry> load(uint64_t planetId, PlanetCacheEntryKind kind, size_t expectedPayloadSize)
+    {
+        if (!isEnabled)
+        {
+            return std::nullopt;
+        }
+        const std::string path = pathFor(planetId, kind);
+        MappedFile file(path);
+        const FileHeader *header = (const FileHeader *)file.data();
+        if (!file.isMapped() || file.size() != sizeof(FileHeader) + expectedPayloadSize || !isMagic(*header) ||
+            header->version != VERSION || header->planetId != planetId || header->kind != (uint32_t)kind ||
+            header->payloadSize != expectedPayloadSize)
+        {
+            misses++;
+            return std::nullopt;
+        }
+
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        hits++;
+        const char *payload = file.data() + sizeof(FileHeader);
+        return PlanetCacheEntry{.file = std::move(file), .payload = payload, .payloadSize = expectedPayloadSize};
+    }
+
+    // the payload is the concatenation of the given parts; through a temporary file, so
+    // that a concurrent load never maps half an entry
+    void store(uint64_t planetId, PlanetCacheEntryKind kind, const std::vector<std::pair<const void *, size_t>> &parts)
+    {
+        if (!isEnabled)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(storeMutex);
+        const std::string path = pathFor(planetId, kind);
+        const std::string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (file == NULL)
+        {
+            return;
+        }
+        FileHeader header{.magic = {'P', 'P', 'L', 'N'}, .version = VERSION, .planetId = planetId, .kind = (uint32_t)kind, .padding = 0, .payloadSize = 0};
+        for (const std::pair<const void *, size_t> &part : parts)
+        {
+            header.payloadSize += part.second;
+        }
+        bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (const std::pair<const void *, size_t> &part : parts)
+        {
+            isWritten = isWritten && fwrite(part.first, 1, part.second, file) == part.second;
+        }
+        isWritten = fclose(file) == 0 && isWritten;
+        std::error_code error;
+        if (!isWritten)
+        {
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+        std::filesystem::rename(temporaryPath, path, error);
+        stores++;
+        evict();
+    }
+
+    PlanetCacheStatistics getStatistics() const
+    {
+        return PlanetCacheStatistics{.hits = hits.load(), .misses = misses.load(), .stores = stores.load(), .evictions = evictions.load()};
+    }
+};
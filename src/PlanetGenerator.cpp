@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CpuRenderer.hpp"
+#include "Icosphere.hpp"
+#include "MeshExport.hpp"
+#include "MeshOptimizer.hpp"
+#include "PlanetCache.hpp"
+#include "TerrainBaker.hpp"
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+
+// Generates planets without a GL context: the terrain displacement of TerrainGenerator.vertex.glsl
+// runs on the CPU through the baker, and every planet is written as a mesh as soon as it is done.
+// Each seed gives the planet that Space generates with that seed from the start planet.
+// Optionally, each planet also gets a thumbnail rendered on the CPU from the viewer's start view.
+
+// of the default quality tier, see QualityGovernor.hpp, which needs GL
+const unsigned int THUMBNAIL_IN_SCATTER_SAMPLES = 8;
+
+struct GeneratorOptions
+{
+    std::vector<uint32_t> seeds;
+    std::string outputDirectory = "planets";
+    MeshExportFormat format = MeshExportFormat::Glb;
+    // the defaults of Planet in ProceduralPlanets.cpp
+    float baseRadius = 100;
+    float maxDepth = 20;
+    float maxHeight = 15;
+    unsigned int sphereSubdivisions = 7;
+    // the width and height of the thumbnails, 0 for none
+    unsigned int thumbnailSize = 0;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+// a comma separated list of seeds and inclusive ranges, such as 1-100,200,300-310
+bool parseSeeds(const char *list, std::vector<uint32_t> &seeds)
+{
+    const char *position = list;
+    while (*position != '\0')
+    {
+        char *end;
+        const unsigned long first = strtoul(position, &end, 10);
+        if (end == position)
+        {
+            return false;
+        }
+        unsigned long last = first;
+        position = end;
+        if (*position == '-')
+        {
+            last = strtoul(++position, &end, 10);
+            if (end == position || last < first)
+            {
+                return false;
+            }
+            position = end;
+        }
+        for (unsigned long seed = first; seed <= last; seed++)
+        {
+            seeds.push_back((uint32_t)seed);
+        }
+        if (*position == ',')
+        {
+            position++;
+        }
+        else if (*position != '\0')
+        {
+            return false;
+        }
+    }
+    return !seeds.empty();
+}
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--seeds LIST] [--output-dir DIR] [--format glb|ply] [--subdivisions N] [--thumbnails N] [--threads N]\n", program);
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    GeneratorOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string argument = argv[i];
+        if (i + 1 >= argc)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (argument == "--seeds" && parseSeeds(value, options.seeds))
+            continue;
+        else if (argument == "--output-dir")
+            options.outputDirectory = value;
+        else if (argument == "--format" && std::string(value) == "glb")
+            options.format = MeshExportFormat::Glb;
+        else if (argument == "--format" && std::string(value) == "ply")
+            options.format = MeshExportFormat::Ply;
+        else if (argument == "--subdivisions")
+            options.sphereSubdivisions = std::clamp(atoi(value), 0, 10);
+        else if (argument == "--thumbnails")
+            options.thumbnailSize = std::clamp(atoi(value), 0, 8192);
+        else if (argument == "--threads")
+            options.threads = std::max(1, atoi(value));
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.seeds.empty())
+    {
+        parseSeeds("1-16", options.seeds);
+    }
+
+    std::error_code error;
+    if (!std::filesystem::create_directories(options.outputDirectory, error) && error)
+    {
+        fprintf(stderr, "Failed to create the output directory %s\n", options.outputDirectory.c_str());
+        return 1;
+    }
+
+    // the calling thread takes planets as well
+    ThreadPool threadPool(options.threads - 1);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // all planets displace the same sphere, ordered once for the vertex cache of the viewers
+    Mesh sphere = generateSphere(options.baseRadius, options.sphereSubdivisions, threadPool);
+    const MeshOptimization optimization = optimizeMesh(sphere);
+    printf("Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+           optimization.before.acmr(), optimization.after.acmr(), optimization.before.atvr(), optimization.after.atvr());
+
+    // the start view of the viewer: the camera, the light and the atmosphere of Scene
+    const float atmosphereRadius = options.baseRadius + 6;
+    const glm::vec3 cameraPosition(0, 0, -250);
+    const CpuRenderView thumbnailView{
+        .viewMatrix = glm::lookAt(cameraPosition, glm::vec3(0), glm::vec3(0, 1, 0)),
+        .projectionMatrix = glm::perspective(45.0f, 1.0f, 0.1f, 10000.0f),
+        .cameraPosition = cameraPosition,
+        .lightDirection = glm::vec3(0, 0, 1),
+        .lightColor = glm::vec3(1),
+        .lightPower = 1,
+    };
+    CpuAtmosphere thumbnailAtmosphere;
+    if (options.thumbnailSize > 0)
+    {
+        thumbnailAtmosphere = cpuAtmosphere(options.baseRadius, atmosphereRadius, threadPool);
+    }
+    std::atomic<uint64_t> thumbnailRays = 0;
+    std::atomic<uint64_t> thumbnailMicroseconds = 0;
+
+    // One planet per task, baked on a single thread: planets are independent, so this scales
+    // with the number of threads without the synchronization of splitting each bake.
+    const float footprint = icosphereVertexSpacing(options.baseRadius, options.sphereSubdivisions);
+    std::atomic<unsigned int> failures = 0;
+    std::atomic<uint64_t> writtenBytes = 0;
+    threadPool.parallelFor(options.seeds.size(), 1, [&](size_t begin, size_t end)
+                           {
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint32_t seed = options.seeds[i];
+            const std::chrono::steady_clock::time_point planetStart = std::chrono::steady_clock::now();
+            const TerrainNoiseParameters parameters{
+                .noiseOffset = planetNoiseOffsetStep(seed),
+                .minElevation = -options.maxDepth,
+                .maxElevation = options.maxHeight,
+            };
+            const std::vector<BakedTerrainVertex> vertices = bakeTerrain(sphere.indexed_vertices, parameters, footprint);
+            const double bakeMilliseconds = millisecondsSince(planetStart);
+
+            char name[64];
+            snprintf(name, sizeof(name), "planet-%u.%s", seed, meshExportExtension(options.format));
+            const std::string path = options.outputDirectory + "/" + name;
+            if (!writeMesh(options.format, path, vertices, sphere.indices))
+            {
+                fprintf(stderr, "Failed to write %s\n", path.c_str());
+                failures++;
+                continue;
+            }
+            std::error_code sizeError;
+            writtenBytes += std::filesystem::file_size(path, sizeError);
+            printf("%s: baked in %.1f ms, written in %.1f ms\n", path.c_str(), bakeMilliseconds, millisecondsSince(planetStart) - bakeMilliseconds);
+
+            if (options.thumbnailSize == 0)
+            {
+                continue;
+            }
+            CpuImage thumbnail{.width = options.thumbnailSize, .height = options.thumbnailSize, .pixels = {}};
+            // the tiles of one thumbnail go to the threads that are out of planets
+            const CpuRenderStatistics statistics = renderPlanetOnCpu(CpuRenderPlanet{
+                                                                         .vertices = &vertices,
+                                                                         .indices = &sphere.indices,
+                                                                         .atmosphere = &thumbnailAtmosphere,
+                                                                         .modelMatrix = glm::mat4(1),
+                                                                         .noiseOffset = parameters.noiseOffset,
+                                                                         .maxPositiveHeight = options.maxHeight,
+                                                                         .inScatterSamples = THUMBNAIL_IN_SCATTER_SAMPLES,
+                                                                     },
+                                                                     thumbnailView, thumbnail, threadPool);
+            snprintf(name, sizeof(name), "planet-%u.ppm", seed);
+            const std::string thumbnailPath = options.outputDirectory + "/" + name;
+            if (!writeImagePpm(thumbnailPath, thumbnail))
+            {
+                fprintf(stderr, "Failed to write %s\n", thumbnailPath.c_str());
+                failures++;
+                continue;
+            }
+            thumbnailRays += statistics.rays;
+            thumbnailMicroseconds += (uint64_t)(statistics.milliseconds() * 1000);
+            printf("%s: rendered in %.1f ms (transform %.1f, binning %.1f, tiles %.1f), %zu binned triangles, %.2f Mrays/s\n",
+                   thumbnailPath.c_str(), statistics.milliseconds(), statistics.transformMilliseconds, statistics.binningMilliseconds,
+                   statistics.tilesMilliseconds, statistics.binnedTriangles, statistics.raysPerSecond() / 1e6);
+        } });
+
+    const double seconds = millisecondsSince(start) / 1000;
+    const unsigned int planets = options.seeds.size() - failures;
+    printf("Generated %u planets of %zu vertices in %.2f s on %u threads: %.2f planets/s, %.1f MB written\n",
+           planets, sphere.indexed_vertices.size(), seconds, options.threads, planets / seconds, writtenBytes / 1e6);
+    if (thumbnailRays > 0)
+    {
+        printf("Rendered thumbnails of %u × %u pixels: %.2f Mrays/s while rendering\n",
+               options.thumbnailSize, options.thumbnailSize, thumbnailRays / std::max(1e-9, thumbnailMicroseconds / 1e6) / 1e6);
+    }
+    return failures == 0 ? 0 : 1;
+}
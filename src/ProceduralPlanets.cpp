@@ -4,6 +4,10 @@
 #include <string>
 #include <time.h>
 #include <random>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 #include <GL/glew.h>
 #include <glfw3.h>
@@ -11,11 +15,42 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/easing.hpp>
 
+#include "AsyncRegenerator.hpp"
+#include "AtmosphereTables.hpp"
+#include "Benchmark.hpp"
+#include "ClusterCulling.hpp"
+#include "CompactVertex.hpp"
+#include "FrameCapture.hpp"
 #include "GlResources.hpp"
+#include "Icosphere.hpp"
+#include "InputScript.hpp"
+#include "PlanetCache.hpp"
+#include "Profiler.hpp"
+#include "ProgramCache.hpp"
+#include "QuadtreeTerrain.hpp"
+#include "QualityGovernor.hpp"
+#include "SceneUniforms.hpp"
+#include "StarSystem.hpp"
+#include "TerrainBaker.hpp"
+#include "TerrainHeightfield.hpp"
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+#include "TripleBuffer.hpp"
+
+#ifdef PROCEDURAL_PLANETS_HEADLESS
+#include "EglContext.hpp"
+#endif
 
 const glm::vec3 UP(0, 1, 0);
 const glm::mat4 IDENTITY(1.0f);
 
+struct TerrainPatchUniformLocations
+{
+    GLint origin;
+    GLint axisU;
+    GLint axisV;
+};
+
 struct Planet
 {
     float baseRadius = 100;
@@ -23,13 +58,69 @@ struct Planet
     float maxHeight = 15;
     float rotateSpeed = 0.03f;
     unsigned int sphereSubdivisions = 7;
+    // the seed that the step to the current noise offset was drawn with
+    uint32_t seed = 0;
     glm::vec3 noiseOffset = glm::vec3(0, 0, 0);
     int textureIndex = 0;
     float angle = 0;
+    bool isTerrainBaked = true;
+    bool isTerrainChunked = true;
+    // the terrain shaders sample the baked heightfield instead of evaluating the noise
+    bool isHeightfieldSampled = true;
+    unsigned int heightfieldResolution = 512;
 
     unsigned int meshIndex;
     unsigned int shaderIndex;
+    unsigned int bakedMeshIndex;
+    unsigned int backBakedMeshIndex;
+    unsigned int bakedShaderIndex;
+    unsigned int chunkedShaderIndex;
+    TerrainPatchUniformLocations patchUniformLocations;
+    unsigned int uniformsIndex;
+    glm::vec3 bakedNoiseOffset;
+    glm::vec3 requestedNoiseOffset;
+    TerrainNoiseParameters bakedHeightfieldParameters;
+    TerrainNoiseParameters requestedHeightfieldParameters;
     glm::mat4 modelMatrix;
+
+    // the baked terrain vertices store their radius between these, see CompactTerrainVertex
+    float minRadius() const
+    {
+        return baseRadius - maxDepth;
+    }
+
+    float maxRadius() const
+    {
+        return baseRadius + maxHeight;
+    }
+
+    // the footprint of the sphere's vertices, see terrainOctaves()
+    float vertexSpacing() const
+    {
+        return icosphereVertexSpacing(baseRadius, sphereSubdivisions);
+    }
+
+    TerrainNoiseParameters terrainNoiseParameters() const
+    {
+        return TerrainNoiseParameters{
+            .noiseOffset = noiseOffset,
+            .minElevation = -maxDepth,
+            .maxElevation = maxHeight,
+        };
+    }
+
+    PlanetDescription description() const
+    {
+        return PlanetDescription{
+            .seed = seed,
+            .noiseOffset = noiseOffset,
+            .baseRadius = baseRadius,
+            .maxDepth = maxDepth,
+            .maxHeight = maxHeight,
+            .sphereSubdivisions = sphereSubdivisions,
+            .heightfieldResolution = heightfieldResolution,
+        };
+    }
 };
 
 struct Atmosphere
@@ -38,15 +129,28 @@ struct Atmosphere
     float innerRadius;
     float outerRadius;
 
+    // reads the optical depths from AtmosphereTables instead of marching them
+    bool isScatteringTabulated = true;
+    // 1 shades every pixel, 2 or 4 shade an offscreen target at that fraction of the
+    // resolution, which is then upsampled
+    unsigned int resolutionDivisor = 1;
+
     unsigned int meshIndex;
     unsigned int shaderIndex;
+    unsigned int tablesShaderIndex;
+    unsigned int upsampleShaderIndex;
+    unsigned int uniformsIndex;
     glm::mat4 modelMatrix;
 };
 
 struct State
 {
     bool isPlanetGenerationBlocked = true;
-    float lastTime = 0;
+    bool isTerrainModeToggleBlocked = true;
+    bool isTerrainLodToggleBlocked = true;
+    bool isAtmosphereModeToggleBlocked = true;
+    bool isAtmosphereResolutionCycleBlocked = true;
+    bool isHeightfieldToggleBlocked = true;
 };
 
 struct Camera
@@ -55,9 +159,14 @@ struct Camera
     glm::vec3 up;
 
     float rotateSpeed = 1.5f;
+    float zoomSpeed = 1.f;
+    float minDistance = 0.f;
+    float maxDistance = 1000.f;
 
     float fieldOfView = 45.0;
     float aspectRatio = 1.f;
+    float viewportWidth = 1024.f;
+    float viewportHeight = 1024.f;
 
     glm::mat4 viewMatrix() const
     {
@@ -68,6 +177,12 @@ struct Camera
     {
         return glm::perspective(fieldOfView, aspectRatio, 0.1f, 10000.0f);
     }
+
+    // pixels covered by one unit at unit distance from the camera
+    float projectionScale() const
+    {
+        return viewportHeight / (2 * glm::tan(fieldOfView / 2));
+    }
 };
 
 struct DirectionalLight
@@ -77,182 +192,236 @@ struct DirectionalLight
     float power;
 };
 
-struct Mesh
+struct AnimationParameters
 {
-    std::vector<unsigned int> indices;
-    std::vector<glm::vec3> indexed_vertices;
+    glm::vec3 noiseOffset;
 };
 
-static const GLdouble theta = 0.5 * (1.0 + sqrt(5.0));
-static const glm::vec3 ICOSAHEDRON_VERTICES[12] = {
-    glm::vec3(-1, theta, 0),
-    glm::vec3(1, theta, 0),
-    glm::vec3(-1, -theta, 0),
-    glm::vec3(1, -theta, 0),
-
-    glm::vec3(0, -1, theta),
-    glm::vec3(0, 1, theta),
-    glm::vec3(0, -1, -theta),
-    glm::vec3(0, 1, -theta),
-
-    glm::vec3(theta, 0, -1),
-    glm::vec3(theta, 0, 1),
-    glm::vec3(-theta, 0, -1),
-    glm::vec3(-theta, 0, 1)};
-
-static const unsigned int ICOSAHEDRON_INDICES[60] = {
-    0, 11, 5,
-    0, 5, 1,
-    0, 1, 7,
-    0, 7, 10,
-    0, 10, 11,
-
-    1, 5, 9,
-    5, 11, 4,
-    11, 10, 2,
-    10, 7, 6,
-    7, 1, 8,
+struct Animation
+{
+    bool active = false;
+    AnimationParameters source;
+    AnimationParameters target;
+    float progress;
+    float duration;
 
-    3, 9, 4,
-    3, 4, 2,
-    3, 2, 6,
-    3, 6, 8,
-    3, 8, 9,
+    AnimationParameters current() const
+    {
+        const float parameter = glm::sineEaseInOut(glm::clamp(progress, 0.0f, 1.0f));
+        return AnimationParameters{
+            .noiseOffset = parameter * target.noiseOffset + (1 - parameter) * source.noiseOffset,
+        };
+    }
+};
 
-    4, 9, 5,
-    2, 4, 11,
-    6, 2, 10,
-    8, 6, 7,
-    9, 8, 1};
+struct BakedTerrain
+{
+    glm::vec3 noiseOffset;
+    std::vector<CompactTerrainVertex> vertices;
+};
 
-int addSphereVertex(Mesh &mesh, glm::vec3 vertex, GLfloat radius)
+// the payload of a PlanetCacheEntryKind::Heightfield entry
+size_t heightfieldPayloadSize(unsigned int resolution)
 {
-    glm::vec3 normalizedVertex = glm::normalize(vertex);
-    mesh.indexed_vertices.push_back(normalizedVertex * radius);
-    return mesh.indexed_vertices.size() - 1;
+    return 6 * size_t(resolution) * resolution * (sizeof(glm::vec4) + sizeof(float));
 }
 
-Mesh generateSphere(GLfloat radius, int subdivisions)
+void storeTerrainHeightfield(PlanetCache &planetCache, uint64_t planetId, const TerrainHeightfield &heightfield)
 {
-    Mesh sphere;
-
-    for (int i = 0; i < 12; i++)
+    std::vector<std::pair<const void *, size_t>> parts;
+    for (unsigned int face = 0; face < 6; face++)
     {
-        addSphereVertex(sphere, ICOSAHEDRON_VERTICES[i], radius);
+        parts.push_back({heightfield.elevation[face].data(), heightfield.elevation[face].size() * sizeof(glm::vec4)});
     }
-
-    for (int i = 0; i < 60; i++)
+    for (unsigned int face = 0; face < 6; face++)
     {
-        sphere.indices.push_back(ICOSAHEDRON_INDICES[i]);
+        parts.push_back({heightfield.colorNoise[face].data(), heightfield.colorNoise[face].size() * sizeof(float)});
     }
-
-    for (int s = 0; s < subdivisions; s++)
-    {
-        std::vector<unsigned int> subdividedSphereIndices;
-
-        for (unsigned int i = 0; (i + 2) < sphere.indices.size(); i += 3)
-        {
-            int aIndex = sphere.indices[i];
-            int bIndex = sphere.indices[i + 1];
-            int cIndex = sphere.indices[i + 2];
-
-            glm::vec3 a = sphere.indexed_vertices[aIndex];
-            glm::vec3 b = sphere.indexed_vertices[bIndex];
-            glm::vec3 c = sphere.indexed_vertices[cIndex];
-
-            glm::vec3 ab = a + b;
-            glm::vec3 bc = b + c;
-            glm::vec3 ca = c + a;
-
-            int abIndex = addSphereVertex(sphere, ab, radius);
-            int bcIndex = addSphereVertex(sphere, bc, radius);
-            int caIndex = addSphereVertex(sphere, ca, radius);
-
-            subdividedSphereIndices.push_back(aIndex);
-            subdividedSphereIndices.push_back(abIndex);
-            subdividedSphereIndices.push_back(caIndex);
-
-            subdividedSphereIndices.push_back(bIndex);
-            subdividedSphereIndices.push_back(bcIndex);
-            subdividedSphereIndices.push_back(abIndex);
-
-            subdividedSphereIndices.push_back(cIndex);
-            subdividedSphereIndices.push_back(caIndex);
-            subdividedSphereIndices.push_back(bcIndex);
-
-            subdividedSphereIndices.push_back(abIndex);
-            subdividedSphereIndices.push_back(bcIndex);
-            subdividedSphereIndices.push_back(caIndex);
-        }
-
-        sphere.indices = subdividedSphereIndices;
-    }
-
-    return sphere;
+    planetCache.store(planetId, PlanetCacheEntryKind::Heightfield, parts);
 }
 
-struct AnimationParameters
+// the texture unit that AtmosphereUpsample.fragment.glsl reads the atmosphere from
+const GLuint ATMOSPHERE_TARGET_TEXTURE_UNIT = 1;
+// the texture units that the terrain shaders read the baked heightfield from
+const GLuint TERRAIN_HEIGHTFIELD_TEXTURE_UNIT = 2;
+const GLuint TERRAIN_COLOR_NOISE_TEXTURE_UNIT = 3;
+
+// Whether the shaders are compiled with the settings they loop and branch on as constants,
+// which lets the compiler unroll the loops and drop the branches that cannot be taken, or
+// read them from uniforms as a single generic program does.
+enum class ShaderVariants
 {
-    glm::vec3 noiseOffset;
+    Generic,
+    Specialized,
 };
 
-struct Animation
+const char *shaderVariantsName(ShaderVariants variants)
 {
-    bool active = false;
-    AnimationParameters source;
-    AnimationParameters target;
-    float progress;
-    float duration;
+    return variants == ShaderVariants::Generic ? "generic" : "specialized";
+}
 
-    AnimationParameters current() const
+// the terrain noise with the octaves of TerrainNoise.hpp and the period and rotation of each shader
+ShaderDefines terrainShaderDefines(ShaderVariants variants)
+{
+    if (variants == ShaderVariants::Generic)
     {
-        const float parameter = glm::sineEaseInOut(glm::clamp(progress, 0.0f, 1.0f));
-        return AnimationParameters{
-            .noiseOffset = parameter * target.noiseOffset + (1 - parameter) * source.noiseOffset,
-        };
+        return {};
     }
+    return {
+        ShaderDefine{.name = "TERRAIN_OCTAVES", .value = std::to_string(TERRAIN_OCTAVE_COUNT)},
+        ShaderDefine{.name = "SPECIALIZE_NOISE", .value = ""},
+    };
+}
+
+// the atmosphere programs of one quality tier, or of all of them for generic shaders
+struct AtmospherePrograms
+{
+    unsigned int shaderIndex;
+    unsigned int tablesShaderIndex;
+    unsigned int bodyAtmosphereShaderIndex;
 };
 
 struct Scene
 {
+    ThreadPool *threadPool;
+    ProgramCache *programCache;
+    PlanetCache *planetCache;
+    ShaderVariants shaderVariants;
+    // declared before the stream buffers, which give their storage back to it
+    GlBufferPool bufferPool;
     std::vector<GlMesh> meshes;
+    MeshMemory meshMemory;
     std::vector<GlShaderProgram> shaderPrograms;
+    Mesh planetSphere;
+    // the baked terrain meshes copy the vertices of the planet sphere in this order
+    ChunkedIndices planetChunks;
+    MeshOptimization planetSphereOptimization;
+    // the clusters of the planet meshes that are drawn this frame, unless the terrain is chunked
+    std::vector<ClusterBounds> planetClusterBounds;
+    GlMultiDraw planetClusterDraw;
+    std::vector<unsigned int> planetDrawnClusters;
+    ClusterCullingStatistics planetClusterStatistics;
+    // of the terrain shaders that evaluate the noise, see updatePlanetTerrainOctaves()
+    TerrainOctaveHistogram planetTerrainOctaves;
+    QuadtreeTerrain planetTerrain;
+    SceneUniformBuffers uniformBuffers;
+    AtmosphereTables atmosphereTables;
+    std::optional<GlTextureFramebuffer> atmosphereTarget;
+    GlVertexArrayObject fullScreenVertexArray;
+    StarSystem starSystem;
+    unsigned int bodyShaderIndex;
+    unsigned int bodyAtmosphereShaderIndex;
+    // loaded when a tier is first used, indexed by tier for specialized shaders and at 0 otherwise
+    std::optional<AtmospherePrograms> atmospherePrograms[NUMBER_OF_QUALITY_TIERS];
 
     Camera camera;
     DirectionalLight light;
     float lightRotationSpeed = 0.2f;
 
-    State state;
     Planet planet;
     Atmosphere atmosphere;
     Animation animation;
-
-    Scene()
+    // the new planet requests of the simulation that the terrain was updated for
+    unsigned int handledPlanetRequests = 0;
+    unsigned int qualityTier = DEFAULT_QUALITY_TIER;
+    // the quality governor rather than the simulation sets the atmosphere resolution
+    bool isQualityGoverned = false;
+
+    AsyncRegenerator<BakedTerrain> terrainRegenerator;
+    // declared after the planet, whose resolution they are created with
+    GlCubeMapTexture terrainHeightfield;
+    GlCubeMapTexture terrainColorNoise;
+    AsyncRegenerator<TerrainHeightfield> heightfieldRegenerator;
+
+    Scene(ThreadPool &threadPool, ProgramCache &programCache, PlanetCache &planetCache, ShaderVariants shaderVariants = ShaderVariants::Specialized)
+        : threadPool(&threadPool), programCache(&programCache), planetCache(&planetCache), shaderVariants(shaderVariants),
+          uniformBuffers(bufferPool, 2), starSystem(threadPool, bufferPool),
+          terrainHeightfield(planet.heightfieldResolution, GL_RGBA16F, GL_RGBA),
+          terrainColorNoise(planet.heightfieldResolution, GL_R16F, GL_RED)
     {
         atmosphere.innerRadius = planet.baseRadius;
         atmosphere.outerRadius = planet.baseRadius + 6;
         atmosphere.modelMatrix = IDENTITY;
         planet.modelMatrix = IDENTITY;
+        planet.uniformsIndex = 0;
+        atmosphere.uniformsIndex = 1;
 
-        Mesh atmosphereMesh = generateSphere(atmosphere.outerRadius, atmosphere.sphereSubdivisions);
-        meshes.push_back(GlMesh(atmosphereMesh.indexed_vertices, atmosphereMesh.indices));
+        Mesh atmosphereMesh = generateSphere(atmosphere.outerRadius, atmosphere.sphereSubdivisions, threadPool);
+        meshes.push_back(compactSphereMesh(atmosphereMesh, threadPool));
+        meshMemory.add(meshes.back(), uncompressedMeshBytes<glm::vec3>(atmosphereMesh));
         atmosphere.meshIndex = 0;
 
-        Mesh sphereMesh = generateSphere(planet.baseRadius, planet.sphereSubdivisions);
-        meshes.push_back(GlMesh(sphereMesh.indexed_vertices, sphereMesh.indices));
+        planetSphere = generateSphere(planet.baseRadius, planet.sphereSubdivisions, threadPool);
+        planetChunks = splitIntoChunks(planetSphere.indices, planetSphere.indexed_vertices.size());
+        planetSphereOptimization = optimizeChunks(planetChunks, threadPool);
+        planetClusterBounds = sphereClusterBounds(planetChunks, planetSphere.indexed_vertices);
+        meshes.push_back(compactSphereMesh(planetSphere, planetChunks));
+        meshMemory.add(meshes.back(), uncompressedMeshBytes<glm::vec3>(planetSphere));
         planet.meshIndex = 1;
 
-        GlShaderProgram atmosphericScattering = createVertexFragmentShaderProgram(
-            loadShader(GL_VERTEX_SHADER, "assets/shaders/AtmosphericScattering.vertex.glsl"),
-            loadShader(GL_FRAGMENT_SHADER, "assets/shaders/AtmosphericScattering.fragment.glsl"));
-        shaderPrograms.push_back(std::move(atmosphericScattering));
-        atmosphere.shaderIndex = 0;
+        std::vector<CompactTerrainVertex> bakedTerrain = compactTerrainVertices(bakeTerrain(planetSphere.indexed_vertices, planet.terrainNoiseParameters(), planet.vertexSpacing(), threadPool),
+                                                                                planetChunks, planet.minRadius(), planet.maxRadius());
+        for (unsigned int *index : {&planet.bakedMeshIndex, &planet.backBakedMeshIndex})
+        {
+            meshes.push_back(GlMesh(bakedTerrain, compactTerrainVertexAttributes(), planetChunks.indices, planetChunks.chunks));
+            meshMemory.add(meshes.back(), uncompressedMeshBytes<BakedTerrainVertex>(planetSphere));
+            *index = meshes.size() - 1;
+        }
+        meshMemory.add(starSystem.getMeshMemory());
+        planet.bakedNoiseOffset = planet.noiseOffset;
+        planet.requestedNoiseOffset = planet.noiseOffset;
+
+        if (!loadCachedTerrainHeightfield())
+        {
+            TerrainHeightfield heightfield = bakeTerrainHeightfield(planet.heightfieldResolution, planet.baseRadius, planet.terrainNoiseParameters(), threadPool);
+            uploadTerrainHeightfield(heightfield);
+            storeTerrainHeightfield(planetCache, planetId(planet.description()), heightfield);
+        }
+        planet.requestedHeightfieldParameters = planet.bakedHeightfieldParameters;
+
+        const ShaderDefines terrainDefines = terrainShaderDefines(shaderVariants);
+        planet.shaderIndex = addShaderProgram(programCache.load(
+            "assets/shaders/TerrainGenerator.vertex.glsl",
+            "assets/shaders/TerrainGenerator.fragment.glsl", terrainDefines, sceneUniformsPrelude()));
+
+        planet.bakedShaderIndex = addShaderProgram(programCache.load(
+            "assets/shaders/BakedTerrain.vertex.glsl",
+            "assets/shaders/TerrainGenerator.fragment.glsl", terrainDefines, sceneUniformsPrelude()));
+
+        planet.chunkedShaderIndex = addShaderProgram(programCache.load(
+            "assets/shaders/TerrainPatch.vertex.glsl",
+            "assets/shaders/TerrainGenerator.fragment.glsl", terrainDefines, sceneUniformsPrelude()));
+
+        GlShaderProgram atmosphereUpsample = programCache.load(
+            "assets/shaders/AtmosphereUpsample.vertex.glsl",
+            "assets/shaders/AtmosphereUpsample.fragment.glsl", {}, sceneUniformsPrelude());
+        glUseProgram(atmosphereUpsample.id());
+        glUniform1i(atmosphereUpsample.uniformLocation("atmosphereTexture"), ATMOSPHERE_TARGET_TEXTURE_UNIT);
+        atmosphere.upsampleShaderIndex = addShaderProgram(std::move(atmosphereUpsample));
+
+        bodyShaderIndex = addShaderProgram(programCache.load(
+            "assets/shaders/BodyTerrain.vertex.glsl",
+            "assets/shaders/BodyTerrain.fragment.glsl", terrainDefines, frameUniformsPrelude()));
+
+        atmosphereTables.update(atmosphere.innerRadius, atmosphere.outerRadius, threadPool);
+        const GlShaderProgram &terrainPatch = shaderPrograms[planet.chunkedShaderIndex];
+        planet.patchUniformLocations = TerrainPatchUniformLocations{
+            .origin = terrainPatch.uniformLocation("patchOrigin"),
+            .axisU = terrainPatch.uniformLocation("patchAxisU"),
+            .axisV = terrainPatch.uniformLocation("patchAxisV"),
+        };
 
-        GlShaderProgram terrainGenerator = createVertexFragmentShaderProgram(
-            loadShader(GL_VERTEX_SHADER, "assets/shaders/TerrainGenerator.vertex.glsl"),
-            loadShader(GL_FRAGMENT_SHADER, "assets/shaders/TerrainGenerator.fragment.glsl"));
-        shaderPrograms.push_back(std::move(terrainGenerator));
-        planet.shaderIndex = 1;
+        for (unsigned int index : {planet.shaderIndex, planet.bakedShaderIndex, planet.chunkedShaderIndex})
+        {
+            glUseProgram(shaderPrograms[index].id());
+            glUniform1i(shaderPrograms[index].uniformLocation("terrainHeightfield"), TERRAIN_HEIGHTFIELD_TEXTURE_UNIT);
+            glUniform1i(shaderPrograms[index].uniformLocation("terrainColorNoise"), TERRAIN_COLOR_NOISE_TEXTURE_UNIT);
+        }
+        glUseProgram(shaderPrograms[planet.shaderIndex].id());
+        glUniform1f(shaderPrograms[planet.shaderIndex].uniformLocation("vertexSpacing"), planet.vertexSpacing());
+        glUseProgram(shaderPrograms[planet.chunkedShaderIndex].id());
+        glUniform1f(shaderPrograms[planet.chunkedShaderIndex].uniformLocation("vertexSpacing"), planetTerrain.finestVertexSpacing(planet.baseRadius));
+        setQualityTier(DEFAULT_QUALITY_TIER);
 
         light = DirectionalLight{
             .direction = glm::vec3(0, 0, 1),
@@ -273,6 +442,7 @@ struct Scene
         camera = Camera{
             .position = glm::vec3(0, 0, -250.0),
             .up = glm::vec3(0, 1, 0),
+            .minDistance = planet.baseRadius + planet.maxHeight + 3,
         };
     }
 
@@ -281,51 +451,303 @@ struct Scene
 
     Scene(Scene &&) = default;
     Scene &operator=(Scene &&other) = default;
+
+    // returns its index in shaderPrograms
+    unsigned int addShaderProgram(GlShaderProgram shaderProgram)
+    {
+        bindSceneUniformBlocks(shaderProgram);
+        shaderPrograms.push_back(std::move(shaderProgram));
+        return shaderPrograms.size() - 1;
+    }
+
+    // with the sample counts of the quality tier as constants, or as uniforms for generic shaders
+    AtmospherePrograms loadAtmospherePrograms(const QualityTier &quality)
+    {
+        auto samplesDefines = [&](unsigned int inScatterSamples, unsigned int outScatterSamples)
+        {
+            return shaderVariants == ShaderVariants::Generic ? ShaderDefines{}
+                                                             : ShaderDefines{
+                                                                   ShaderDefine{.name = "IN_SCATTER_SAMPLES", .value = std::to_string(inScatterSamples)},
+                                                                   ShaderDefine{.name = "OUT_SCATTER_SAMPLES", .value = std::to_string(outScatterSamples)},
+                                                               };
+        };
+        AtmospherePrograms programs;
+        programs.shaderIndex = addShaderProgram(programCache->load(
+            "assets/shaders/AtmosphericScattering.vertex.glsl",
+            "assets/shaders/AtmosphericScattering.fragment.glsl",
+            samplesDefines(quality.marchedScatterSamples, quality.marchedScatterSamples), sceneUniformsPrelude()));
+
+        programs.tablesShaderIndex = addShaderProgram(programCache->load(
+            "assets/shaders/AtmosphericScattering.vertex.glsl",
+            "assets/shaders/AtmosphericScatteringTables.fragment.glsl",
+            samplesDefines(quality.inScatterSamples, quality.inScatterSamples), sceneUniformsPrelude()));
+
+        programs.bodyAtmosphereShaderIndex = addShaderProgram(programCache->load(
+            "assets/shaders/BodyAtmosphere.vertex.glsl",
+            "assets/shaders/BodyAtmosphere.fragment.glsl",
+            samplesDefines(quality.inScatterSamples, quality.inScatterSamples), frameUniformsPrelude()));
+
+        for (unsigned int index : {programs.tablesShaderIndex, programs.bodyAtmosphereShaderIndex})
+        {
+            glUseProgram(shaderPrograms[index].id());
+            glUniform1i(shaderPrograms[index].uniformLocation("opticalDepthTable"), ATMOSPHERE_TABLES_TEXTURE_UNIT);
+        }
+        return programs;
+    }
+
+    void setQualityTier(unsigned int tier)
+    {
+        const QualityTier &quality = QUALITY_TIERS[tier];
+        qualityTier = tier;
+        planetTerrain.setRefinementLimits(quality.maxScreenSpaceError, quality.maxPatches);
+        starSystem.setMaxEdgePixels(quality.maxBodyEdgePixels);
+        atmosphere.resolutionDivisor = quality.atmosphereResolutionDivisor;
+
+        std::optional<AtmospherePrograms> &programs = atmospherePrograms[shaderVariants == ShaderVariants::Generic ? 0 : tier];
+        if (!programs)
+        {
+            programs = loadAtmospherePrograms(quality);
+        }
+        atmosphere.shaderIndex = programs->shaderIndex;
+        atmosphere.tablesShaderIndex = programs->tablesShaderIndex;
+        bodyAtmosphereShaderIndex = programs->bodyAtmosphereShaderIndex;
+        if (shaderVariants == ShaderVariants::Specialized)
+        {
+            return;
+        }
+        for (unsigned int index : {atmosphere.tablesShaderIndex, bodyAtmosphereShaderIndex})
+        {
+            glUseProgram(shaderPrograms[index].id());
+            glUniform1i(shaderPrograms[index].uniformLocation("inScatterSamples"), quality.inScatterSamples);
+        }
+        const GlShaderProgram &marched = shaderPrograms[atmosphere.shaderIndex];
+        glUseProgram(marched.id());
+        glUniform1i(marched.uniformLocation("inScatterSamples"), quality.marchedScatterSamples);
+        glUniform1i(marched.uniformLocation("outScatterSamples"), quality.marchedScatterSamples);
+    }
+
+    void uploadTerrainHeightfield(const TerrainHeightfield &heightfield)
+    {
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            terrainHeightfield.update(face, &heightfield.elevation[face][0].x);
+            terrainColorNoise.update(face, heightfield.colorNoise[face].data());
+        }
+        planet.bakedHeightfieldParameters = heightfield.parameters;
+        fprintf(stderr, "Baked the terrain heightfield (%u x %u x 6 texels) in %.1f ms\n",
+                heightfield.resolution, heightfield.resolution, heightfield.bakeMilliseconds);
+    }
+
+    // the following upload straight from the mapped planet cache entry of the current
+    // planet, and return whether there was one
+
+    bool loadCachedTerrainHeightfield()
+    {
+        const unsigned int resolution = planet.heightfieldResolution;
+        const uint64_t id = planetId(planet.description());
+        std::optional<PlanetCacheEntry> entry = planetCache->load(id, PlanetCacheEntryKind::Heightfield, heightfieldPayloadSize(resolution));
+        if (!entry.has_value())
+        {
+            return false;
+        }
+        const size_t texelsPerFace = size_t(resolution) * resolution;
+        const float *elevation = (const float *)entry->payload;
+        const float *colorNoise = elevation + 6 * 4 * texelsPerFace;
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            terrainHeightfield.update(face, elevation + face * 4 * texelsPerFace);
+            terrainColorNoise.update(face, colorNoise + face * texelsPerFace);
+        }
+        planet.bakedHeightfieldParameters = planet.terrainNoiseParameters();
+        fprintf(stderr, "Loaded the terrain heightfield of planet %016llx from the planet cache\n", (unsigned long long)id);
+        return true;
+    }
+
+    bool loadCachedBakedTerrain()
+    {
+        const uint64_t id = planetId(planet.description());
+        std::optional<PlanetCacheEntry> entry = planetCache->load(id, PlanetCacheEntryKind::BakedTerrain, planetChunks.sourceVertices.size() * sizeof(CompactTerrainVertex));
+        if (!entry.has_value())
+        {
+            return false;
+        }
+        meshes[planet.backBakedMeshIndex].getVertexBuffer().update(entry->payload, entry->payloadSize);
+        std::swap(planet.bakedMeshIndex, planet.backBakedMeshIndex);
+        planet.bakedNoiseOffset = planet.noiseOffset;
+        fprintf(stderr, "Loaded the baked terrain of planet %016llx from the planet cache\n", (unsigned long long)id);
+        return true;
+    }
 };
 
-void updateCamera(Camera &camera, GLFWwindow *window, float deltaTime)
+void updateCamera(Camera &camera, const InputState &input, float deltaTime)
 {
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+    if (input.rotateUp)
     {
         glm::mat4 rotationMatrix = glm::rotate(IDENTITY, deltaTime * camera.rotateSpeed, glm::cross(camera.position, camera.up));
         camera.position = rotationMatrix * glm::vec4(camera.position, 0);
         camera.up = rotationMatrix * glm::vec4(camera.up, 0);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+    if (input.rotateDown)
     {
         glm::mat4 rotationMatrix = glm::rotate(IDENTITY, -deltaTime * camera.rotateSpeed, glm::cross(camera.position, camera.up));
         camera.position = rotationMatrix * glm::vec4(camera.position, 0);
         camera.up = rotationMatrix * glm::vec4(camera.up, 0);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+    if (input.rotateRight)
     {
         glm::mat4 rotationMatrix = glm::rotate(IDENTITY, deltaTime * camera.rotateSpeed, camera.up);
         camera.position = rotationMatrix * glm::vec4(camera.position, 0);
         camera.up = rotationMatrix * glm::vec4(camera.up, 0);
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+    if (input.rotateLeft)
     {
         glm::mat4 rotationMatrix = glm::rotate(IDENTITY, -deltaTime * camera.rotateSpeed, camera.up);
         camera.position = rotationMatrix * glm::vec4(camera.position, 0);
         camera.up = rotationMatrix * glm::vec4(camera.up, 0);
     }
 
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
+    if (input.zoomIn)
+    {
+        float distance = glm::length(camera.position);
+        camera.position *= glm::max(camera.minDistance, distance * glm::exp(-deltaTime * camera.zoomSpeed)) / distance;
+    }
+    if (input.zoomOut)
+    {
+        float distance = glm::length(camera.position);
+        camera.position *= glm::min(camera.maxDistance, distance * glm::exp(deltaTime * camera.zoomSpeed)) / distance;
+    }
+}
+
+void resizeCamera(Camera &camera, int width, int height)
+{
     camera.aspectRatio = (float)width / height;
+    camera.viewportWidth = width;
+    camera.viewportHeight = height;
 }
 
-void updatePlanetMovement(Scene &scene, float deltaTime)
+InputState readInput(GLFWwindow *window)
 {
-    scene.planet.angle += scene.planet.rotateSpeed * deltaTime;
-    scene.planet.modelMatrix = glm::rotate(IDENTITY, scene.planet.angle, UP);
+    InputState input;
+    input.rotateUp = glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS;
+    input.rotateDown = glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS;
+    input.rotateRight = glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS;
+    input.rotateLeft = glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS;
+    input.zoomIn = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    input.zoomOut = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    input.newPlanet = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    input.toggleBakedTerrain = glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS;
+    input.toggleTerrainLod = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    input.toggleAtmosphereTables = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    input.cycleAtmosphereResolution = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    input.toggleHeightfield = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    return input;
 }
 
-void updateLight(Scene &scene, float deltaTime)
+// What input and time advance, without anything GL: the camera, the light, the rotation
+// and terrain animation of the planet and the render toggles. It is simulated in steps of
+// its own, and the scene takes it over before each frame, see applySimulation().
+struct SimulationState
 {
-    scene.light.direction = glm::rotate(IDENTITY, scene.lightRotationSpeed * deltaTime, glm::vec3(1, 1, 0)) * glm::vec4(scene.light.direction, 0);
+    // seconds of simulated time
+    double time = 0;
+    Camera camera;
+    glm::vec3 lightDirection;
+    float lightRotationSpeed;
+    float planetAngle;
+    float planetRotateSpeed;
+    uint32_t planetSeed;
+    glm::vec3 noiseOffset;
+    Animation animation;
+    // counts the new planet requests, so that the scene notices each one
+    unsigned int planetRequests;
+    bool isTerrainBaked;
+    bool isTerrainChunked;
+    bool isHeightfieldSampled;
+    bool isScatteringTabulated;
+    unsigned int atmosphereResolutionDivisor;
+    State state;
+};
+
+SimulationState captureSimulation(const Scene &scene)
+{
+    return SimulationState{
+        .time = 0,
+        .camera = scene.camera,
+        .lightDirection = scene.light.direction,
+        .lightRotationSpeed = scene.lightRotationSpeed,
+        .planetAngle = scene.planet.angle,
+        .planetRotateSpeed = scene.planet.rotateSpeed,
+        .planetSeed = scene.planet.seed,
+        .noiseOffset = scene.planet.noiseOffset,
+        .animation = scene.animation,
+        .planetRequests = scene.handledPlanetRequests,
+        .isTerrainBaked = scene.planet.isTerrainBaked,
+        .isTerrainChunked = scene.planet.isTerrainChunked,
+        .isHeightfieldSampled = scene.planet.isHeightfieldSampled,
+        .isScatteringTabulated = scene.atmosphere.isScatteringTabulated,
+        .atmosphereResolutionDivisor = scene.atmosphere.resolutionDivisor,
+        .state = State(),
+    };
+}
+
+// Between two consecutive states, at alpha from 0 to 1; the discrete parts come from the
+// later one. Values that did not change come out exactly as they were, which keeps the
+// noise offset of a planet at rest equal to the one its terrain was baked for.
+SimulationState interpolateSimulation(const SimulationState &previous, const SimulationState &current, float alpha)
+{
+    auto interpolate = [alpha](auto from, auto to)
+    {
+        return from + (to - from) * alpha;
+    };
+    SimulationState state = current;
+    state.time = interpolate(previous.time, current.time);
+    // the camera orbits the planet, so its direction and distance are interpolated apart
+    const float distance = interpolate(glm::length(previous.camera.position), glm::length(current.camera.position));
+    state.camera.position = glm::normalize(interpolate(previous.camera.position, current.camera.position)) * distance;
+    state.camera.up = glm::normalize(interpolate(previous.camera.up, current.camera.up));
+    state.lightDirection = glm::normalize(interpolate(previous.lightDirection, current.lightDirection));
+    state.planetAngle = interpolate(previous.planetAngle, current.planetAngle);
+    state.noiseOffset = interpolate(previous.noiseOffset, current.noiseOffset);
+    return state;
+}
+
+// returns whether a new planet was requested since the previous call
+bool applySimulation(Scene &scene, const SimulationState &simulation)
+{
+    scene.camera.position = simulation.camera.position;
+    scene.camera.up = simulation.camera.up;
+    scene.light.direction = simulation.lightDirection;
+    scene.animation = simulation.animation;
+
+    Planet &planet = scene.planet;
+    planet.angle = simulation.planetAngle;
+    planet.modelMatrix = glm::rotate(IDENTITY, planet.angle, UP);
+    planet.seed = simulation.planetSeed;
+    planet.noiseOffset = simulation.noiseOffset;
+    planet.isTerrainBaked = simulation.isTerrainBaked;
+    planet.isTerrainChunked = simulation.isTerrainChunked;
+    planet.isHeightfieldSampled = simulation.isHeightfieldSampled;
+    scene.atmosphere.isScatteringTabulated = simulation.isScatteringTabulated;
+    if (!scene.isQualityGoverned)
+    {
+        scene.atmosphere.resolutionDivisor = simulation.atmosphereResolutionDivisor;
+    }
+
+    const bool isNewPlanetRequested = simulation.planetRequests != scene.handledPlanetRequests;
+    scene.handledPlanetRequests = simulation.planetRequests;
+    return isNewPlanetRequested;
+}
+
+void updatePlanetMovement(SimulationState &simulation, float deltaTime)
+{
+    simulation.planetAngle += simulation.planetRotateSpeed * deltaTime;
+}
+
+void updateLight(SimulationState &simulation, float deltaTime)
+{
+    simulation.lightDirection = glm::rotate(IDENTITY, simulation.lightRotationSpeed * deltaTime, glm::vec3(1, 1, 0)) * glm::vec4(simulation.lightDirection, 0);
 }
 
 std::random_device device;
@@ -343,20 +765,299 @@ float random_in_range(float min, float max)
     return dist(generator);
 }
 
-void updateAnimation(Scene &scene, float deltaTime)
+void updateAnimation(SimulationState &simulation, float deltaTime)
+{
+    Animation &animation = simulation.animation;
+    if (!animation.active)
+    {
+        return;
+    }
+
+    animation.progress += deltaTime / animation.duration;
+    if (animation.progress >= 1)
+    {
+        animation.active = false;
+    }
+    const AnimationParameters parameters = animation.current();
+    simulation.noiseOffset = parameters.noiseOffset;
+}
+
+// Terrain is baked in the background while the current mesh keeps being drawn. A
+// finished bake is uploaded into the back mesh, which then becomes the front mesh.
+// While an animation runs, a new bake for the current noise offset starts whenever
+// the previous one is done; a new planet request cancels the running bake instead.
+// Once the planet is at rest, its terrain comes from the planet cache if possible,
+// and otherwise the bake for it goes there.
+void updateBakedTerrain(Scene &scene, bool isNewPlanetRequested)
 {
-    if (!scene.animation.active)
+    Planet &planet = scene.planet;
+    BakedTerrain bakedTerrain;
+    if (scene.terrainRegenerator.tryTakeResult(bakedTerrain))
+    {
+        scene.meshes[planet.backBakedMeshIndex].getVertexBuffer().update(bakedTerrain.vertices);
+        std::swap(planet.bakedMeshIndex, planet.backBakedMeshIndex);
+        planet.bakedNoiseOffset = bakedTerrain.noiseOffset;
+    }
+
+    if (!planet.isTerrainBaked || planet.isTerrainChunked || planet.requestedNoiseOffset == planet.noiseOffset)
     {
         return;
     }
 
-    scene.animation.progress += deltaTime / scene.animation.duration;
-    if (scene.animation.progress >= 1)
+    const bool isPlanetAtRest = !scene.animation.active;
+    if (isPlanetAtRest && scene.loadCachedBakedTerrain())
     {
-        scene.animation.active = false;
+        scene.terrainRegenerator.cancel();
+        planet.requestedNoiseOffset = planet.noiseOffset;
+        return;
+    }
+
+    if (scene.terrainRegenerator.isBusy() && !isNewPlanetRequested && !isPlanetAtRest)
+    {
+        return;
+    }
+
+    const TerrainNoiseParameters parameters = planet.terrainNoiseParameters();
+    const std::vector<glm::vec3> &spherePositions = scene.planetSphere.indexed_vertices;
+    const ChunkedIndices &chunks = scene.planetChunks;
+    const float minRadius = planet.minRadius();
+    const float maxRadius = planet.maxRadius();
+    const float footprint = planet.vertexSpacing();
+    ThreadPool &threadPool = *scene.threadPool;
+    PlanetCache *planetCache = isPlanetAtRest ? scene.planetCache : NULL;
+    const uint64_t id = planetId(planet.description());
+    scene.terrainRegenerator.submit([parameters, &spherePositions, &chunks, minRadius, maxRadius, footprint, &threadPool, planetCache, id](const CancellationToken &cancellation) -> std::optional<BakedTerrain>
+                                    {
+        std::optional<std::vector<BakedTerrainVertex>> bakedVertices = bakeTerrain(spherePositions, parameters, footprint, threadPool, cancellation);
+        if (!bakedVertices.has_value())
+        {
+            return std::nullopt;
+        }
+        std::vector<CompactTerrainVertex> vertices = compactTerrainVertices(*bakedVertices, chunks, minRadius, maxRadius);
+        if (planetCache != NULL)
+        {
+            planetCache->store(id, PlanetCacheEntryKind::BakedTerrain, {{vertices.data(), vertices.size() * sizeof(CompactTerrainVertex)}});
+        }
+        return BakedTerrain{
+            .noiseOffset = parameters.noiseOffset,
+            .vertices = std::move(vertices),
+        }; });
+    planet.requestedNoiseOffset = planet.noiseOffset;
+}
+
+// Like the baked terrain, the heightfield is baked in the background whenever the terrain
+// parameters change, and comes from or goes to the planet cache once the planet is at
+// rest. Until the heightfield for the current parameters is uploaded, the shaders fall
+// back to evaluating the noise, see updateUniforms().
+void updateHeightfield(Scene &scene, bool isNewPlanetRequested)
+{
+    Planet &planet = scene.planet;
+    TerrainHeightfield heightfield;
+    if (scene.heightfieldRegenerator.tryTakeResult(heightfield))
+    {
+        scene.uploadTerrainHeightfield(heightfield);
+    }
+
+    const TerrainNoiseParameters parameters = planet.terrainNoiseParameters();
+    if (!planet.isHeightfieldSampled || planet.requestedHeightfieldParameters == parameters)
+    {
+        return;
+    }
+
+    const bool isPlanetAtRest = !scene.animation.active;
+    if (isPlanetAtRest && scene.loadCachedTerrainHeightfield())
+    {
+        scene.heightfieldRegenerator.cancel();
+        planet.requestedHeightfieldParameters = parameters;
+        return;
+    }
+
+    if (scene.heightfieldRegenerator.isBusy() && !isNewPlanetRequested && !isPlanetAtRest)
+    {
+        return;
+    }
+
+    const unsigned int resolution = planet.heightfieldResolution;
+    const float baseRadius = planet.baseRadius;
+    ThreadPool &threadPool = *scene.threadPool;
+    PlanetCache *planetCache = isPlanetAtRest ? scene.planetCache : NULL;
+    const uint64_t id = planetId(planet.description());
+    scene.heightfieldRegenerator.submit([resolution, baseRadius, parameters, &threadPool, planetCache, id](const CancellationToken &cancellation)
+                                        {
+        std::optional<TerrainHeightfield> heightfield = bakeTerrainHeightfield(resolution, baseRadius, parameters, threadPool, cancellation);
+        if (heightfield.has_value() && planetCache != NULL)
+        {
+            storeTerrainHeightfield(*planetCache, id, *heightfield);
+        }
+        return heightfield; });
+    planet.requestedHeightfieldParameters = parameters;
+}
+
+void updateTerrainPatches(Scene &scene)
+{
+    const Planet &planet = scene.planet;
+    if (!planet.isTerrainChunked)
+    {
+        return;
+    }
+
+    const glm::mat4 modelViewProjectionMatrix = scene.camera.projectionMatrix() * scene.camera.viewMatrix() * planet.modelMatrix;
+    // the terrain shader clamps elevations to at least zero, so nothing lies below baseRadius
+    scene.planetTerrain.select(QuadtreeTerrainView{
+        .cameraPosition = glm::inverse(planet.modelMatrix) * glm::vec4(scene.camera.position, 1),
+        .frustum = Frustum::fromMatrix(modelViewProjectionMatrix),
+        .projectionScale = scene.camera.projectionScale(),
+        .baseRadius = planet.baseRadius,
+        .minRadius = planet.baseRadius,
+        .maxRadius = planet.baseRadius + planet.maxHeight + 1,
+    });
+}
+
+// The whole-sphere planet meshes, shader displaced or baked, share the clusters of the
+// planet sphere and are drawn with the ones that pass.
+void updatePlanetClusters(Scene &scene)
+{
+    const Planet &planet = scene.planet;
+    if (planet.isTerrainChunked)
+    {
+        scene.planetClusterStatistics = ClusterCullingStatistics();
+        return;
+    }
+
+    const glm::mat4 modelViewProjectionMatrix = scene.camera.projectionMatrix() * scene.camera.viewMatrix() * planet.modelMatrix;
+    // a unit of slack for the flat triangles between the displaced vertices
+    scene.planetClusterStatistics = cullClusters(ClusterCullingView{
+                                                     .cameraPosition = glm::inverse(planet.modelMatrix) * glm::vec4(scene.camera.position, 1),
+                                                     .frustum = Frustum::fromMatrix(modelViewProjectionMatrix),
+                                                     .minRadius = planet.minRadius() - 1,
+                                                     .maxRadius = planet.maxRadius() + 1,
+                                                 },
+                                                 scene.planetChunks, scene.planetClusterBounds, scene.planetClusterDraw, &scene.planetDrawnClusters);
+}
+
+// Estimates how many octaves the terrain vertex shaders sum this frame, taking the
+// footprint that they compute per vertex at the center of each drawn cluster or patch.
+// The histogram stays empty while the terrain is baked or sampled from the heightfield.
+void updatePlanetTerrainOctaves(Scene &scene)
+{
+    const Planet &planet = scene.planet;
+    scene.planetTerrainOctaves = TerrainOctaveHistogram();
+    if (planet.isHeightfieldSampled || (planet.isTerrainBaked && !planet.isTerrainChunked))
+    {
+        return;
+    }
+
+    const glm::vec3 cameraPosition = glm::inverse(planet.modelMatrix) * glm::vec4(scene.camera.position, 1);
+    const float pixelsPerUnit = scene.camera.projectionScale() * glm::length(glm::vec3(planet.modelMatrix[0]));
+    if (planet.isTerrainChunked)
+    {
+        // TerrainPatch.vertex.glsl bounds the footprint by the spacing of the finest patches
+        const QuadtreeTerrain &terrain = scene.planetTerrain;
+        const size_t patchVertices = size_t(terrain.getPatchResolution() + 1) * (terrain.getPatchResolution() + 1);
+        const float minFootprint = terrain.finestVertexSpacing(planet.baseRadius);
+        for (const TerrainPatch &patch : terrain.getPatches())
+        {
+            const glm::vec3 center = planet.baseRadius * glm::normalize(patch.origin + 0.5f * (patch.axisU + patch.axisV));
+            scene.planetTerrainOctaves.add(terrainOctaves(std::max(glm::length(center - cameraPosition) / pixelsPerUnit, minFootprint)), patchVertices);
+        }
+        return;
+    }
+
+    for (unsigned int cluster : scene.planetDrawnClusters)
+    {
+        const glm::vec3 center = planet.baseRadius * scene.planetClusterBounds[cluster].direction;
+        const float footprint = std::max(glm::length(center - cameraPosition) / pixelsPerUnit, planet.vertexSpacing());
+        // the clusters of a closed mesh have about half as many vertices as triangles
+        scene.planetTerrainOctaves.add(terrainOctaves(footprint), scene.planetChunks.clusters[cluster].numberOfIndices / 6);
+    }
+}
+
+// Fills the uniform blocks for this frame, so that drawing only binds them.
+void updateUniforms(Scene &scene)
+{
+    const Camera &camera = scene.camera;
+    const glm::mat4 viewMatrix = camera.viewMatrix();
+    const glm::mat4 projectionMatrix = camera.projectionMatrix();
+    const glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+
+    const Planet &planet = scene.planet;
+    scene.uniformBuffers.setObject(planet.uniformsIndex, ObjectUniforms{
+                                                             .modelMatrix = planet.modelMatrix,
+                                                             .modelViewProjectionMatrix = viewProjectionMatrix * planet.modelMatrix,
+                                                             .noiseOffset = planet.noiseOffset,
+                                                             .baseRadius = planet.baseRadius,
+                                                             .maxNegativeHeight = planet.maxDepth,
+                                                             .maxPositiveHeight = planet.maxHeight,
+                                                             .atmosphereRadius = 0,
+                                                             .isHeightfieldSampled = planet.isHeightfieldSampled && planet.bakedHeightfieldParameters == planet.terrainNoiseParameters(),
+                                                         });
+
+    const Atmosphere &atmosphere = scene.atmosphere;
+    scene.uniformBuffers.setObject(atmosphere.uniformsIndex, ObjectUniforms{
+                                                                 .modelMatrix = atmosphere.modelMatrix,
+                                                                 .modelViewProjectionMatrix = viewProjectionMatrix * atmosphere.modelMatrix,
+                                                                 .noiseOffset = glm::vec3(0),
+                                                                 .baseRadius = atmosphere.innerRadius,
+                                                                 .maxNegativeHeight = 0,
+                                                                 .maxPositiveHeight = 0,
+                                                                 .atmosphereRadius = atmosphere.outerRadius,
+                                                                 .isHeightfieldSampled = 0,
+                                                             });
+
+    scene.uniformBuffers.upload(FrameUniforms{
+        .viewMatrix = viewMatrix,
+        .projectionMatrix = projectionMatrix,
+        .viewProjectionMatrix = viewProjectionMatrix,
+        .cameraPositionInWorldSpace = camera.position,
+        .lightPower = scene.light.power,
+        .lightDirectionInWorldSpace = scene.light.direction,
+        .projectionScale = camera.projectionScale(),
+        .lightColor = scene.light.color,
+        .padding1 = 0,
+        .inverseViewProjectionMatrix = glm::inverse(viewProjectionMatrix),
+    });
+}
+
+// Bodies orbit between the atmosphere of the planet and the far end of the camera range.
+void generateStarSystem(Scene &scene, unsigned int numberOfBodies, uint32_t seed)
+{
+    scene.starSystem.setBodies(generateBodies(numberOfBodies, seed, StarSystemParameters{
+                                                                        .baseRadius = scene.planet.baseRadius,
+                                                                        .atmosphereRadius = scene.atmosphere.outerRadius,
+                                                                        .minOrbitRadius = 1.6f * scene.atmosphere.outerRadius,
+                                                                        .maxOrbitRadius = 0.9f * scene.camera.maxDistance,
+                                                                        .minBodyRadius = 1.5f,
+                                                                        .maxBodyRadius = 10.0f,
+                                                                    }));
+}
+
+void updateStarSystem(Scene &scene, float deltaTime)
+{
+    const Camera &camera = scene.camera;
+    scene.starSystem.update(deltaTime, StarSystemView{
+                                           .viewProjectionMatrix = camera.projectionMatrix() * camera.viewMatrix(),
+                                           .cameraPosition = camera.position,
+                                           .projectionScale = camera.projectionScale(),
+                                           .occluderRadius = scene.planet.baseRadius,
+                                       });
+}
+
+// (re)creates the offscreen atmosphere target when the resolution divisor or the viewport change
+void updateAtmosphereTarget(Scene &scene)
+{
+    const unsigned int divisor = scene.atmosphere.resolutionDivisor;
+    if (divisor <= 1)
+    {
+        scene.atmosphereTarget.reset();
+        return;
+    }
+    const unsigned int width = std::max(1u, ((unsigned int)scene.camera.viewportWidth + divisor - 1) / divisor);
+    const unsigned int height = std::max(1u, ((unsigned int)scene.camera.viewportHeight + divisor - 1) / divisor);
+    if (!scene.atmosphereTarget || scene.atmosphereTarget->getWidth() != width || scene.atmosphereTarget->getHeight() != height)
+    {
+        scene.atmosphereTarget.reset();
+        scene.atmosphereTarget.emplace(width, height, GL_RGBA16F);
     }
-    const AnimationParameters parameters = scene.animation.current();
-    scene.planet.noiseOffset = parameters.noiseOffset;
 }
 
 glm::vec3 orthogonal(const glm::vec3 vector)
@@ -387,128 +1088,853 @@ glm::vec3 random_orthogonal_direction(const glm::vec3 vector)
     return glm::cos(phi) * normal + glm::sin(phi) * binormal;
 }
 
-void update(GLFWwindow *window, Scene &scene)
+void simulate(SimulationState &simulation, const InputState &input, float deltaTime)
 {
-    double currentTime = glfwGetTime();
-    float deltaTime = float(currentTime - scene.state.lastTime);
-
-    updateCamera(scene.camera, window, deltaTime);
+    simulation.time += deltaTime;
+    updateCamera(simulation.camera, input, deltaTime);
 
-    int newNoiseOffset = glfwGetKey(window, GLFW_KEY_SPACE);
-    if (newNoiseOffset == GLFW_PRESS && !scene.state.isPlanetGenerationBlocked)
+    State &state = simulation.state;
+    if (input.newPlanet && !state.isPlanetGenerationBlocked)
     {
-        scene.animation.source = AnimationParameters{
-            .noiseOffset = scene.planet.noiseOffset,
+        simulation.planetRequests++;
+        simulation.animation.source = AnimationParameters{
+            .noiseOffset = simulation.noiseOffset,
         };
-        float phi = random_in_range(0, 3.14);
-        float theta = random_in_range(-1.57, 1.57);
-        glm::vec3 rotation_axis = random_orthogonal_direction(scene.light.direction);
+        // the step to the new noise offset follows from the seed of the planet alone
+        simulation.planetSeed = generator();
+        glm::vec3 rotation_axis = random_orthogonal_direction(simulation.lightDirection);
 
-        scene.animation.target = AnimationParameters{
-            .noiseOffset = scene.planet.noiseOffset + 0.5f * glm::vec3(glm::sin(theta) * glm::cos(phi), glm::sin(theta) * glm::sin(phi), glm::cos(phi)),
+        simulation.animation.target = AnimationParameters{
+            .noiseOffset = simulation.noiseOffset + planetNoiseOffsetStep(simulation.planetSeed),
         };
-        scene.animation.progress = 0;
-        scene.animation.duration = 0.5;
-        scene.animation.active = true;
+        simulation.animation.progress = 0;
+        simulation.animation.duration = 0.5;
+        simulation.animation.active = true;
 
-        scene.state.isPlanetGenerationBlocked = true;
+        state.isPlanetGenerationBlocked = true;
     }
-    else if (newNoiseOffset == GLFW_RELEASE)
+    else if (!input.newPlanet)
     {
-        scene.state.isPlanetGenerationBlocked = false;
+        state.isPlanetGenerationBlocked = false;
     }
 
-    updatePlanetMovement(scene, deltaTime);
-    updateLight(scene, deltaTime);
-    updateAnimation(scene, deltaTime);
+    if (input.toggleBakedTerrain && !state.isTerrainModeToggleBlocked)
+    {
+        simulation.isTerrainBaked = !simulation.isTerrainBaked;
+        state.isTerrainModeToggleBlocked = true;
+    }
+    else if (!input.toggleBakedTerrain)
+    {
+        state.isTerrainModeToggleBlocked = false;
+    }
+
+    if (input.toggleTerrainLod && !state.isTerrainLodToggleBlocked)
+    {
+        simulation.isTerrainChunked = !simulation.isTerrainChunked;
+        state.isTerrainLodToggleBlocked = true;
+    }
+    else if (!input.toggleTerrainLod)
+    {
+        state.isTerrainLodToggleBlocked = false;
+    }
+
+    if (input.toggleAtmosphereTables && !state.isAtmosphereModeToggleBlocked)
+    {
+        simulation.isScatteringTabulated = !simulation.isScatteringTabulated;
+        state.isAtmosphereModeToggleBlocked = true;
+    }
+    else if (!input.toggleAtmosphereTables)
+    {
+        state.isAtmosphereModeToggleBlocked = false;
+    }
+
+    if (input.toggleHeightfield && !state.isHeightfieldToggleBlocked)
+    {
+        simulation.isHeightfieldSampled = !simulation.isHeightfieldSampled;
+        state.isHeightfieldToggleBlocked = true;
+    }
+    else if (!input.toggleHeightfield)
+    {
+        state.isHeightfieldToggleBlocked = false;
+    }
 
-    scene.state.lastTime = currentTime;
+    if (input.cycleAtmosphereResolution && !state.isAtmosphereResolutionCycleBlocked)
+    {
+        unsigned int &divisor = simulation.atmosphereResolutionDivisor;
+        divisor = divisor >= 4 ? 1 : divisor * 2;
+        state.isAtmosphereResolutionCycleBlocked = true;
+    }
+    else if (!input.cycleAtmosphereResolution)
+    {
+        state.isAtmosphereResolutionCycleBlocked = false;
+    }
+
+    updatePlanetMovement(simulation, deltaTime);
+    updateLight(simulation, deltaTime);
+    updateAnimation(simulation, deltaTime);
 }
 
-void renderAtmosphere(const Scene &scene)
+// Takes the simulation over into the scene and updates everything that follows from it
+// for the next frame, which is where all uploads happen. deltaTime is the simulated time
+// since the previous frame.
+void updateScene(Scene &scene, const SimulationState &simulation, float deltaTime, Profiler *profiler)
 {
-    const glm::vec3 cameraPosition = scene.camera.position;
-    const glm::mat4 viewMatrix = scene.camera.viewMatrix();
-    const glm::mat4 projectionMatrix = scene.camera.projectionMatrix();
-    const glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
-    const GlMesh &mesh = scene.meshes[scene.atmosphere.meshIndex];
-    const glm::mat4 &modelViewProjectionMatrix = viewProjectionMatrix;
+    ProfileScope scope(profiler, "update", PROFILE_CPU);
 
-    const GlShaderProgram &shaderProgra = scene.shaderPrograms[scene.atmosphere.shaderIndex];
-    glUseProgram(shaderProgra.id());
+    const bool isNewPlanetRequested = applySimulation(scene, simulation);
+    {
+        ProfileScope bakedTerrainScope(profiler, "bakedTerrain", PROFILE_CPU);
+        updateBakedTerrain(scene, isNewPlanetRequested);
+    }
+    {
+        ProfileScope heightfieldScope(profiler, "heightfield", PROFILE_CPU);
+        updateHeightfield(scene, isNewPlanetRequested);
+    }
+    {
+        ProfileScope terrainSelectionScope(profiler, "terrainSelection", PROFILE_CPU);
+        updateTerrainPatches(scene);
+    }
+    {
+        ProfileScope clusterCullingScope(profiler, "clusterCulling", PROFILE_CPU);
+        updatePlanetClusters(scene);
+        updatePlanetTerrainOctaves(scene);
+    }
+    {
+        ProfileScope atmosphereTablesScope(profiler, "atmosphereTables", PROFILE_CPU);
+        scene.atmosphereTables.update(scene.atmosphere.innerRadius, scene.atmosphere.outerRadius, *scene.threadPool);
+        updateAtmosphereTarget(scene);
+    }
+    {
+        ProfileScope bodiesScope(profiler, "bodies", PROFILE_CPU);
+        updateStarSystem(scene, deltaTime);
+    }
+    {
+        ProfileScope uniformsScope(profiler, "uniforms", PROFILE_CPU);
+        updateUniforms(scene);
+    }
+}
 
-    glUniform3f(glGetUniformLocation(shaderProgra.id(), "lightDirectionInWorldSpace"), scene.light.direction.x, scene.light.direction.y, scene.light.direction.z);
-    glUniform1f(glGetUniformLocation(shaderProgra.id(), "lightPower"), scene.light.power);
+// one simulation step and the frame for it, which keeps the simulation in lockstep with
+// the frames, as the headless benchmark needs
+void update(Scene &scene, SimulationState &simulation, const InputState &input, float deltaTime, Profiler *profiler)
+{
+    simulate(simulation, input, deltaTime);
+    updateScene(scene, simulation, deltaTime, profiler);
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgra.id(), "modelViewProjectionMatrix"), 1, GL_FALSE, &modelViewProjectionMatrix[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgra.id(), "modelMatrix"), 1, GL_FALSE, &scene.atmosphere.modelMatrix[0][0]);
+// Hands the frames that the profiler collected to the governor. A frame costs the CPU time
+// of updating and submitting it, without waiting for the swap, and the GPU time of
+// rendering it.
+void measureQuality(QualityGovernor &governor, const Profiler &profiler)
+{
+    const std::vector<ProfileScopeStatistics> &scopes = profiler.getScopes();
+    const std::vector<ProfileScopeTiming> &timings = profiler.getResolvedTimings();
+    size_t i = 0;
+    while (i < timings.size())
+    {
+        const unsigned long frame = timings[i].frame;
+        double cpuMilliseconds = 0;
+        double gpuMilliseconds = 0;
+        for (; i < timings.size() && timings[i].frame == frame; i++)
+        {
+            const std::string &path = scopes[timings[i].scope].path;
+            if (path == "frame/update" || path == "frame/render")
+            {
+                cpuMilliseconds += timings[i].cpuMilliseconds;
+            }
+            if (path == "frame/render")
+            {
+                gpuMilliseconds = std::max(0.0, timings[i].gpuMilliseconds);
+            }
+        }
+        governor.addFrame(frame, cpuMilliseconds, gpuMilliseconds);
+    }
+}
+
+// after the profiler ended a frame; applies the tier that the governor moves to from the next frame on
+void governQuality(Scene &scene, QualityGovernor &governor, const Profiler &profiler)
+{
+    measureQuality(governor, profiler);
+    if (!governor.decide(profiler.getFrames()))
+    {
+        return;
+    }
+    const QualityDecision &decision = governor.getDecisions().back();
+    fprintf(stderr, "Quality %s -> %s at frame %lu: %.2f ms on the CPU and %.2f ms on the GPU per frame for a budget of %.2f ms\n",
+            QUALITY_TIERS[decision.fromTier].name, QUALITY_TIERS[decision.toTier].name, decision.frame,
+            decision.cpuMilliseconds, decision.gpuMilliseconds, governor.getBudgetMilliseconds());
+    scene.setQualityTier(governor.getTier());
+}
+
+// Simulates in fixed steps on a thread of its own, from the latest input that the window
+// thread handed over, so that slow frames slow down neither the simulation nor the
+// response to input. Each step publishes the states before and after it, and the render
+// thread interpolates between the latest pair at the time of its frame; neither thread
+// ever waits for the other.
+class SimulationThread
+{
+private:
+    static constexpr double STEP_SECONDS = 1.0 / 120;
+    // behind by more steps than this, e.g. after the process was suspended, the simulation
+    // skips the time instead of catching up
+    static const unsigned int MAX_STEPS_BEHIND = 12;
+
+    struct Snapshot
+    {
+        SimulationState previous;
+        SimulationState current;
+        // seconds since start at which current is due
+        double dueSeconds;
+    };
+
+    std::chrono::steady_clock::time_point start;
+    TripleBuffer<InputState> inputs;
+    TripleBuffer<Snapshot> snapshots;
+    std::atomic<bool> isRunning = true;
+    std::thread thread;
+
+    double secondsSinceStart() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run(SimulationState state)
+    {
+        double skippedSeconds = 0;
+        while (isRunning.load(std::memory_order_relaxed))
+        {
+            inputs.update();
+            const double now = secondsSinceStart();
+            unsigned int steps = 0;
+            while (state.time + skippedSeconds + STEP_SECONDS <= now)
+            {
+                if (steps == MAX_STEPS_BEHIND)
+                {
+                    skippedSeconds = now - state.time;
+                    break;
+                }
+                const SimulationState previous = state;
+                simulate(state, inputs.front(), STEP_SECONDS);
+                snapshots.back() = Snapshot{
+                    .previous = previous,
+                    .current = state,
+                    .dueSeconds = state.time + skippedSeconds,
+                };
+                snapshots.publish();
+                steps++;
+            }
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                      std::chrono::duration<double>(state.time + skippedSeconds + STEP_SECONDS)));
+        }
+    }
+
+public:
+    explicit SimulationThread(const SimulationState &initial)
+        : start(std::chrono::steady_clock::now()),
+          inputs(InputState()),
+          snapshots(Snapshot{.previous = initial, .current = initial, .dueSeconds = 0}),
+          thread([this, initial]()
+                 { run(initial); })
+    {
+    }
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    ~SimulationThread()
+    {
+        isRunning.store(false, std::memory_order_relaxed);
+        thread.join();
+    }
 
-    glUniform3f(glGetUniformLocation(shaderProgra.id(), "cameraPositionInWorldSpace"), cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    // window thread only
+    void setInput(const InputState &input)
+    {
+        inputs.back() = input;
+        inputs.publish();
+    }
 
-    glUniform1f(glGetUniformLocation(shaderProgra.id(), "baseRadius"), scene.atmosphere.innerRadius);
-    glUniform1f(glGetUniformLocation(shaderProgra.id(), "atmosphereRadius"), scene.atmosphere.outerRadius);
+    // render thread only; the state one step before now, which lies between the latest
+    // published pair unless the simulation fell behind
+    SimulationState interpolated()
+    {
+        snapshots.update();
+        const Snapshot &snapshot = snapshots.front();
+        const float alpha = glm::clamp((secondsSinceStart() - snapshot.dueSeconds) / STEP_SECONDS, 0.0, 1.0);
+        return interpolateSimulation(snapshot.previous, snapshot.current, alpha);
+    }
+};
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.getVertexBuffer().id());
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+void renderAtmosphere(const Scene &scene)
+{
+    const Atmosphere &atmosphere = scene.atmosphere;
+    const GlMesh &mesh = scene.meshes[atmosphere.meshIndex];
+    glUseProgram(scene.shaderPrograms[atmosphere.isScatteringTabulated ? atmosphere.tablesShaderIndex : atmosphere.shaderIndex].id());
+    scene.uniformBuffers.bindObject(atmosphere.uniformsIndex);
+    if (atmosphere.isScatteringTabulated)
+    {
+        scene.atmosphereTables.bind();
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.getElementBuffer().id());
-    glDrawElements(GL_TRIANGLES, mesh.getNumberOfElements(), GL_UNSIGNED_INT, 0);
+    mesh.draw();
 }
 
-void renderPlanet(const Scene &scene)
+// into the offscreen target, restoring the framebuffer and viewport afterwards
+void renderAtmosphereAtReducedResolution(const Scene &scene)
 {
-    const glm::vec3 cameraPosition = scene.camera.position;
-    const glm::mat4 viewMatrix = scene.camera.viewMatrix();
-    const glm::mat4 projectionMatrix = scene.camera.projectionMatrix();
-    const glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
-    const GlMesh &mesh = scene.meshes[scene.planet.meshIndex];
-    const glm::mat4 &modelViewProjectionMatrix = viewProjectionMatrix * scene.planet.modelMatrix;
+    const GlTextureFramebuffer &target = *scene.atmosphereTarget;
+    GLint previousFramebuffer = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.id());
+    glViewport(0, 0, target.getWidth(), target.getHeight());
+    // empty texels pass the planet as well, so that the outer boundary fades out as at full resolution
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    renderAtmosphere(scene);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
 
-    const GlShaderProgram &shaderProgram = scene.shaderPrograms[scene.planet.shaderIndex];
-    glUseProgram(shaderProgram.id());
+// fills the pixels that nothing was drawn to yet with the upsampled atmosphere
+void upsampleAtmosphere(const Scene &scene)
+{
+    glUseProgram(scene.shaderPrograms[scene.atmosphere.upsampleShaderIndex].id());
+    scene.uniformBuffers.bindObject(scene.atmosphere.uniformsIndex);
+    scene.atmosphereTarget->bindTexture(ATMOSPHERE_TARGET_TEXTURE_UNIT);
+
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(scene.fullScreenVertexArray.id());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDepthMask(GL_TRUE);
+}
 
-    glUniform3f(glGetUniformLocation(shaderProgram.id(), "lightDirectionInWorldSpace"), scene.light.direction.x, scene.light.direction.y, scene.light.direction.z);
-    glUniform3f(glGetUniformLocation(shaderProgram.id(), "lightColor"), scene.light.color.r, scene.light.color.g, scene.light.color.b);
-    glUniform1f(glGetUniformLocation(shaderProgram.id(), "lightPower"), scene.light.power);
+void renderPlanetPatches(const Scene &scene)
+{
+    const QuadtreeTerrain &terrain = scene.planetTerrain;
+    const TerrainPatchUniformLocations &locations = scene.planet.patchUniformLocations;
+    glUseProgram(scene.shaderPrograms[scene.planet.chunkedShaderIndex].id());
+    scene.uniformBuffers.bindObject(scene.planet.uniformsIndex);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram.id(), "modelViewProjectionMatrix"), 1, GL_FALSE, &modelViewProjectionMatrix[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram.id(), "modelMatrix"), 1, GL_FALSE, &scene.planet.modelMatrix[0][0]);
+    glBindVertexArray(terrain.getVertexArray().id());
+    for (const TerrainPatch &patch : terrain.getPatches())
+    {
+        glUniform3f(locations.origin, patch.origin.x, patch.origin.y, patch.origin.z);
+        glUniform3f(locations.axisU, patch.axisU.x, patch.axisU.y, patch.axisU.z);
+        glUniform3f(locations.axisV, patch.axisV.x, patch.axisV.y, patch.axisV.z);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrain.getElementBuffer(patch).id());
+        glDrawElements(GL_TRIANGLES, terrain.getNumberOfElements(patch), GL_UNSIGNED_SHORT, 0);
+    }
+}
 
-    glUniform3f(glGetUniformLocation(shaderProgram.id(), "cameraPositionInWorldSpace"), cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram.id(), "viewMatrix"), 1, GL_FALSE, &viewMatrix[0][0]);
+void renderPlanet(const Scene &scene)
+{
+    scene.terrainHeightfield.bind(TERRAIN_HEIGHTFIELD_TEXTURE_UNIT);
+    scene.terrainColorNoise.bind(TERRAIN_COLOR_NOISE_TEXTURE_UNIT);
+    if (scene.planet.isTerrainChunked)
+    {
+        renderPlanetPatches(scene);
+        return;
+    }
 
-    glUniform1f(glGetUniformLocation(shaderProgram.id(), "maxNegativeHeight"), scene.planet.maxDepth);
-    glUniform1f(glGetUniformLocation(shaderProgram.id(), "maxPositiveHeight"), scene.planet.maxHeight);
-    glUniform1f(glGetUniformLocation(shaderProgram.id(), "baseRadius"), scene.planet.baseRadius);
-    glUniform3f(glGetUniformLocation(shaderProgram.id(), "noiseOffset"), scene.planet.noiseOffset.x, scene.planet.noiseOffset.y, scene.planet.noiseOffset.z);
+    const GlMesh &mesh = scene.meshes[scene.planet.isTerrainBaked ? scene.planet.bakedMeshIndex : scene.planet.meshIndex];
+    glUseProgram(scene.shaderPrograms[scene.planet.isTerrainBaked ? scene.planet.bakedShaderIndex : scene.planet.shaderIndex].id());
+    scene.uniformBuffers.bindObject(scene.planet.uniformsIndex);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.getVertexBuffer().id());
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    // the terrain is a closed surface around the center, so its back faces are always covered
+    glEnable(GL_CULL_FACE);
+    mesh.draw(scene.planetClusterDraw);
+    glDisable(GL_CULL_FACE);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.getElementBuffer().id());
-    glDrawElements(GL_TRIANGLES, mesh.getNumberOfElements(), GL_UNSIGNED_INT, 0);
+void renderBodies(const Scene &scene)
+{
+    const GlShaderProgram &program = scene.shaderPrograms[scene.bodyShaderIndex];
+    glUseProgram(program.id());
+    scene.starSystem.drawTerrain(program.uniformLocation("unitVertexSpacing"));
 }
 
-void render(GLFWwindow *glfwWindow, const Scene &scene)
+// added onto what is drawn so far, once per pixel by culling the back faces
+void renderBodyAtmospheres(const Scene &scene)
 {
+    if (!scene.starSystem.hasAtmospheres())
+    {
+        return;
+    }
+    glUseProgram(scene.shaderPrograms[scene.bodyAtmosphereShaderIndex].id());
+    scene.atmosphereTables.bind();
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(GL_FALSE);
+    scene.starSystem.drawAtmospheres();
+    glDepthMask(GL_TRUE);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+}
+
+void render(const Scene &scene, Profiler *profiler)
+{
+    ProfileScope scope(profiler, "render", PROFILE_GPU);
     glClearColor(0.0, 0.0, 0.0, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
+    // at full resolution the atmosphere goes first and the planet covers it; at reduced
+    // resolution it is upsampled last, only into the pixels that the planet left empty
+    const bool isAtmosphereReduced = scene.atmosphereTarget.has_value();
     glDisable(GL_DEPTH_TEST);
-    renderAtmosphere(scene);
+    if (isAtmosphereReduced)
+    {
+        ProfileScope atmosphereScope(profiler, scene.atmosphere.resolutionDivisor == 2 ? "atmosphereHalf" : "atmosphereQuarter",
+                                     PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        renderAtmosphereAtReducedResolution(scene);
+    }
+    else
+    {
+        ProfileScope atmosphereScope(profiler, "atmosphere", PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        renderAtmosphere(scene);
+    }
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    renderPlanet(scene);
+    {
+        ProfileScope planetScope(profiler, "planet", PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        renderPlanet(scene);
+    }
+    {
+        ProfileScope bodiesScope(profiler, "bodies", PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        renderBodies(scene);
+    }
+    if (isAtmosphereReduced)
+    {
+        ProfileScope upsampleScope(profiler, "atmosphereUpsample", PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        upsampleAtmosphere(scene);
+    }
+    // after the upsampled atmosphere, which would cover the parts of them in front of space
+    {
+        ProfileScope bodyAtmospheresScope(profiler, "bodyAtmospheres", PROFILE_GPU | PROFILE_PIPELINE_STATISTICS);
+        renderBodyAtmospheres(scene);
+    }
 
-    glfwSwapBuffers(glfwWindow);
     check_gl_error();
 }
 
-int main(void)
+// Checks the host terrain kernels against the scalar port of TerrainNoise.glsl
+int checkTerrainNoise()
+{
+    const float tolerance = 1e-3f;
+    Planet planet;
+    bool passed = true;
+    for (SimdInstructionSet instructionSet : {SimdInstructionSet::Sse41, SimdInstructionSet::Avx2})
+    {
+        if (supportedSimdInstructionSet() < instructionSet)
+        {
+            printf("%s: not supported\n", simdInstructionSetName(instructionSet));
+            continue;
+        }
+        // all octaves, and those of the heightfield with the last one fading
+        for (float footprint : {0.0f, heightfieldTexelFootprint(planet.baseRadius, planet.heightfieldResolution)})
+        {
+            TerrainNoiseParity parity = checkTerrainNoiseParity(instructionSet, 1 << 16, 1, planet.baseRadius - planet.maxDepth, planet.baseRadius + planet.maxHeight, footprint);
+            bool withinTolerance = parity.maxElevationError <= tolerance && parity.maxGradientError <= tolerance;
+            printf("%s: %zu samples, %.2f octaves, max elevation error %g, max gradient error %g: %s\n",
+                   simdInstructionSetName(instructionSet), parity.samples, terrainOctaves(footprint), parity.maxElevationError, parity.maxGradientError,
+                   withinTolerance ? "ok" : "FAILED");
+            passed = passed && withinTolerance;
+        }
+    }
+    return passed ? 0 : 1;
+}
+
+const unsigned int DEFAULT_PLANET_CACHE_MEGABYTES = 512;
+// bodies are opt-in, with --bodies
+const unsigned int DEFAULT_BODIES = 0;
+
+struct BenchmarkOptions
+{
+    unsigned int frames = 600;
+    unsigned int warmupFrames = 10;
+    unsigned int seed = 1;
+    unsigned int planets = 1;
+    unsigned int bodies = DEFAULT_BODIES;
+    unsigned int width = 1024;
+    unsigned int height = 1024;
+    std::string inputScriptPath;
+    std::string outputPath;
+    std::string tracePath;
+    // an image sequence or raw video, see FrameCapture
+    std::string capturePath;
+    std::string programCachePath = "shader-cache";
+    std::string planetCachePath = "planet-cache";
+    unsigned int planetCacheMegabytes = DEFAULT_PLANET_CACHE_MEGABYTES;
+    // 0 for the one of the quality tier
+    unsigned int atmosphereResolutionDivisor = 0;
+    unsigned int qualityTier = DEFAULT_QUALITY_TIER;
+    // 0 keeps the quality tier fixed
+    double frameBudgetMilliseconds = 0;
+    ShaderVariants shaderVariants = ShaderVariants::Specialized;
+    // or orphan them every write
+    bool isPersistentMappingAllowed = true;
+};
+
+// how long it takes until the first frame is on screen, most of which goes into shaders
+struct StartupTimings
+{
+    double sceneMilliseconds;
+    double firstFrameMilliseconds;
+    ProgramCacheStatistics programCache;
+    MeshMemory meshMemory;
+    // of the planet sphere, which the baked terrain shares
+    MeshOptimization vertexCache;
+};
+
+void printStartupTimings(const StartupTimings &startup)
+{
+    printf("Started in %.1f ms: scene %.1f ms, first frame %.1f ms, shader programs %.1f ms (%u from the program cache, %u compiled, %u rejected binaries)\n",
+           startup.sceneMilliseconds + startup.firstFrameMilliseconds, startup.sceneMilliseconds, startup.firstFrameMilliseconds,
+           startup.programCache.milliseconds, startup.programCache.hits, startup.programCache.misses, startup.programCache.rejected);
+    printf("Meshes take %.1f MB, %.1f times less than %.1f MB with float vertices and 32-bit indices\n",
+           startup.meshMemory.bytes / 1e6, double(startup.meshMemory.uncompressedBytes) / startup.meshMemory.bytes, startup.meshMemory.uncompressedBytes / 1e6);
+    printf("Planet vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+           startup.vertexCache.before.acmr(), startup.vertexCache.after.acmr(), startup.vertexCache.before.atvr(), startup.vertexCache.after.atvr());
+}
+
+void printQualityJson(const QualityGovernor &governor)
+{
+    printf("  \"quality\": {\"tier\": \"%s\", \"budgetMs\": %.4f, \"tierFrames\": {", governor.getQualityTier().name, governor.getBudgetMilliseconds());
+    for (unsigned int tier = 0; tier < NUMBER_OF_QUALITY_TIERS; tier++)
+    {
+        printf("%s\"%s\": %lu", tier == 0 ? "" : ", ", QUALITY_TIERS[tier].name, governor.getTierFrames(tier));
+    }
+    printf("}, \"decisions\": [");
+    const std::vector<QualityDecision> &decisions = governor.getDecisions();
+    for (size_t i = 0; i < decisions.size(); i++)
+    {
+        printf("%s\n    {\"frame\": %lu, \"from\": \"%s\", \"to\": \"%s\", \"cpuMs\": %.4f, \"gpuMs\": %.4f}", i == 0 ? "" : ",",
+               decisions[i].frame, QUALITY_TIERS[decisions[i].fromTier].name, QUALITY_TIERS[decisions[i].toTier].name,
+               decisions[i].cpuMilliseconds, decisions[i].gpuMilliseconds);
+    }
+    printf("%s]},\n", decisions.empty() ? "" : "\n  ");
+}
+
+void printCaptureJson(const FrameCapture &capture)
+{
+    const FrameCaptureStatistics statistics = capture.getStatistics();
+    printf("  \"capture\": {\"path\": \"%s\", \"format\": \"%s\", \"offeredFrames\": %lu, \"writtenFrames\": %lu, \"droppedFrames\": %lu, \"failedFrames\": %lu, \"bytesWritten\": %llu, \"captureMsPerFrame\": %.4f},\n",
+           capture.getPath().c_str(), capture.isImageSequence() ? "ppm" : "rgb24", statistics.offeredFrames, statistics.writtenFrames, statistics.droppedFrames,
+           statistics.failedFrames, (unsigned long long)statistics.bytesWritten, statistics.captureMilliseconds / std::max(1ul, statistics.offeredFrames));
+}
+
+void printBufferPoolJson(const GlBufferPoolStatistics &pool, double frames)
+{
+    printf("  \"bufferPool\": {\"persistent\": %s, \"allocations\": %lu, \"reuses\": %lu, \"deletions\": %lu, \"liveBuffers\": %zu, \"liveBytes\": %zu, \"pooledBuffers\": %zu, \"pooledBytes\": %zu, "
+           "\"streamedBytesPerFrame\": %.0f, \"streamWritesPerFrame\": %.1f, \"fenceWaits\": %lu, \"orphansPerFrame\": %.1f},\n",
+           pool.isPersistent ? "true" : "false", pool.allocations, pool.reuses, pool.deletions, pool.liveBuffers, pool.liveBytes, pool.pooledBuffers, pool.pooledBytes,
+           pool.streamedBytes / frames, pool.streamWrites / frames, pool.fenceWaits, pool.orphans / frames);
+}
+
+// the means per frame of a histogram summed over the frames, next to the noise evaluations
+// that summing all octaves everywhere would take
+void printTerrainOctavesJson(const char *name, const TerrainOctaveHistogram &histogram, double frames)
+{
+    printf("\"%s\": {\"vertices\": [", name);
+    for (unsigned int octaves = 0; octaves <= TERRAIN_OCTAVE_COUNT; octaves++)
+    {
+        printf("%s%.0f", octaves == 0 ? "" : ", ", histogram.vertices[octaves] / frames);
+    }
+    printf("], \"noiseEvaluations\": %.0f, \"allOctaveNoiseEvaluations\": %.0f}",
+           histogram.noiseEvaluations() / frames, double(histogram.totalVertices()) * TERRAIN_OCTAVE_COUNT / frames);
+}
+
+// planetClusters and the histograms are summed over the frames
+void printBenchmarkReport(const BenchmarkOptions &options, const StartupTimings &startup, const PlanetCacheStatistics &planetCache,
+                          const ClusterCullingStatistics &planetClusters, const TerrainOctaveHistogram &planetOctaves,
+                          const TerrainOctaveHistogram &bodyOctaves, const QualityGovernor &governor, const GlBufferPoolStatistics &bufferPool,
+                          const FrameCapture *capture, const Profiler &profiler)
+{
+    const ProfileScopeStatistics *frame = profiler.findScope("frame");
+    printf("{\n");
+    printf("  \"renderer\": \"%s\",\n", (const char *)glGetString(GL_RENDERER));
+    printf("  \"frames\": %u, \"warmupFrames\": %u, \"seed\": %u, \"planets\": %u, \"bodies\": %u, \"width\": %u, \"height\": %u, \"droppedFrames\": %lu,\n",
+           options.frames, options.warmupFrames, options.seed, options.planets, options.bodies, options.width, options.height, profiler.getDroppedFrames());
+    printf("  \"shaderVariants\": \"%s\",\n", shaderVariantsName(options.shaderVariants));
+    printf("  \"startup\": {\"sceneMs\": %.4f, \"firstFrameMs\": %.4f, \"shaderProgramsMs\": %.4f, \"programCacheHits\": %u, \"programCacheMisses\": %u, \"programCacheRejected\": %u},\n",
+           startup.sceneMilliseconds, startup.firstFrameMilliseconds, startup.programCache.milliseconds,
+           startup.programCache.hits, startup.programCache.misses, startup.programCache.rejected);
+    printf("  \"meshMemory\": {\"bytes\": %zu, \"uncompressedBytes\": %zu},\n", startup.meshMemory.bytes, startup.meshMemory.uncompressedBytes);
+    printf("  \"vertexCache\": {\"acmrBefore\": %.4f, \"acmrAfter\": %.4f, \"atvrBefore\": %.4f, \"atvrAfter\": %.4f},\n",
+           startup.vertexCache.before.acmr(), startup.vertexCache.after.acmr(), startup.vertexCache.before.atvr(), startup.vertexCache.after.atvr());
+    printf("  \"planetCache\": {\"hits\": %u, \"misses\": %u, \"stores\": %u, \"evictions\": %u},\n",
+           planetCache.hits, planetCache.misses, planetCache.stores, planetCache.evictions);
+    const double frames = std::max(1u, options.frames);
+    printf("  \"planetClusters\": {\"clusters\": %.1f, \"horizonCulled\": %.1f, \"frustumCulled\": %.1f, \"drawn\": %.1f, \"drawnTriangles\": %.0f, \"drawRanges\": %.1f},\n",
+           planetClusters.clusters / frames, planetClusters.horizonCulledClusters / frames, planetClusters.frustumCulledClusters / frames,
+           planetClusters.drawnClusters / frames, planetClusters.drawnTriangles / frames, planetClusters.drawRanges / frames);
+    printf("  \"terrainOctaves\": {");
+    printTerrainOctavesJson("planet", planetOctaves, frames);
+    printf(", ");
+    printTerrainOctavesJson("bodies", bodyOctaves, frames);
+    printf("},\n");
+    printQualityJson(governor);
+    printBufferPoolJson(bufferPool, frames);
+    if (capture != NULL)
+    {
+        printCaptureJson(*capture);
+    }
+    printf("  \"frameMs\": ");
+    printTimingSummaryJson(stdout, profiler.getFrameIntervalMilliseconds().summary());
+    printf(",\n  \"cpuFrameMs\": ");
+    printTimingSummaryJson(stdout, frame->cpuMilliseconds.summary());
+    printf(",\n  \"gpuFrameMs\": ");
+    printTimingSummaryJson(stdout, frame->gpuMilliseconds.summary());
+    printf(",\n  \"scopes\": {");
+    const std::vector<ProfileScopeStatistics> &scopes = profiler.getScopes();
+    for (size_t i = 0; i < scopes.size(); i++)
+    {
+        printf("%s\n    \"%s\": {\"cpuMs\": ", i == 0 ? "" : ",", scopes[i].path.c_str());
+        printTimingSummaryJson(stdout, scopes[i].cpuMilliseconds.summary());
+        if (!scopes[i].gpuMilliseconds.empty())
+        {
+            printf(", \"gpuMs\": ");
+            printTimingSummaryJson(stdout, scopes[i].gpuMilliseconds.summary());
+        }
+        if (!scopes[i].vertexShaderInvocations.empty())
+        {
+            printf(", \"vertexShaderInvocations\": %.0f, \"fragmentShaderInvocations\": %.0f",
+                   scopes[i].vertexShaderInvocations.summary().mean, scopes[i].fragmentShaderInvocations.summary().mean);
+        }
+        printf("}");
+    }
+    printf("\n  }\n}\n");
+}
+
+#ifdef PROCEDURAL_PLANETS_HEADLESS
+// Renders a fixed number of frames offscreen with a fixed time step, scripted input and
+// a seeded planet sequence, and reports the frame timings as JSON on stdout.
+int runHeadlessBenchmark(const BenchmarkOptions &options)
+{
+    try
+    {
+        EglContext context;
+        Glew glew;
+        if (options.isPersistentMappingAllowed)
+        {
+            loadBufferStorage(eglGetProcAddress);
+        }
+        GlFramebuffer framebuffer(options.width, options.height);
+        glViewport(0, 0, options.width, options.height);
+
+        InputScript script = options.inputScriptPath.empty() ? defaultInputScript() : loadInputScript(options.inputScriptPath);
+        generator.seed(options.seed);
+        const unsigned int framesPerPlanet = std::max(1u, options.frames / std::max(1u, options.planets));
+        const float deltaTime = 1.0f / 60;
+
+        ThreadPool threadPool;
+        ProgramCache programCache(options.programCachePath);
+        PlanetCache planetCache(options.planetCachePath, uint64_t(options.planetCacheMegabytes) << 20);
+        StartupTimings startup;
+        std::chrono::steady_clock::time_point startupStart = std::chrono::steady_clock::now();
+        Scene scene(threadPool, programCache, planetCache, options.shaderVariants);
+        resizeCamera(scene.camera, options.width, options.height);
+        QualityGovernor governor(options.frameBudgetMilliseconds, options.qualityTier);
+        scene.setQualityTier(governor.getTier());
+        scene.isQualityGoverned = governor.isGoverning();
+        if (options.atmosphereResolutionDivisor != 0)
+        {
+            scene.atmosphere.resolutionDivisor = options.atmosphereResolutionDivisor;
+        }
+        generateStarSystem(scene, options.bodies, options.seed);
+        startup.sceneMilliseconds = millisecondsSince(startupStart);
+        startup.programCache = programCache.getStatistics();
+        startup.meshMemory = scene.meshMemory;
+        startup.vertexCache = scene.planetSphereOptimization;
+        SimulationState simulation = captureSimulation(scene);
+
+        // some drivers only finish compiling shaders when they are first drawn with
+        startupStart = std::chrono::steady_clock::now();
+        update(scene, simulation, InputState(), deltaTime, NULL);
+        render(scene, NULL);
+        glFinish();
+        startup.firstFrameMilliseconds = millisecondsSince(startupStart);
+
+        // warmup frames fill the caches without being measured
+        for (unsigned int frame = 0; frame < options.warmupFrames; frame++)
+        {
+            update(scene, simulation, InputState(), deltaTime, NULL);
+            render(scene, NULL);
+        }
+        glFinish();
+
+        // a frame lasts until the next one starts, or until the GPU is done for the last one
+        Profiler profiler(0);
+        if (!options.tracePath.empty())
+        {
+            profiler.enableTracing(0);
+        }
+        const GlBufferPoolStatistics measuredStreamStart = scene.bufferPool.getStatistics();
+        std::optional<FrameCapture> capture;
+        if (!options.capturePath.empty())
+        {
+            capture.emplace(options.capturePath, options.width, options.height);
+        }
+        ClusterCullingStatistics planetClusters;
+        TerrainOctaveHistogram planetOctaves;
+        TerrainOctaveHistogram bodyOctaves;
+        for (unsigned int frame = 0; frame < options.frames; frame++)
+        {
+            profiler.beginFrame();
+            InputState input = script.inputAt(frame);
+            input.newPlanet = input.newPlanet || (frame > 0 && frame % framesPerPlanet == 0);
+            update(scene, simulation, input, deltaTime, &profiler);
+            planetClusters.add(scene.planetClusterStatistics);
+            planetOctaves.add(scene.planetTerrainOctaves);
+            bodyOctaves.add(scene.starSystem.getStatistics().terrainOctaves);
+            render(scene, &profiler);
+            if (capture.has_value())
+            {
+                ProfileScope captureScope(&profiler, "capture", PROFILE_CPU);
+                capture->capture(options.width, options.height);
+            }
+            profiler.endFrame();
+            governQuality(scene, governor, profiler);
+            glFlush();
+        }
+        profiler.finish();
+        measureQuality(governor, profiler);
+        // the streamed bytes and writes of the measured frames only
+        GlBufferPoolStatistics bufferPool = scene.bufferPool.getStatistics();
+        bufferPool.streamedBytes -= measuredStreamStart.streamedBytes;
+        bufferPool.streamWrites -= measuredStreamStart.streamWrites;
+        bufferPool.orphans -= measuredStreamStart.orphans;
+        if (capture.has_value())
+        {
+            capture->finish();
+        }
+
+        if (!options.outputPath.empty() && !writeFramebufferPpm(options.outputPath, options.width, options.height))
+        {
+            fprintf(stderr, "Failed to write %s\n", options.outputPath.c_str());
+            return 1;
+        }
+        if (!options.tracePath.empty() && !profiler.writeChromeTrace(options.tracePath))
+        {
+            fprintf(stderr, "Failed to write %s\n", options.tracePath.c_str());
+            return 1;
+        }
+        printBenchmarkReport(options, startup, planetCache.getStatistics(), planetClusters, planetOctaves, bodyOctaves, governor, bufferPool,
+                             capture.has_value() ? &*capture : NULL, profiler);
+    }
+    catch (int exception)
+    {
+        fprintf(stderr, "Failed to set up headless rendering\n");
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+void printUsage(const char *program)
 {
+    fprintf(stderr, "usage: %s [--check-terrain-noise]\n", program);
+    fprintf(stderr, "       %s [--bodies N]\n", program);
+    fprintf(stderr, "       %s --headless [--frames N] [--warmup-frames N] [--seed N] [--planets N] [--bodies N] [--width N] [--height N]\n", program);
+    fprintf(stderr, "           [--input-script FILE] [--output FILE.ppm] [--trace FILE.json] [--capture FILE] [--program-cache DIR]\n");
+    fprintf(stderr, "           [--atmosphere-resolution 1|2|4] [--planet-cache DIR] [--planet-cache-megabytes N]\n");
+    fprintf(stderr, "           [--quality-tier ultra|high|medium|low|minimum] [--frame-budget MS]\n");
+    fprintf(stderr, "           [--shader-variants generic|specialized] [--stream-buffers persistent|orphaning]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "--check-terrain-noise")
+    {
+        return checkTerrainNoise();
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--headless")
+    {
+        BenchmarkOptions options;
+        for (int i = 2; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            if (i + 1 >= argc)
+            {
+                printUsage(argv[0]);
+                return 1;
+            }
+            const char *value = argv[++i];
+            if (argument == "--frames")
+                options.frames = std::max(1, atoi(value));
+            else if (argument == "--warmup-frames")
+                options.warmupFrames = std::max(0, atoi(value));
+            else if (argument == "--seed")
+                options.seed = strtoul(value, NULL, 10);
+            else if (argument == "--planets")
+                options.planets = std::max(1, atoi(value));
+            else if (argument == "--bodies")
+                options.bodies = std::max(0, atoi(value));
+            else if (argument == "--width")
+                options.width = std::max(1, atoi(value));
+            else if (argument == "--height")
+                options.height = std::max(1, atoi(value));
+            else if (argument == "--input-script")
+                options.inputScriptPath = value;
+            else if (argument == "--output")
+                options.outputPath = value;
+            else if (argument == "--trace")
+                options.tracePath = value;
+            else if (argument == "--capture")
+                options.capturePath = value;
+            else if (argument == "--program-cache")
+                options.programCachePath = value;
+            else if (argument == "--planet-cache")
+                options.planetCachePath = value;
+            else if (argument == "--planet-cache-megabytes")
+                options.planetCacheMegabytes = std::max(0, atoi(value));
+            else if (argument == "--atmosphere-resolution" && (atoi(value) == 1 || atoi(value) == 2 || atoi(value) == 4))
+                options.atmosphereResolutionDivisor = atoi(value);
+            else if (argument == "--quality-tier" && findQualityTier(value) < NUMBER_OF_QUALITY_TIERS)
+                options.qualityTier = findQualityTier(value);
+            else if (argument == "--frame-budget")
+                options.frameBudgetMilliseconds = std::max(0.0, atof(value));
+            else if (argument == "--shader-variants" && std::string(value) == "generic")
+                options.shaderVariants = ShaderVariants::Generic;
+            else if (argument == "--shader-variants" && std::string(value) == "specialized")
+                options.shaderVariants = ShaderVariants::Specialized;
+            else if (argument == "--stream-buffers" && std::string(value) == "persistent")
+                options.isPersistentMappingAllowed = true;
+            else if (argument == "--stream-buffers" && std::string(value) == "orphaning")
+                options.isPersistentMappingAllowed = false;
+            else
+            {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+#ifdef PROCEDURAL_PLANETS_HEADLESS
+        return runHeadlessBenchmark(options);
+#else
+        fprintf(stderr, "Headless mode needs EGL, which was not found when building\n");
+        return 1;
+#endif
+    }
+
+    unsigned int bodies = DEFAULT_BODIES;
+    if (argc == 3 && std::string(argv[1]) == "--bodies")
+    {
+        bodies = std::max(0, atoi(argv[2]));
+    }
+    else if (argc > 1)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
     try
     {
         Glfw glfw;
@@ -518,15 +1944,121 @@ int main(void)
             try
             {
                 Glew glew;
-                Scene scene;
+                loadBufferStorage(glfwGetProcAddress);
+                ThreadPool threadPool;
+                ProgramCache programCache("shader-cache");
+                PlanetCache planetCache("planet-cache", uint64_t(DEFAULT_PLANET_CACHE_MEGABYTES) << 20);
+                StartupTimings startup;
+                std::chrono::steady_clock::time_point startupStart = std::chrono::steady_clock::now();
+                Scene scene(threadPool, programCache, planetCache);
+                generateStarSystem(scene, bodies, generator());
+                startup.sceneMilliseconds = millisecondsSince(startupStart);
+                startup.programCache = programCache.getStatistics();
+                startup.meshMemory = scene.meshMemory;
+                startup.vertexCache = scene.planetSphereOptimization;
+                startupStart = std::chrono::steady_clock::now();
+                bool isStartupReported = false;
+                Profiler profiler;
+                profiler.enableTracing(600);
+                double lastTitleUpdate = 0;
+                bool isTraceWriteBlocked = false;
                 GLFWwindow *glfwWindow = window.glfwWindow();
-                GlVertexArrayObject vao;
-                glBindVertexArray(vao.id());
+                const double frameBudgetMilliseconds = 1000.0 / 60;
+                QualityGovernor governor(frameBudgetMilliseconds);
+                scene.isQualityGoverned = true;
+                bool isGovernorToggleBlocked = false;
+                std::optional<FrameCapture> capture;
+                bool isCaptureToggleBlocked = false;
+                SimulationThread simulationThread(captureSimulation(scene));
+                double lastSimulationTime = 0;
                 do
                 {
+                    profiler.beginFrame();
                     glfwPollEvents();
-                    update(glfwWindow, scene);
-                    render(glfwWindow, scene);
+                    const double currentTime = glfwGetTime();
+                    simulationThread.setInput(readInput(glfwWindow));
+
+                    int width, height;
+                    glfwGetWindowSize(glfwWindow, &width, &height);
+                    resizeCamera(scene.camera, width, height);
+
+                    // the bodies orbit in simulated time as well
+                    const SimulationState simulation = simulationThread.interpolated();
+                    const float deltaTime = std::max(0.0, simulation.time - lastSimulationTime);
+                    lastSimulationTime = simulation.time;
+                    updateScene(scene, simulation, deltaTime, &profiler);
+                    render(scene, &profiler);
+                    if (capture.has_value())
+                    {
+                        ProfileScope captureScope(&profiler, "capture", PROFILE_CPU);
+                        int framebufferWidth, framebufferHeight;
+                        glfwGetFramebufferSize(glfwWindow, &framebufferWidth, &framebufferHeight);
+                        capture->capture(framebufferWidth, framebufferHeight);
+                    }
+                    {
+                        ProfileScope swapScope(&profiler, "swap", PROFILE_CPU);
+                        glfwSwapBuffers(glfwWindow);
+                    }
+                    profiler.endFrame();
+                    governQuality(scene, governor, profiler);
+
+                    if (!isStartupReported)
+                    {
+                        glFinish();
+                        startup.firstFrameMilliseconds = millisecondsSince(startupStart);
+                        printStartupTimings(startup);
+                        isStartupReported = true;
+                    }
+
+                    if (currentTime - lastTitleUpdate > 0.5)
+                    {
+                        const std::string quality = std::string(" | quality ") + governor.getQualityTier().name + (governor.isGoverning() ? " (governed)" : "");
+                        glfwSetWindowTitle(glfwWindow, ("Procedural Planets | " + profiler.describe(2) + quality).c_str());
+                        lastTitleUpdate = currentTime;
+                    }
+
+                    bool isTraceWriteRequested = glfwGetKey(glfwWindow, GLFW_KEY_T) == GLFW_PRESS;
+                    if (isTraceWriteRequested && !isTraceWriteBlocked)
+                    {
+                        const char *tracePath = "ProceduralPlanets.trace.json";
+                        if (profiler.writeChromeTrace(tracePath))
+                        {
+                            printf("Wrote the last 600 frames to %s\n", tracePath);
+                        }
+                    }
+                    isTraceWriteBlocked = isTraceWriteRequested;
+
+                    // frames of another size, after resizing the window, are dropped
+                    bool isCaptureToggleRequested = glfwGetKey(glfwWindow, GLFW_KEY_C) == GLFW_PRESS;
+                    if (isCaptureToggleRequested && !isCaptureToggleBlocked)
+                    {
+                        if (capture.has_value())
+                        {
+                            capture->finish();
+                            const FrameCaptureStatistics statistics = capture->getStatistics();
+                            printf("Captured %lu of %lu frames of %u × %u to %s (%lu dropped, %lu failed, %.3f ms per frame on the render thread)\n",
+                                   statistics.writtenFrames, statistics.offeredFrames, capture->getWidth(), capture->getHeight(), capture->getPath().c_str(),
+                                   statistics.droppedFrames, statistics.failedFrames, statistics.captureMilliseconds / std::max(1ul, statistics.offeredFrames));
+                            capture.reset();
+                        }
+                        else
+                        {
+                            int framebufferWidth, framebufferHeight;
+                            glfwGetFramebufferSize(glfwWindow, &framebufferWidth, &framebufferHeight);
+                            capture.emplace("ProceduralPlanets.capture.rgb", framebufferWidth, framebufferHeight);
+                        }
+                    }
+                    isCaptureToggleBlocked = isCaptureToggleRequested;
+
+                    // without the governor the quality returns to the default tier, and R sets the atmosphere resolution again
+                    bool isGovernorToggleRequested = glfwGetKey(glfwWindow, GLFW_KEY_G) == GLFW_PRESS;
+                    if (isGovernorToggleRequested && !isGovernorToggleBlocked)
+                    {
+                        governor = governor.isGoverning() ? QualityGovernor(0) : QualityGovernor(frameBudgetMilliseconds, scene.qualityTier);
+                        scene.setQualityTier(governor.getTier());
+                        scene.isQualityGoverned = governor.isGoverning();
+                    }
+                    isGovernorToggleBlocked = isGovernorToggleRequested;
                 } while (!glfwWindowShouldClose(glfwWindow));
             }
             catch (int exception)
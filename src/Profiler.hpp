@@ -0,0 +1,527 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "Benchmark.hpp"
+
+// GL_ARB_pipeline_statistics_query, core since OpenGL 4.6; GLEW 1.9 predates it
+#ifndef GL_VERTEX_SHADER_INVOCATIONS_ARB
+#define GL_VERTEX_SHADER_INVOCATIONS_ARB 0x82F0
+#endif
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+enum ProfileScopeFlags
+{
+    PROFILE_CPU = 0,
+    PROFILE_GPU = 1,
+    // counts vertex and fragment shader invocations where the driver supports it; only
+    // one such scope can be open at a time, nested ones are not counted
+    PROFILE_PIPELINE_STATISTICS = 2,
+};
+
+// The most recent samples, or all of them when the capacity is 0.
+class RollingSamples
+{
+private:
+    std::vector<double> values;
+    size_t capacity;
+    size_t next = 0;
+
+public:
+    explicit RollingSamples(size_t capacity) : capacity(capacity)
+    {
+    }
+
+    void add(double value)
+    {
+        if (capacity == 0 || values.size() < capacity)
+        {
+            values.push_back(value);
+            return;
+        }
+        values[next] = value;
+        next = (next + 1) % capacity;
+    }
+
+    bool empty() const
+    {
+        return values.empty();
+    }
+
+    // in no particular order
+    const std::vector<double> &samples() const
+    {
+        return values;
+    }
+
+    TimingSummary summary() const
+    {
+        return summarizeTimings(values);
+    }
+};
+
+struct ProfileScopeStatistics
+{
+    std::string name;
+    // names of the enclosing scopes and this one, joined by '/'
+    std::string path;
+    int parent;
+    unsigned int depth;
+    unsigned int flags;
+    RollingSamples cpuMilliseconds;
+    RollingSamples gpuMilliseconds;
+    RollingSamples vertexShaderInvocations;
+    RollingSamples fragmentShaderInvocations;
+};
+
+// the timings of one scope in one frame
+struct ProfileScopeTiming
+{
+    unsigned int scope;
+    unsigned long frame;
+    double cpuMilliseconds;
+    // negative for CPU scopes
+    double gpuMilliseconds;
+};
+
+// Nested CPU and GPU timing scopes. GPU scopes put GL_TIMESTAMP queries around their
+// commands, which unlike GL_TIME_ELAPSED may nest. The queries of a frame are read a few
+// frames later, once the GPU has finished them, from a ring of frames in flight; a frame
+// whose results are still missing when its slot comes round again is dropped rather than
+// waited for. Timings are kept per scope over a rolling window, and optionally as trace
+// events in the Chrome trace format.
+class Profiler
+{
+private:
+    static const unsigned int FRAMES_IN_FLIGHT = 4;
+
+    struct ScopeRecord
+    {
+        unsigned int scope;
+        double cpuBegin;
+        double cpuEnd;
+        int gpuQuery;
+        int statisticsQuery;
+    };
+
+    struct FrameSlot
+    {
+        std::vector<GLuint> queries;
+        unsigned int usedQueries = 0;
+        std::vector<ScopeRecord> records;
+        bool pending = false;
+        unsigned long frame = 0;
+    };
+
+    struct TraceEvent
+    {
+        unsigned int scope;
+        unsigned long frame;
+        bool onGpu;
+        double beginMicroseconds;
+        double durationMicroseconds;
+    };
+
+    size_t windowSize;
+    std::vector<ProfileScopeStatistics> scopes;
+    FrameSlot slots[FRAMES_IN_FLIGHT];
+    unsigned int currentSlot = 0;
+    std::vector<unsigned int> openRecords;
+    bool isStatisticsQueryOpen = false;
+    bool isPipelineStatisticsSupported = false;
+
+    std::chrono::steady_clock::time_point epoch;
+    GLint64 gpuEpochNanoseconds = 0;
+    unsigned long frames = 0;
+    unsigned long droppedFrames = 0;
+    double previousFrameBegin = -1;
+    RollingSamples frameIntervalMilliseconds;
+    std::vector<ProfileScopeTiming> resolvedTimings;
+
+    bool isTracing = false;
+    unsigned long traceFrameLimit = 0;
+    std::deque<TraceEvent> traceEvents;
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static bool hasPipelineStatistics()
+    {
+        GLint majorVersion = 0, minorVersion = 0, numberOfExtensions = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+        glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+        if (majorVersion > 4 || (majorVersion == 4 && minorVersion >= 6))
+        {
+            return true;
+        }
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numberOfExtensions);
+        for (GLint i = 0; i < numberOfExtensions; i++)
+        {
+            if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_pipeline_statistics_query") == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned int scopeIndex(int parent, const char *name, unsigned int flags)
+    {
+        for (unsigned int i = 0; i < scopes.size(); i++)
+        {
+            if (scopes[i].parent == parent && scopes[i].name == name)
+            {
+                return i;
+            }
+        }
+        scopes.push_back(ProfileScopeStatistics{
+            .name = name,
+            .path = parent < 0 ? std::string(name) : scopes[parent].path + "/" + name,
+            .parent = parent,
+            .depth = parent < 0 ? 0 : scopes[parent].depth + 1,
+            .flags = flags,
+            .cpuMilliseconds = RollingSamples(windowSize),
+            .gpuMilliseconds = RollingSamples(windowSize),
+            .vertexShaderInvocations = RollingSamples(windowSize),
+            .fragmentShaderInvocations = RollingSamples(windowSize),
+        });
+        return scopes.size() - 1;
+    }
+
+    // the first of `count` consecutive queries of the current frame
+    int acquireQueries(unsigned int count)
+    {
+        FrameSlot &slot = slots[currentSlot];
+        if (slot.usedQueries + count > slot.queries.size())
+        {
+            size_t first = slot.queries.size();
+            slot.queries.resize(slot.usedQueries + count);
+            glGenQueries(slot.queries.size() - first, &slot.queries[first]);
+        }
+        slot.usedQueries += count;
+        return slot.usedQueries - count;
+    }
+
+    static GLuint64 queryResult(GLuint query)
+    {
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+        return result;
+    }
+
+    bool isAvailable(const FrameSlot &slot) const
+    {
+        for (unsigned int i = 0; i < slot.usedQueries; i++)
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(slot.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void resolve(FrameSlot &slot)
+    {
+        for (const ScopeRecord &record : slot.records)
+        {
+            ProfileScopeStatistics &scope = scopes[record.scope];
+            scope.cpuMilliseconds.add(record.cpuEnd - record.cpuBegin);
+            resolvedTimings.push_back(ProfileScopeTiming{record.scope, slot.frame, record.cpuEnd - record.cpuBegin, -1});
+            if (isTracing)
+            {
+                traceEvents.push_back(TraceEvent{record.scope, slot.frame, false, record.cpuBegin * 1e3, (record.cpuEnd - record.cpuBegin) * 1e3});
+            }
+            if (record.gpuQuery >= 0)
+            {
+                GLuint64 begin = queryResult(slot.queries[record.gpuQuery]);
+                GLuint64 end = queryResult(slot.queries[record.gpuQuery + 1]);
+                scope.gpuMilliseconds.add((end - begin) / 1e6);
+                resolvedTimings.back().gpuMilliseconds = (end - begin) / 1e6;
+                if (isTracing)
+                {
+                    traceEvents.push_back(TraceEvent{record.scope, slot.frame, true, (GLint64(begin) - gpuEpochNanoseconds) / 1e3, (end - begin) / 1e3});
+                }
+            }
+            if (record.statisticsQuery >= 0)
+            {
+                scope.vertexShaderInvocations.add(queryResult(slot.queries[record.statisticsQuery]));
+                scope.fragmentShaderInvocations.add(queryResult(slot.queries[record.statisticsQuery + 1]));
+            }
+        }
+        while (traceFrameLimit > 0 && !traceEvents.empty() && traceEvents.front().frame + traceFrameLimit <= slot.frame)
+        {
+            traceEvents.pop_front();
+        }
+        slot.pending = false;
+    }
+
+public:
+    // windowSize: how many recent samples the statistics keep, 0 for all of them
+    explicit Profiler(size_t windowSize = 240)
+        : windowSize(windowSize), frameIntervalMilliseconds(windowSize)
+    {
+        isPipelineStatisticsSupported = hasPipelineStatistics();
+        glGetInteger64v(GL_TIMESTAMP, &gpuEpochNanoseconds);
+        epoch = std::chrono::steady_clock::now();
+    }
+
+    ~Profiler()
+    {
+        for (FrameSlot &slot : slots)
+        {
+            if (!slot.queries.empty())
+            {
+                glDeleteQueries(slot.queries.size(), slot.queries.data());
+            }
+        }
+    }
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    // keeps trace events of the last frameLimit frames, or of all frames when it is 0
+    void enableTracing(unsigned long frameLimit)
+    {
+        isTracing = true;
+        traceFrameLimit = frameLimit;
+    }
+
+    // opens the root scope "frame", which every other scope of the frame is nested in
+    void beginFrame()
+    {
+        FrameSlot &slot = slots[currentSlot];
+        if (slot.pending)
+        {
+            droppedFrames++;
+        }
+        slot.pending = false;
+        slot.usedQueries = 0;
+        slot.records.clear();
+        slot.frame = frames;
+
+        double frameBegin = now();
+        if (previousFrameBegin >= 0)
+        {
+            frameIntervalMilliseconds.add(frameBegin - previousFrameBegin);
+        }
+        previousFrameBegin = frameBegin;
+        beginScope("frame", PROFILE_GPU);
+    }
+
+    // closes the frame and collects the results of earlier frames that are available
+    void endFrame()
+    {
+        endScope();
+        resolvedTimings.clear();
+        slots[currentSlot].pending = true;
+        frames++;
+        currentSlot = (currentSlot + 1) % FRAMES_IN_FLIGHT;
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            FrameSlot &slot = slots[(currentSlot + i) % FRAMES_IN_FLIGHT];
+            if (slot.pending && isAvailable(slot))
+            {
+                resolve(slot);
+            }
+        }
+    }
+
+    // waits for the GPU and collects every outstanding frame; the time since the last
+    // frame began counts as its interval
+    void finish()
+    {
+        glFinish();
+        frameIntervalMilliseconds.add(now() - previousFrameBegin);
+        previousFrameBegin = -1;
+        resolvedTimings.clear();
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            FrameSlot &slot = slots[(currentSlot + i) % FRAMES_IN_FLIGHT];
+            if (slot.pending)
+            {
+                resolve(slot);
+            }
+        }
+    }
+
+    void beginScope(const char *name, unsigned int flags)
+    {
+        FrameSlot &slot = slots[currentSlot];
+        int parent = openRecords.empty() ? -1 : int(slot.records[openRecords.back()].scope);
+        ScopeRecord record{
+            .scope = scopeIndex(parent, name, flags),
+            .cpuBegin = now(),
+            .cpuEnd = 0,
+            .gpuQuery = -1,
+            .statisticsQuery = -1,
+        };
+        if (flags & PROFILE_GPU)
+        {
+            record.gpuQuery = acquireQueries(2);
+            glQueryCounter(slot.queries[record.gpuQuery], GL_TIMESTAMP);
+        }
+        if ((flags & PROFILE_PIPELINE_STATISTICS) && isPipelineStatisticsSupported && !isStatisticsQueryOpen)
+        {
+            record.statisticsQuery = acquireQueries(2);
+            glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, slot.queries[record.statisticsQuery]);
+            glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, slot.queries[record.statisticsQuery + 1]);
+            isStatisticsQueryOpen = true;
+        }
+        openRecords.push_back(slot.records.size());
+        slot.records.push_back(record);
+    }
+
+    void endScope()
+    {
+        FrameSlot &slot = slots[currentSlot];
+        ScopeRecord &record = slot.records[openRecords.back()];
+        openRecords.pop_back();
+        if (record.statisticsQuery >= 0)
+        {
+            glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+            glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+            isStatisticsQueryOpen = false;
+        }
+        if (record.gpuQuery >= 0)
+        {
+            glQueryCounter(slot.queries[record.gpuQuery + 1], GL_TIMESTAMP);
+        }
+        record.cpuEnd = now();
+    }
+
+    // in the order the scopes were first opened, so that parents precede their children
+    const std::vector<ProfileScopeStatistics> &getScopes() const
+    {
+        return scopes;
+    }
+
+    const ProfileScopeStatistics *findScope(const std::string &path) const
+    {
+        for (const ProfileScopeStatistics &scope : scopes)
+        {
+            if (scope.path == path)
+            {
+                return &scope;
+            }
+        }
+        return NULL;
+    }
+
+    // time from the beginning of one frame to the beginning of the next
+    const RollingSamples &getFrameIntervalMilliseconds() const
+    {
+        return frameIntervalMilliseconds;
+    }
+
+    // the timings of the frames that the latest endFrame() or finish() collected, in the
+    // order of the frames and, within a frame, of the scopes
+    const std::vector<ProfileScopeTiming> &getResolvedTimings() const
+    {
+        return resolvedTimings;
+    }
+
+    // the number of frames ended so far, which is the number of the next frame
+    unsigned long getFrames() const
+    {
+        return frames;
+    }
+
+    unsigned long getDroppedFrames() const
+    {
+        return droppedFrames;
+    }
+
+    bool hasPipelineStatisticsSupport() const
+    {
+        return isPipelineStatisticsSupported;
+    }
+
+    // one line of rolling averages: the frame interval and its 99th percentile, then every
+    // scope down to maxDepth with its CPU time and, for GPU scopes, its GPU time
+    std::string describe(unsigned int maxDepth) const
+    {
+        char text[128];
+        TimingSummary frameSummary = frameIntervalMilliseconds.summary();
+        snprintf(text, sizeof(text), "%.2f ms (p99 %.2f)", frameSummary.mean, frameSummary.p99);
+        std::string description = text;
+        for (const ProfileScopeStatistics &scope : scopes)
+        {
+            if (scope.depth == 0 || scope.depth > maxDepth || scope.cpuMilliseconds.empty())
+            {
+                continue;
+            }
+            snprintf(text, sizeof(text), " | %s %.2f", scope.name.c_str(), scope.cpuMilliseconds.summary().mean);
+            description += text;
+            if (!scope.gpuMilliseconds.empty())
+            {
+                snprintf(text, sizeof(text), "/%.2f", scope.gpuMilliseconds.summary().mean);
+                description += text;
+            }
+        }
+        return description;
+    }
+
+    // the recorded events in the Chrome trace event format, viewable in chrome://tracing
+    // or Perfetto; CPU scopes are on thread 1 and GPU scopes on thread 2
+    bool writeChromeTrace(const std::string &path) const
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (file == NULL)
+        {
+            return false;
+        }
+        fprintf(file, "{\"traceEvents\": [\n");
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+        for (const TraceEvent &event : traceEvents)
+        {
+            fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %lu}}",
+                    scopes[event.scope].name.c_str(), event.onGpu ? "gpu" : "cpu", event.onGpu ? 2 : 1,
+                    event.beginMicroseconds, event.durationMicroseconds, event.frame);
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+};
+
+// Profiles the enclosing scope; does nothing without a profiler.
+class ProfileScope
+{
+private:
+    Profiler *profiler;
+
+public:
+    ProfileScope(Profiler *profiler, const char *name, unsigned int flags)
+        : profiler(profiler)
+    {
+        if (profiler != NULL)
+        {
+            profiler->beginScope(name, flags);
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (profiler != NULL)
+        {
+            profiler->endScope();
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "Benchmark.hpp"
+#include "GlResources.hpp"
+#include "Hash.hpp"
+
+struct ProgramCacheStatistics
+{
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    // binaries that were found but that the driver did not accept
+    unsigned int rejected = 0;
+    double milliseconds = 0;
+};
+
+// Keeps linked shader programs on disk as driver binaries. A program is found by a hash of
+// the driver and renderer strings and the exact sources given to the compiler, so the
+// defines injected into them are part of the key. A binary the driver rejects, for
+// example after a driver update, is compiled from source again and replaced.
+class ProgramCache
+{
+private:
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t binaryFormat;
+        uint64_t binaryLength;
+    };
+
+    std::string directory;
+    bool isEnabled;
+    std::string driver;
+    ProgramCacheStatistics statistics;
+
+    static std::string glString(GLenum name)
+    {
+        const char *value = (const char *)glGetString(name);
+        return value == NULL ? "" : value;
+    }
+
+    static bool isMagic(const FileHeader &header)
+    {
+        return header.magic[0] == 'P' && header.magic[1] == 'P' && header.magic[2] == 'S' && header.magic[3] == 'C';
+    }
+
+    std::string pathFor(const std::string &vertexSource, const std::string &fragmentSource) const
+    {
+        uint64_t hash = fnv1a64(driver);
+        hash = fnv1a64(std::string(1, '\0') + vertexSource, hash);
+        hash = fnv1a64(std::string(1, '\0') + fragmentSource, hash);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+        return directory + "/" + name;
+    }
+
+    static bool readBinary(const std::string &path, GLenum &binaryFormat, std::vector<char> &binary)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == NULL)
+        {
+            return false;
+        }
+        FileHeader header;
+        bool isValid = fread(&header, sizeof(header), 1, file) == 1 && isMagic(header) && header.binaryLength < (1u << 30);
+        if (isValid)
+        {
+            binaryFormat = header.binaryFormat;
+            binary.resize(header.binaryLength);
+            isValid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+        return isValid;
+    }
+
+    // through a temporary file, so that a concurrent reader never sees half a binary
+    static void writeBinary(const std::string &path, GLenum binaryFormat, const std::vector<char> &binary)
+    {
+        const std::string temporaryPath = path + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if (file == NULL)
+        {
+            return;
+        }
+        FileHeader header{.magic = {'P', 'P', 'S', 'C'}, .binaryFormat = binaryFormat, .binaryLength = binary.size()};
+        bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+        isWritten = fclose(file) == 0 && isWritten;
+        std::error_code error;
+        if (isWritten)
+        {
+            std::filesystem::rename(temporaryPath, path, error);
+        }
+        else
+        {
+            std::filesystem::remove(temporaryPath, error);
+        }
+    }
+
+public:
+    // an empty directory disables the cache
+    explicit ProgramCache(const std::string &directory) : directory(directory)
+    {
+        GLint numberOfBinaryFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numberOfBinaryFormats);
+        isEnabled = !directory.empty() && numberOfBinaryFormats > 0 && glProgramBinary != NULL && glGetProgramBinary != NULL;
+        driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+
+        std::error_code error;
+        if (isEnabled && !std::filesystem::create_directories(directory, error) && error)
+        {
+            fprintf(stderr, "Failed to create the program cache %s, compiling all shaders\n", directory.c_str());
+            isEnabled = false;
+        }
+    }
+
+    // the defines and the prelude are injected into both shaders, so each set of them is a
+    // variant of its own
+    GlShaderProgram load(const std::string &vertexPath, const std::string &fragmentPath, const ShaderDefines &defines = {}, const std::string &prelude = "")
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const std::string vertexSource = injectShaderDefines(readShaderSource(vertexPath), defines, prelude);
+        const std::string fragmentSource = injectShaderDefines(readShaderSource(fragmentPath), defines, prelude);
+        const std::string path = isEnabled ? pathFor(vertexSource, fragmentSource) : "";
+
+        GLenum binaryFormat;
+        std::vector<char> binary;
+        if (isEnabled && readBinary(path, binaryFormat, binary))
+        {
+            GlShaderProgram program(binaryFormat, binary);
+            if (program.isLinked())
+            {
+                statistics.hits++;
+                statistics.milliseconds += millisecondsSince(start);
+                return program;
+            }
+            statistics.rejected++;
+        }
+
+        GlShaderProgram program = createVertexFragmentShaderProgram(
+            compileShader(GL_VERTEX_SHADER, vertexSource),
+            compileShader(GL_FRAGMENT_SHADER, fragmentSource));
+        statistics.misses++;
+        if (isEnabled && program.isLinked())
+        {
+            binary = program.binary(binaryFormat);
+            if (!binary.empty())
+            {
+                writeBinary(path, binaryFormat, binary);
+            }
+        }
+        statistics.milliseconds += millisecondsSince(start);
+        return program;
+    }
+
+    const ProgramCacheStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+};
@@ -0,0 +1,550 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Culling.hpp"
+#include "GlResources.hpp"
+
+struct CubeFace
+{
+    glm::vec3 normal;
+    glm::vec3 axisU;
+    glm::vec3 axisV;
+};
+
+// axisU x axisV = normal, so patch triangles wind counter-clockwise seen from outside
+const CubeFace CUBE_FACES[6] = {
+    {glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)},
+    {glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0)},
+    {glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1)},
+    {glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+    {glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+    {glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0)},
+};
+
+enum TerrainPatchEdge
+{
+    PATCH_EDGE_S0 = 0,
+    PATCH_EDGE_S1 = 1,
+    PATCH_EDGE_T0 = 2,
+    PATCH_EDGE_T1 = 3,
+};
+
+// A node of the quadtree over one cube face. Face coordinates (s, t) in [0, 1]^2 map to
+// the cube point normal + (2s - 1) axisU + (2t - 1) axisV; a patch at level L covers
+// s in [x, x + 1] / 2^L and t in [y, y + 1] / 2^L.
+struct TerrainPatch
+{
+    unsigned int face;
+    unsigned int level;
+    unsigned int x;
+    unsigned int y;
+
+    // cube point at (s, t) = (0, 0) of the patch and the cube vectors spanned by the patch
+    // along s and t; all of them are dyadic, so neighbouring patches compute bit-identical
+    // positions for shared vertices
+    glm::vec3 origin;
+    glm::vec3 axisU;
+    glm::vec3 axisV;
+
+    // log2 of the vertex step along each TerrainPatchEdge that matches a coarser neighbour
+    unsigned int stitchShifts[4];
+};
+
+struct QuadtreeTerrainView
+{
+    // in model space
+    glm::vec3 cameraPosition;
+    Frustum frustum;
+
+    // viewport height in pixels divided by 2 tan(fieldOfView / 2)
+    float projectionScale;
+
+    // the terrain lies between these radii; minRadius also serves as the horizon occluder
+    float baseRadius;
+    float minRadius;
+    float maxRadius;
+};
+
+struct QuadtreeTerrainStatistics
+{
+    unsigned int visitedPatches = 0;
+    unsigned int horizonCulledPatches = 0;
+    unsigned int frustumCulledPatches = 0;
+    unsigned int drawnPatches = 0;
+    unsigned int drawnTriangles = 0;
+    // drawn patches split to keep their drawn neighbours within a level of each other
+    unsigned int balancingSplits = 0;
+};
+
+// Chunked level of detail for the planet surface. Every patch is drawn from the same grid
+// of (patchResolution + 1)^2 patch coordinates, placed on the cube by per-patch uniforms
+// (see TerrainPatch.vertex.glsl). Patches are refined while their projected vertex
+// spacing exceeds maxScreenSpaceError pixels and the patch budget allows, and skipped if
+// they are beyond the horizon or outside the view frustum. The drawn patches are then
+// balanced into a restricted quadtree: a drawn patch that borders a drawn patch two or more
+// levels finer is split, so that drawn neighbours differ by at most one level. Where a
+// patch borders a coarser one, the edge vertices between the neighbour's vertices are
+// snapped onto the previous shared vertex, which leaves only degenerate triangles there and
+// closes the crack, as every other vertex of the edge is one of the neighbour's. Culled
+// neighbours are not drawn, so they leave no crack whatever their level.
+class QuadtreeTerrain
+{
+private:
+    unsigned int patchResolution;
+    unsigned int patchResolutionShift;
+    unsigned int maxLevel;
+    float maxScreenSpaceError;
+    size_t maxPatches;
+
+    GlVertexArrayObject vertexArray;
+    GlVertexBuffer vertexBuffer;
+    std::unordered_map<unsigned int, GlElementBuffer> stitchedIndices;
+    std::unordered_map<unsigned int, unsigned int> stitchedIndexCounts;
+
+    std::vector<TerrainPatch> patches;
+    // every patch without children, drawn or culled, for the neighbour lookups
+    std::unordered_set<uint64_t> leaves;
+    // the leaves that are drawn
+    std::unordered_set<uint64_t> drawnLeaves;
+    QuadtreeTerrainStatistics statistics;
+
+    static uint64_t patchKey(unsigned int face, unsigned int level, unsigned int x, unsigned int y)
+    {
+        return (uint64_t(face) << 61) | (uint64_t(level) << 56) | (uint64_t(x) << 28) | uint64_t(y);
+    }
+
+    static unsigned int stitchKey(const unsigned int stitchShifts[4])
+    {
+        return stitchShifts[0] | (stitchShifts[1] << 8) | (stitchShifts[2] << 16) | (stitchShifts[3] << 24);
+    }
+
+    static std::vector<glm::vec2> patchCoordinates(unsigned int resolution)
+    {
+        std::vector<glm::vec2> coordinates;
+        coordinates.reserve((resolution + 1) * (resolution + 1));
+        for (unsigned int j = 0; j <= resolution; j++)
+        {
+            for (unsigned int i = 0; i <= resolution; i++)
+            {
+                coordinates.push_back(glm::vec2(float(i) / resolution, float(j) / resolution));
+            }
+        }
+        return coordinates;
+    }
+
+    static glm::vec3 cubePoint(unsigned int face, float s, float t)
+    {
+        const CubeFace &cubeFace = CUBE_FACES[face];
+        return cubeFace.normal + (2 * s - 1) * cubeFace.axisU + (2 * t - 1) * cubeFace.axisV;
+    }
+
+    // 16-bit, as the grid of a patch has fewer than 65536 vertices
+    std::vector<uint16_t> stitchedPatchIndices(const unsigned int stitchShifts[4]) const
+    {
+        const unsigned int resolution = patchResolution;
+        auto vertexIndex = [&](unsigned int i, unsigned int j)
+        {
+            unsigned int snappedI = i;
+            unsigned int snappedJ = j;
+            if (i == 0)
+            {
+                snappedJ = (j >> stitchShifts[PATCH_EDGE_S0]) << stitchShifts[PATCH_EDGE_S0];
+            }
+            else if (i == resolution)
+            {
+                snappedJ = (j >> stitchShifts[PATCH_EDGE_S1]) << stitchShifts[PATCH_EDGE_S1];
+            }
+            if (j == 0)
+            {
+                snappedI = (i >> stitchShifts[PATCH_EDGE_T0]) << stitchShifts[PATCH_EDGE_T0];
+            }
+            else if (j == resolution)
+            {
+                snappedI = (i >> stitchShifts[PATCH_EDGE_T1]) << stitchShifts[PATCH_EDGE_T1];
+            }
+            return snappedJ * (resolution + 1) + snappedI;
+        };
+        auto addTriangle = [](std::vector<uint16_t> &indices, unsigned int a, unsigned int b, unsigned int c)
+        {
+            if (a != b && b != c && c != a)
+            {
+                indices.push_back(a);
+                indices.push_back(b);
+                indices.push_back(c);
+            }
+        };
+
+        // The quads go row by row through stripes of columns narrow enough that two rows of
+        // vertices stay in a 16 entry vertex cache, instead of through whole rows of the patch
+        // whose vertices are evicted before the next row uses them again.
+        const unsigned int stripeWidth = 6;
+        std::vector<uint16_t> indices;
+        indices.reserve(6 * resolution * resolution);
+        for (unsigned int stripe = 0; stripe < resolution; stripe += stripeWidth)
+        {
+            for (unsigned int j = 0; j < resolution; j++)
+            {
+                for (unsigned int i = stripe; i < std::min(stripe + stripeWidth, resolution); i++)
+                {
+                    const unsigned int a = vertexIndex(i, j);
+                    const unsigned int b = vertexIndex(i + 1, j);
+                    const unsigned int c = vertexIndex(i + 1, j + 1);
+                    const unsigned int d = vertexIndex(i, j + 1);
+                    addTriangle(indices, a, b, c);
+                    addTriangle(indices, a, c, d);
+                }
+            }
+        }
+        return indices;
+    }
+
+    struct PatchLocation
+    {
+        unsigned int face;
+        unsigned int level;
+        unsigned int x;
+        unsigned int y;
+    };
+
+    // the leaf containing the face coordinates, which may lie slightly outside [0, 1]^2, in
+    // which case they are carried over to the adjacent face
+    PatchLocation leafAt(unsigned int face, float s, float t) const
+    {
+        if (s < 0 || s > 1 || t < 0 || t > 1)
+        {
+            const glm::vec3 point = cubePoint(face, s, t);
+            const glm::vec3 magnitude = glm::abs(point);
+            unsigned int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : (magnitude.y >= magnitude.z ? 1 : 2);
+            face = 2 * axis + (point[axis] < 0 ? 1 : 0);
+            const glm::vec3 projected = point / magnitude[axis];
+            s = glm::clamp((glm::dot(projected, CUBE_FACES[face].axisU) + 1) / 2, 0.0f, 1.0f);
+            t = glm::clamp((glm::dot(projected, CUBE_FACES[face].axisV) + 1) / 2, 0.0f, 1.0f);
+        }
+
+        const unsigned int finestCount = 1u << maxLevel;
+        const unsigned int finestX = std::min(finestCount - 1, (unsigned int)(s * finestCount));
+        const unsigned int finestY = std::min(finestCount - 1, (unsigned int)(t * finestCount));
+        for (unsigned int level = 0; level < maxLevel; level++)
+        {
+            if (leaves.count(patchKey(face, level, finestX >> (maxLevel - level), finestY >> (maxLevel - level))))
+            {
+                return PatchLocation{.face = face, .level = level, .x = finestX >> (maxLevel - level), .y = finestY >> (maxLevel - level)};
+            }
+        }
+        return PatchLocation{.face = face, .level = maxLevel, .x = finestX, .y = finestY};
+    }
+
+    // the leaves just outside of the middle of each TerrainPatchEdge of the patch
+    std::array<PatchLocation, 4> edgeNeighbours(unsigned int face, unsigned int level, unsigned int x, unsigned int y) const
+    {
+        const float size = 1.0f / (1u << level);
+        const float outside = 0.25f / (1u << maxLevel);
+        const float s0 = x * size;
+        const float t0 = y * size;
+        return {
+            leafAt(face, s0 - outside, t0 + size / 2),
+            leafAt(face, s0 + size + outside, t0 + size / 2),
+            leafAt(face, s0 + size / 2, t0 - outside),
+            leafAt(face, s0 + size / 2, t0 + size + outside),
+        };
+    }
+
+    struct PatchCandidate
+    {
+        float screenSpaceError;
+        unsigned int face;
+        unsigned int level;
+        unsigned int x;
+        unsigned int y;
+
+        bool operator<(const PatchCandidate &other) const
+        {
+            return screenSpaceError < other.screenSpaceError;
+        }
+    };
+
+    // queues the patch unless it is culled, which makes it a leaf right away
+    void considerPatch(const QuadtreeTerrainView &view, std::priority_queue<PatchCandidate> &candidates,
+                       unsigned int face, unsigned int level, unsigned int x, unsigned int y)
+    {
+        statistics.visitedPatches++;
+
+        const float size = 1.0f / (1u << level);
+        const glm::vec3 corners[4] = {
+            glm::normalize(cubePoint(face, x * size, y * size)),
+            glm::normalize(cubePoint(face, (x + 1) * size, y * size)),
+            glm::normalize(cubePoint(face, x * size, (y + 1) * size)),
+            glm::normalize(cubePoint(face, (x + 1) * size, (y + 1) * size)),
+        };
+        const glm::vec3 direction = glm::normalize(cubePoint(face, (x + 0.5f) * size, (y + 0.5f) * size));
+        float minCosine = 1;
+        for (const glm::vec3 &corner : corners)
+        {
+            minCosine = std::min(minCosine, glm::dot(direction, corner));
+        }
+        const float angularRadius = std::acos(glm::clamp(minCosine, -1.0f, 1.0f));
+
+        if (isBeyondHorizon(view.cameraPosition, view.minRadius, direction, angularRadius, view.maxRadius))
+        {
+            statistics.horizonCulledPatches++;
+            leaves.insert(patchKey(face, level, x, y));
+            return;
+        }
+
+        const glm::vec3 center = direction * view.maxRadius;
+        const float radius = shellBoundingRadius(view.minRadius, view.maxRadius, minCosine);
+        if (!view.frustum.intersectsSphere(center, radius))
+        {
+            statistics.frustumCulledPatches++;
+            leaves.insert(patchKey(face, level, x, y));
+            return;
+        }
+
+        const float vertexSpacing = 2 * angularRadius * view.baseRadius / patchResolution;
+        // no terrain point is closer than the bounding sphere or the camera altitude above maxRadius
+        const float distance = std::max({glm::length(view.cameraPosition - center) - radius, glm::length(view.cameraPosition) - view.maxRadius, 1e-3f});
+        candidates.push(PatchCandidate{
+            .screenSpaceError = vertexSpacing * view.projectionScale / distance,
+            .face = face,
+            .level = level,
+            .x = x,
+            .y = y,
+        });
+    }
+
+    void selectLeaf(const PatchCandidate &candidate, std::vector<PatchCandidate> &selected)
+    {
+        const uint64_t key = patchKey(candidate.face, candidate.level, candidate.x, candidate.y);
+        leaves.insert(key);
+        drawnLeaves.insert(key);
+        selected.push_back(candidate);
+    }
+
+    // Splits drawn leaves that border a drawn leaf two or more levels finer, which a patch
+    // budget running out or a steep change of the screen space error can leave, until no
+    // such pair is left. A coarser neighbour covers the whole edge of a leaf, so the leaves
+    // at the middles of the edges are all the neighbours that can be too coarse; splitting
+    // only creates finer leaves, so only the new ones need to be checked again.
+    void balance(const QuadtreeTerrainView &view, std::vector<PatchCandidate> &selected)
+    {
+        std::vector<PatchCandidate> unchecked = selected;
+        while (!unchecked.empty())
+        {
+            const PatchCandidate leaf = unchecked.back();
+            unchecked.pop_back();
+            if (!drawnLeaves.count(patchKey(leaf.face, leaf.level, leaf.x, leaf.y)))
+            {
+                continue;
+            }
+            for (const PatchLocation &neighbour : edgeNeighbours(leaf.face, leaf.level, leaf.x, leaf.y))
+            {
+                const uint64_t neighbourKey = patchKey(neighbour.face, neighbour.level, neighbour.x, neighbour.y);
+                if (neighbour.level + 1 >= leaf.level || !drawnLeaves.count(neighbourKey))
+                {
+                    continue;
+                }
+                leaves.erase(neighbourKey);
+                drawnLeaves.erase(neighbourKey);
+                statistics.balancingSplits++;
+                std::priority_queue<PatchCandidate> children;
+                for (unsigned int child = 0; child < 4; child++)
+                {
+                    considerPatch(view, children, neighbour.face, neighbour.level + 1,
+                                  2 * neighbour.x + (child & 1), 2 * neighbour.y + (child >> 1));
+                }
+                for (; !children.empty(); children.pop())
+                {
+                    selectLeaf(children.top(), selected);
+                    unchecked.push_back(children.top());
+                }
+                // the children next to the leaf may still be too coarse for it
+                unchecked.push_back(leaf);
+                break;
+            }
+        }
+    }
+
+    void addPatch(const PatchCandidate &candidate)
+    {
+        const float size = 1.0f / (1u << candidate.level);
+        const CubeFace &cubeFace = CUBE_FACES[candidate.face];
+        patches.push_back(TerrainPatch{
+            .face = candidate.face,
+            .level = candidate.level,
+            .x = candidate.x,
+            .y = candidate.y,
+            .origin = cubePoint(candidate.face, candidate.x * size, candidate.y * size),
+            .axisU = cubeFace.axisU * (2 * size),
+            .axisV = cubeFace.axisV * (2 * size),
+            .stitchShifts = {0, 0, 0, 0},
+        });
+    }
+
+    // drawn neighbours are at most one level coarser after balance(); culled ones may be
+    // coarser still, whose shifts are capped at snapping the edge to its end points
+    void stitchPatch(TerrainPatch &patch)
+    {
+        const std::array<PatchLocation, 4> neighbours = edgeNeighbours(patch.face, patch.level, patch.x, patch.y);
+        for (unsigned int edge = 0; edge < 4; edge++)
+        {
+            const unsigned int neighbourLevel = neighbours[edge].level;
+            patch.stitchShifts[edge] = neighbourLevel < patch.level ? std::min(patch.level - neighbourLevel, patchResolutionShift) : 0;
+        }
+
+        const unsigned int key = stitchKey(patch.stitchShifts);
+        if (!stitchedIndices.count(key))
+        {
+            std::vector<uint16_t> indices = stitchedPatchIndices(patch.stitchShifts);
+            glBindVertexArray(vertexArray.id());
+            stitchedIndices.emplace(key, GlElementBuffer(indices));
+            stitchedIndexCounts[key] = indices.size();
+            glBindVertexArray(0);
+        }
+    }
+
+    // Refines the faces by the screen space error into at most budget drawn leaves and then
+    // balances them, and returns the drawn leaves in the order that they were chosen, those
+    // that balance() split included.
+    std::vector<PatchCandidate> refine(const QuadtreeTerrainView &view, size_t budget)
+    {
+        leaves.clear();
+        drawnLeaves.clear();
+        statistics = QuadtreeTerrainStatistics();
+
+        // split the patch with the largest error first, so that running out of patches
+        // leaves the error evenly distributed
+        std::priority_queue<PatchCandidate> candidates;
+        std::vector<PatchCandidate> selected;
+        for (unsigned int face = 0; face < 6; face++)
+        {
+            considerPatch(view, candidates, face, 0, 0, 0);
+        }
+        while (!candidates.empty())
+        {
+            const PatchCandidate candidate = candidates.top();
+            candidates.pop();
+            if (candidate.level < maxLevel && candidate.screenSpaceError > maxScreenSpaceError &&
+                selected.size() + candidates.size() + 4 <= budget)
+            {
+                for (unsigned int child = 0; child < 4; child++)
+                {
+                    considerPatch(view, candidates, candidate.face, candidate.level + 1,
+                                  2 * candidate.x + (child & 1), 2 * candidate.y + (child >> 1));
+                }
+            }
+            else
+            {
+                selectLeaf(candidate, selected);
+            }
+        }
+        balance(view, selected);
+        return selected;
+    }
+
+public:
+    // patchResolution is the number of quads along a patch edge and must be a power of two
+    // of at most 128, which keeps patch indices within 16 bits; at most maxPatches patches are drawn, which bounds the triangle count
+    QuadtreeTerrain(unsigned int patchResolution = 32, unsigned int maxLevel = 12, float maxScreenSpaceError = 12, size_t maxPatches = 256)
+        : patchResolution(std::min(patchResolution, 128u)),
+          patchResolutionShift(std::countr_zero(this->patchResolution)),
+          maxLevel(std::min(maxLevel, 20u)),
+          maxScreenSpaceError(maxScreenSpaceError),
+          maxPatches(maxPatches),
+          vertexBuffer(patchCoordinates(this->patchResolution))
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (const void *)0);
+        glBindVertexArray(0);
+    }
+
+    QuadtreeTerrain(const QuadtreeTerrain &) = delete;
+    QuadtreeTerrain &operator=(const QuadtreeTerrain &) = delete;
+
+    QuadtreeTerrain(QuadtreeTerrain &&) = default;
+    QuadtreeTerrain &operator=(QuadtreeTerrain &&) = default;
+
+    // takes effect with the next select()
+    void setRefinementLimits(float newMaxScreenSpaceError, size_t newMaxPatches)
+    {
+        maxScreenSpaceError = newMaxScreenSpaceError;
+        maxPatches = newMaxPatches;
+    }
+
+    // Chooses the patches to draw for the view and creates the index buffers they need.
+    void select(const QuadtreeTerrainView &view)
+    {
+        patches.clear();
+
+        // the splits of balance() come on top of the budget of the refinement; where they
+        // exceed maxPatches, the refinement is repeated with a budget lowered by the excess
+        size_t budget = maxPatches;
+        std::vector<PatchCandidate> selected = refine(view, budget);
+        while (drawnLeaves.size() > maxPatches && budget > 0)
+        {
+            budget -= std::min(budget, drawnLeaves.size() - maxPatches);
+            selected = refine(view, budget);
+        }
+        for (const PatchCandidate &candidate : selected)
+        {
+            if (drawnLeaves.count(patchKey(candidate.face, candidate.level, candidate.x, candidate.y)))
+            {
+                addPatch(candidate);
+            }
+        }
+        for (TerrainPatch &patch : patches)
+        {
+            stitchPatch(patch);
+            statistics.drawnPatches++;
+            statistics.drawnTriangles += stitchedIndexCounts[stitchKey(patch.stitchShifts)] / 3;
+        }
+    }
+
+    const std::vector<TerrainPatch> &getPatches() const
+    {
+        return patches;
+    }
+
+    // each patch has (patchResolution + 1)^2 vertices
+    unsigned int getPatchResolution() const
+    {
+        return patchResolution;
+    }
+
+    // the least spacing of the vertices of the finest patches on a sphere of the radius: a
+    // step along a cube face shrinks to sqrt(2) / 3 of it at the corners of the cube
+    float finestVertexSpacing(float radius) const
+    {
+        return radius * std::sqrt(2.0f) / 3 * 2 / (float(1u << maxLevel) * patchResolution);
+    }
+
+    const QuadtreeTerrainStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+
+    const GlVertexArrayObject &getVertexArray() const
+    {
+        return vertexArray;
+    }
+
+    // 16-bit indices, only valid for patches returned by the latest select()
+    const GlElementBuffer &getElementBuffer(const TerrainPatch &patch) const
+    {
+        return stitchedIndices.at(stitchKey(patch.stitchShifts));
+    }
+
+    unsigned int getNumberOfElements(const TerrainPatch &patch) const
+    {
+        return stitchedIndexCounts.at(stitchKey(patch.stitchShifts));
+    }
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Profiler.hpp"
+
+// The settings that trade image quality for frame time, in tiers from the highest quality
+// to the lowest. Each tier refines the terrain and the bodies less, takes fewer samples
+// along the view rays through the atmospheres and shades the planet atmosphere at a lower
+// resolution than the one before it.
+struct QualityTier
+{
+    const char *name;
+    // see QuadtreeTerrain
+    float maxScreenSpaceError;
+    unsigned int maxPatches;
+    // see StarSystem
+    float maxBodyEdgePixels;
+    // of the atmosphere shaders that read the optical depths from AtmosphereTables
+    unsigned int inScatterSamples;
+    // of AtmosphericScattering.fragment.glsl, both along the view ray and towards the light
+    unsigned int marchedScatterSamples;
+    unsigned int atmosphereResolutionDivisor;
+};
+
+const QualityTier QUALITY_TIERS[] = {
+    {
+        .name = "ultra",
+        .maxScreenSpaceError = 8,
+        .maxPatches = 384,
+        .maxBodyEdgePixels = 6,
+        .inScatterSamples = 12,
+        .marchedScatterSamples = 4,
+        .atmosphereResolutionDivisor = 1,
+    },
+    {
+        .name = "high",
+        .maxScreenSpaceError = 12,
+        .maxPatches = 256,
+        .maxBodyEdgePixels = 8,
+        .inScatterSamples = 8,
+        .marchedScatterSamples = 3,
+        .atmosphereResolutionDivisor = 1,
+    },
+    {
+        .name = "medium",
+        .maxScreenSpaceError = 16,
+        .maxPatches = 192,
+        .maxBodyEdgePixels = 12,
+        .inScatterSamples = 6,
+        .marchedScatterSamples = 3,
+        .atmosphereResolutionDivisor = 2,
+    },
+    {
+        .name = "low",
+        .maxScreenSpaceError = 24,
+        .maxPatches = 128,
+        .maxBodyEdgePixels = 16,
+        .inScatterSamples = 4,
+        .marchedScatterSamples = 2,
+        .atmosphereResolutionDivisor = 2,
+    },
+    {
+        .name = "minimum",
+        .maxScreenSpaceError = 32,
+        .maxPatches = 64,
+        .maxBodyEdgePixels = 24,
+        .inScatterSamples = 3,
+        .marchedScatterSamples = 2,
+        .atmosphereResolutionDivisor = 4,
+    },
+};
+
+const unsigned int NUMBER_OF_QUALITY_TIERS = sizeof(QUALITY_TIERS) / sizeof(QUALITY_TIERS[0]);
+// the settings the scene had before there were tiers
+const unsigned int DEFAULT_QUALITY_TIER = 1;
+
+// returns NUMBER_OF_QUALITY_TIERS for an unknown name
+inline unsigned int findQualityTier(const std::string &name)
+{
+    for (unsigned int tier = 0; tier < NUMBER_OF_QUALITY_TIERS; tier++)
+    {
+        if (name == QUALITY_TIERS[tier].name)
+        {
+            return tier;
+        }
+    }
+    return NUMBER_OF_QUALITY_TIERS;
+}
+
+struct QualityDecision
+{
+    // the first frame rendered at the new tier
+    unsigned long frame;
+    unsigned int fromTier;
+    unsigned int toTier;
+    // the means over the frames that the decision was based on
+    double cpuMilliseconds;
+    double gpuMilliseconds;
+};
+
+// Moves between the quality tiers to keep the frame time within a budget. A frame costs
+// its CPU time or its GPU time, whichever is longer, as the two overlap. Once a window of
+// frames at the current tier was measured, the governor goes down a tier when their mean
+// cost exceeds the budget and up a tier when it is below UPGRADE_FRACTION of it, so that
+// the tier above, which costs more, has room to fit. A tier that was left for exceeding
+// the budget is only tried again after a back-off, which doubles each time, so that the
+// governor does not keep oscillating between a tier that fits and one that does not. With
+// a budget of 0 it only measures.
+class QualityGovernor
+{
+private:
+    static const unsigned int WINDOW_FRAMES = 30;
+    static constexpr double UPGRADE_FRACTION = 0.6;
+    static const unsigned long MAX_BACKOFF_FRAMES = 64 * WINDOW_FRAMES;
+
+    double budgetMilliseconds;
+    unsigned int tier;
+    // the frames before it were rendered at an earlier tier
+    unsigned long firstFrameOfTier = 0;
+    RollingSamples cpuMilliseconds;
+    RollingSamples gpuMilliseconds;
+    unsigned long retryFrame[NUMBER_OF_QUALITY_TIERS] = {};
+    unsigned long backoffFrames[NUMBER_OF_QUALITY_TIERS];
+    unsigned long tierFrames[NUMBER_OF_QUALITY_TIERS] = {};
+    std::vector<QualityDecision> decisions;
+
+    void changeTier(unsigned int newTier, unsigned long nextFrame, double cpuMean, double gpuMean)
+    {
+        decisions.push_back(QualityDecision{
+            .frame = nextFrame,
+            .fromTier = tier,
+            .toTier = newTier,
+            .cpuMilliseconds = cpuMean,
+            .gpuMilliseconds = gpuMean,
+        });
+        tier = newTier;
+        firstFrameOfTier = nextFrame;
+        cpuMilliseconds = RollingSamples(WINDOW_FRAMES);
+        gpuMilliseconds = RollingSamples(WINDOW_FRAMES);
+    }
+
+public:
+    explicit QualityGovernor(double budgetMilliseconds, unsigned int tier = DEFAULT_QUALITY_TIER)
+        : budgetMilliseconds(budgetMilliseconds), tier(std::min(tier, NUMBER_OF_QUALITY_TIERS - 1)),
+          cpuMilliseconds(WINDOW_FRAMES), gpuMilliseconds(WINDOW_FRAMES)
+    {
+        std::fill(backoffFrames, backoffFrames + NUMBER_OF_QUALITY_TIERS, (unsigned long)WINDOW_FRAMES);
+    }
+
+    // a measured frame, in the order of the frames; those rendered at an earlier tier
+    // are ignored, as their results arrive a few frames late
+    void addFrame(unsigned long frame, double cpu, double gpu)
+    {
+        if (frame < firstFrameOfTier)
+        {
+            return;
+        }
+        cpuMilliseconds.add(cpu);
+        gpuMilliseconds.add(gpu);
+        tierFrames[tier]++;
+    }
+
+    // after adding the frames measured so far; returns whether the tier changed, which
+    // applies from nextFrame on
+    bool decide(unsigned long nextFrame)
+    {
+        if (budgetMilliseconds <= 0 || cpuMilliseconds.samples().size() < WINDOW_FRAMES)
+        {
+            return false;
+        }
+        const double cpuMean = cpuMilliseconds.summary().mean;
+        const double gpuMean = gpuMilliseconds.summary().mean;
+        const double cost = std::max(cpuMean, gpuMean);
+        if (cost > budgetMilliseconds && tier + 1 < NUMBER_OF_QUALITY_TIERS)
+        {
+            retryFrame[tier] = nextFrame + backoffFrames[tier];
+            backoffFrames[tier] = std::min(2 * backoffFrames[tier], MAX_BACKOFF_FRAMES);
+            changeTier(tier + 1, nextFrame, cpuMean, gpuMean);
+            return true;
+        }
+        if (cost < UPGRADE_FRACTION * budgetMilliseconds && tier > 0 && nextFrame >= retryFrame[tier - 1])
+        {
+            changeTier(tier - 1, nextFrame, cpuMean, gpuMean);
+            return true;
+        }
+        return false;
+    }
+
+    bool isGoverning() const
+    {
+        return budgetMilliseconds > 0;
+    }
+
+    double getBudgetMilliseconds() const
+    {
+        return budgetMilliseconds;
+    }
+
+    unsigned int getTier() const
+    {
+        return tier;
+    }
+
+    const QualityTier &getQualityTier() const
+    {
+        return QUALITY_TIERS[tier];
+    }
+
+    const std::vector<QualityDecision> &getDecisions() const
+    {
+        return decisions;
+    }
+
+    // the measured frames rendered at the given tier
+    unsigned long getTierFrames(unsigned int tierIndex) const
+    {
+        return tierFrames[tierIndex];
+    }
+};
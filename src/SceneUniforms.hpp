@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "GlResources.hpp"
+#include "GlStreamBuffer.hpp"
+
+// The std140 uniform blocks of the shaders, declared here next to their mirrors and
+// injected into the shaders as a prelude by the program loads. A vec3 takes 16 bytes
+// unless a float follows it, which then fills the last 4 bytes.
+
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+const GLuint OBJECT_UNIFORMS_BINDING = 1;
+
+struct FrameUniforms
+{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::mat4 viewProjectionMatrix;
+    glm::vec3 cameraPositionInWorldSpace;
+    float lightPower;
+    glm::vec3 lightDirectionInWorldSpace;
+    // see Camera::projectionScale()
+    float projectionScale;
+    glm::vec3 lightColor;
+    float padding1;
+    glm::mat4 inverseViewProjectionMatrix;
+};
+
+static_assert(offsetof(FrameUniforms, cameraPositionInWorldSpace) == 192);
+static_assert(offsetof(FrameUniforms, lightDirectionInWorldSpace) == 208);
+static_assert(offsetof(FrameUniforms, projectionScale) == 220);
+static_assert(offsetof(FrameUniforms, lightColor) == 224);
+static_assert(offsetof(FrameUniforms, inverseViewProjectionMatrix) == 240);
+static_assert(sizeof(FrameUniforms) == 304);
+
+const char *const FRAME_UNIFORMS_GLSL = R"(layout(std140) uniform FrameUniforms {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 viewProjectionMatrix;
+    vec3 cameraPositionInWorldSpace;
+    float lightPower;
+    vec3 lightDirectionInWorldSpace;
+    float projectionScale;
+    vec3 lightColor;
+    mat4 inverseViewProjectionMatrix;
+};
+)";
+
+struct ObjectUniforms
+{
+    glm::mat4 modelMatrix;
+    glm::mat4 modelViewProjectionMatrix;
+    glm::vec3 noiseOffset;
+    float baseRadius;
+    float maxNegativeHeight;
+    float maxPositiveHeight;
+    float atmosphereRadius;
+    GLint isHeightfieldSampled;
+};
+
+static_assert(offsetof(ObjectUniforms, noiseOffset) == 128);
+static_assert(offsetof(ObjectUniforms, baseRadius) == 140);
+static_assert(offsetof(ObjectUniforms, atmosphereRadius) == 152);
+static_assert(offsetof(ObjectUniforms, isHeightfieldSampled) == 156);
+static_assert(sizeof(ObjectUniforms) == 160);
+
+const char *const OBJECT_UNIFORMS_GLSL = R"(layout(std140) uniform ObjectUniforms {
+    mat4 modelMatrix;
+    mat4 modelViewProjectionMatrix;
+    vec3 noiseOffset;
+    float baseRadius;
+    float maxNegativeHeight;
+    float maxPositiveHeight;
+    float atmosphereRadius;
+    bool isHeightfieldSampled;
+};
+)";
+
+// the prelude of the programs that draw the planet and its atmosphere
+std::string sceneUniformsPrelude()
+{
+    return std::string(FRAME_UNIFORMS_GLSL) + OBJECT_UNIFORMS_GLSL;
+}
+
+// the prelude of the body programs, whose instances bring their own values under the names
+// of the object block
+std::string frameUniformsPrelude()
+{
+    return FRAME_UNIFORMS_GLSL;
+}
+
+void bindSceneUniformBlocks(const GlShaderProgram &program)
+{
+    program.bindUniformBlock("FrameUniforms", FRAME_UNIFORMS_BINDING);
+    program.bindUniformBlock("ObjectUniforms", OBJECT_UNIFORMS_BINDING);
+}
+
+// One FrameUniforms block and a number of ObjectUniforms blocks, each uploaded once per
+// frame into stream buffers. The object blocks share one buffer, spaced by the uniform
+// buffer offset alignment, and a draw selects its block with bindObject().
+class SceneUniformBuffers
+{
+private:
+    size_t alignment;
+    size_t objectStride;
+    GlStreamBuffer frameBuffer;
+    GlStreamBuffer objectBuffer;
+    std::vector<unsigned char> objectData;
+    // of the last upload
+    size_t objectOffset = 0;
+
+    static size_t offsetAlignment()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        return alignment;
+    }
+
+public:
+    SceneUniformBuffers(GlBufferPool &bufferPool, unsigned int numberOfObjects)
+        : alignment(offsetAlignment()),
+          objectStride((sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment),
+          frameBuffer(bufferPool, sizeof(FrameUniforms), alignment),
+          objectBuffer(bufferPool, objectStride * numberOfObjects, alignment),
+          objectData(objectStride * numberOfObjects)
+    {
+    }
+
+    void setObject(unsigned int object, const ObjectUniforms &uniforms)
+    {
+        memcpy(&objectData[object * objectStride], &uniforms, sizeof(ObjectUniforms));
+    }
+
+    // uploads the frame block and every object block set since the last upload
+    void upload(const FrameUniforms &frameUniforms)
+    {
+        const size_t frameOffset = frameBuffer.write(&frameUniforms, sizeof(FrameUniforms));
+        objectOffset = objectBuffer.write(objectData.data(), objectData.size());
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameBuffer.id(), frameOffset, sizeof(FrameUniforms));
+    }
+
+    void bindObject(unsigned int object) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UNIFORMS_BINDING, objectBuffer.id(), objectOffset + object * objectStride, sizeof(ObjectUniforms));
+    }
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+template <typename T>
+class SpscQueue
+{
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1)
+    {
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // producer only; returns false if the queue is full
+    bool tryPush(T &&value)
+    {
+        const size_t currentTail = tail.load(std::memory_order_relaxed);
+        const size_t nextTail = (currentTail + 1) % slots.size();
+        if (nextTail == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        slots[currentTail] = std::move(value);
+        tail.store(nextTail, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only; returns false if the queue is empty
+    bool tryPop(T &value)
+    {
+        const size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(slots[currentHead]);
+        head.store((currentHead + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+};
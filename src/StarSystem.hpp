@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CompactVertex.hpp"
+#include "Culling.hpp"
+#include "GlResources.hpp"
+#include "GlStreamBuffer.hpp"
+#include "Icosphere.hpp"
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+
+// The per-instance attributes of a body, see BodyTerrain.vertex.glsl and
+// BodyAtmosphere.vertex.glsl. All but the model matrix are in model space, where bodies
+// have the size of the planet; the model matrix scales them down.
+struct BodyInstance
+{
+    glm::mat4 modelMatrix;
+    glm::vec3 noiseOffset;
+    float baseRadius;
+    float maxNegativeHeight;
+    float maxPositiveHeight;
+    // 0 for bodies without an atmosphere
+    float atmosphereRadius;
+    float padding0;
+};
+
+static_assert(sizeof(BodyInstance) == 96);
+
+inline std::vector<GlVertexAttribute> bodyInstanceAttributes()
+{
+    return {
+        GlVertexAttribute{3, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, modelMatrix)},
+        GlVertexAttribute{4, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, modelMatrix) + sizeof(glm::vec4)},
+        GlVertexAttribute{5, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, modelMatrix) + 2 * sizeof(glm::vec4)},
+        GlVertexAttribute{6, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, modelMatrix) + 3 * sizeof(glm::vec4)},
+        GlVertexAttribute{7, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, noiseOffset)},
+        GlVertexAttribute{8, 4, GL_FLOAT, GL_FALSE, offsetof(BodyInstance, maxNegativeHeight)},
+    };
+}
+
+// A body on a circular orbit around the planet, spinning about the orbit axis.
+struct Body
+{
+    glm::vec3 orbitAxis;
+    // orbitU, orbitV and orbitAxis are orthonormal
+    glm::vec3 orbitU;
+    glm::vec3 orbitV;
+    float orbitRadius;
+    // radians per second
+    float orbitSpeed;
+    float spinSpeed;
+    float phase;
+    // world radius over model radius
+    float scale;
+    BodyInstance instance;
+};
+
+struct StarSystemParameters
+{
+    // of the planet, which every body is a scaled down variant of
+    float baseRadius;
+    float atmosphereRadius;
+    float minOrbitRadius;
+    float maxOrbitRadius;
+    float minBodyRadius;
+    float maxBodyRadius;
+};
+
+// The same seed and count give the same bodies. Atmospheres keep the ratio of radii of the
+// planet, so that the atmosphere tables of the planet apply to them as well.
+inline std::vector<Body> generateBodies(unsigned int count, uint32_t seed, const StarSystemParameters &parameters)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> unit(0, 1);
+    auto between = [&](float min, float max)
+    {
+        return min + (max - min) * unit(generator);
+    };
+
+    std::vector<Body> bodies;
+    bodies.reserve(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        Body body;
+        const float inclination = between(-0.3f, 0.3f);
+        const float node = between(0, 6.283f);
+        body.orbitAxis = glm::vec3(std::sin(inclination) * std::cos(node), std::cos(inclination), std::sin(inclination) * std::sin(node));
+        body.orbitU = glm::normalize(glm::cross(body.orbitAxis, glm::vec3(1, 0, 0)));
+        body.orbitV = glm::cross(body.orbitAxis, body.orbitU);
+        body.orbitRadius = between(parameters.minOrbitRadius, parameters.maxOrbitRadius);
+        body.orbitSpeed = 0.2f * std::pow(parameters.minOrbitRadius / body.orbitRadius, 1.5f);
+        body.spinSpeed = between(-0.5f, 0.5f);
+        body.phase = between(0, 6.283f);
+        body.scale = between(parameters.minBodyRadius, parameters.maxBodyRadius) / parameters.baseRadius;
+        body.instance = BodyInstance{
+            .modelMatrix = glm::mat4(1.0f),
+            .noiseOffset = glm::vec3(between(-50, 50), between(-50, 50), between(-50, 50)),
+            .baseRadius = parameters.baseRadius,
+            .maxNegativeHeight = between(10, 25),
+            // the terrain colors span from baseRadius to baseRadius + maxPositiveHeight - 10
+            .maxPositiveHeight = between(12, 25),
+            .atmosphereRadius = unit(generator) < 0.5f ? parameters.atmosphereRadius : 0,
+            .padding0 = 0,
+        };
+        bodies.push_back(body);
+    }
+    return bodies;
+}
+
+struct StarSystemView
+{
+    glm::mat4 viewProjectionMatrix;
+    glm::vec3 cameraPosition;
+    // viewport height in pixels divided by 2 tan(fieldOfView / 2)
+    float projectionScale;
+    // of the sphere around the origin that the planet covers at least
+    float occluderRadius;
+};
+
+// Whether a sphere lies entirely within the cone that the occluder sphere around the origin
+// subtends from the camera, and farther than the camera is from the origin. Every ray in
+// that cone enters the occluder before that distance.
+inline bool isBehindOccluder(glm::vec3 cameraPosition, float occluderRadius, glm::vec3 center, float radius)
+{
+    const float cameraDistance = glm::length(cameraPosition);
+    const float distance = glm::length(center - cameraPosition);
+    if (cameraDistance <= occluderRadius || distance - radius <= cameraDistance)
+    {
+        return false;
+    }
+    const float occluderAngle = std::asin(occluderRadius / cameraDistance);
+    const float angle = std::acos(glm::clamp(glm::dot(center - cameraPosition, -cameraPosition) / (distance * cameraDistance), -1.0f, 1.0f));
+    return angle + std::asin(radius / distance) < occluderAngle;
+}
+
+struct StarSystemStatistics
+{
+    unsigned int frustumCulledBodies = 0;
+    unsigned int occludedBodies = 0;
+    unsigned int subpixelBodies = 0;
+    unsigned int drawnBodies = 0;
+    unsigned int drawnAtmospheres = 0;
+    unsigned int drawCalls = 0;
+    // estimated at the center of each drawn body
+    TerrainOctaveHistogram terrainOctaves;
+};
+
+// Bodies drawn with one instanced draw per sphere level and one for all atmospheres. Each
+// frame the bodies are moved along their orbits, culled against the view frustum and the
+// planet, dropped when they are smaller than a pixel, and sorted into the coarsest level whose triangle
+// edges stay below maxEdgePixels on screen. Instances go front to back, so that the
+// depth test rejects the fragments of hidden bodies before they are shaded. The work per
+// body on the CPU is a few matrix products and the sort; on the GPU it follows the
+// covered pixels.
+class StarSystem
+{
+private:
+    static const unsigned int LEVELS = 3;
+    static constexpr unsigned int LEVEL_SUBDIVISIONS[LEVELS] = {1, 3, 5};
+    static const unsigned int ATMOSPHERE_SUBDIVISIONS = 3;
+    static constexpr float MIN_RADIUS_PIXELS = 0.5f;
+
+    struct VisibleBody
+    {
+        float distance;
+        unsigned int level;
+        BodyInstance instance;
+    };
+
+    std::vector<Body> bodies;
+    float maxEdgePixels = 8;
+    float time = 0;
+    std::vector<VisibleBody> visibleBodies;
+
+    // declared before the meshes, which add themselves when they are created
+    MeshMemory meshMemory;
+    std::vector<GlMesh> levelMeshes;
+    std::vector<GlStreamBuffer> levelInstanceBuffers;
+    std::vector<BodyInstance> levelInstances[LEVELS];
+    GlMesh atmosphereMesh;
+    GlStreamBuffer atmosphereInstanceBuffer;
+    std::vector<BodyInstance> atmosphereInstances;
+    StarSystemStatistics statistics;
+
+    GlMesh unitSphere(unsigned int subdivisions, ThreadPool &threadPool)
+    {
+        Mesh sphere = generateSphere(1, subdivisions, threadPool);
+        GlMesh mesh = compactSphereMesh(sphere, threadPool);
+        meshMemory.add(mesh, uncompressedMeshBytes<glm::vec3>(sphere));
+        return mesh;
+    }
+
+    // Each write goes to another region of the stream buffer, so the attributes are pointed
+    // at it again. Nothing is drawn from buffers without instances, which are left alone.
+    static void upload(const GlMesh &mesh, GlStreamBuffer &buffer, const std::vector<BodyInstance> &instances)
+    {
+        if (!instances.empty())
+        {
+            const size_t offset = buffer.write(instances);
+            attachInstanceAttributes<BodyInstance>(mesh.getVertexArray(), buffer.id(), bodyInstanceAttributes(), offset);
+        }
+    }
+
+public:
+    StarSystem(ThreadPool &threadPool, GlBufferPool &bufferPool)
+        : atmosphereMesh(unitSphere(ATMOSPHERE_SUBDIVISIONS, threadPool)),
+          atmosphereInstanceBuffer(bufferPool, sizeof(BodyInstance))
+    {
+        for (unsigned int level = 0; level < LEVELS; level++)
+        {
+            levelMeshes.push_back(unitSphere(LEVEL_SUBDIVISIONS[level], threadPool));
+            levelInstanceBuffers.push_back(GlStreamBuffer(bufferPool, sizeof(BodyInstance)));
+        }
+    }
+
+    StarSystem(const StarSystem &) = delete;
+    StarSystem &operator=(const StarSystem &) = delete;
+
+    StarSystem(StarSystem &&) = default;
+    StarSystem &operator=(StarSystem &&) = default;
+
+    void setBodies(std::vector<Body> newBodies)
+    {
+        bodies = std::move(newBodies);
+    }
+
+    // takes effect with the next update()
+    void setMaxEdgePixels(float newMaxEdgePixels)
+    {
+        maxEdgePixels = newMaxEdgePixels;
+    }
+
+    const MeshMemory &getMeshMemory() const
+    {
+        return meshMemory;
+    }
+
+    size_t getNumberOfBodies() const
+    {
+        return bodies.size();
+    }
+
+    void update(float deltaTime, const StarSystemView &view)
+    {
+        time += deltaTime;
+        statistics = StarSystemStatistics();
+        for (std::vector<BodyInstance> &instances : levelInstances)
+        {
+            instances.clear();
+        }
+        atmosphereInstances.clear();
+        visibleBodies.clear();
+
+        const Frustum frustum = Frustum::fromMatrix(view.viewProjectionMatrix);
+        for (const Body &body : bodies)
+        {
+            const float angle = body.phase + body.orbitSpeed * time;
+            const glm::vec3 center = body.orbitRadius * (std::cos(angle) * body.orbitU + std::sin(angle) * body.orbitV);
+            const float radius = body.scale * std::max(body.instance.baseRadius + body.instance.maxPositiveHeight, body.instance.atmosphereRadius);
+            if (!frustum.intersectsSphere(center, radius))
+            {
+                statistics.frustumCulledBodies++;
+                continue;
+            }
+            if (isBehindOccluder(view.cameraPosition, view.occluderRadius, center, radius))
+            {
+                statistics.occludedBodies++;
+                continue;
+            }
+            const float distance = std::max(glm::length(center - view.cameraPosition), radius);
+            const float radiusPixels = radius * view.projectionScale / distance;
+            if (radiusPixels < MIN_RADIUS_PIXELS)
+            {
+                statistics.subpixelBodies++;
+                continue;
+            }
+
+            // a sphere with n subdivisions has about 2.6 * 2^n edges around its circumference
+            unsigned int level = 0;
+            while (level + 1 < LEVELS && 2.6f * radiusPixels / float(1u << LEVEL_SUBDIVISIONS[level]) > maxEdgePixels)
+            {
+                level++;
+            }
+
+            // as BodyTerrain.vertex.glsl chooses them per vertex
+            const float footprint = std::max(distance / (view.projectionScale * body.scale),
+                                             icosphereVertexSpacing(body.instance.baseRadius, LEVEL_SUBDIVISIONS[level]));
+            statistics.terrainOctaves.add(terrainOctaves(footprint), icosphereVertexCount(LEVEL_SUBDIVISIONS[level]));
+
+            BodyInstance instance = body.instance;
+            instance.modelMatrix = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), center), body.spinSpeed * time, body.orbitAxis), glm::vec3(body.scale));
+            visibleBodies.push_back(VisibleBody{.distance = distance, .level = level, .instance = instance});
+        }
+
+        std::sort(visibleBodies.begin(), visibleBodies.end(), [](const VisibleBody &a, const VisibleBody &b)
+                  { return a.distance < b.distance; });
+        for (const VisibleBody &visibleBody : visibleBodies)
+        {
+            levelInstances[visibleBody.level].push_back(visibleBody.instance);
+            statistics.drawnBodies++;
+            if (visibleBody.instance.atmosphereRadius > 0)
+            {
+                atmosphereInstances.push_back(visibleBody.instance);
+                statistics.drawnAtmospheres++;
+            }
+        }
+
+        for (unsigned int level = 0; level < LEVELS; level++)
+        {
+            upload(levelMeshes[level], levelInstanceBuffers[level], levelInstances[level]);
+            statistics.drawCalls += levelInstances[level].empty() ? 0 : 1;
+        }
+        upload(atmosphereMesh, atmosphereInstanceBuffer, atmosphereInstances);
+        statistics.drawCalls += atmosphereInstances.empty() ? 0 : 1;
+    }
+
+    // with the program of BodyTerrain.vertex.glsl in use, given the location of its unitVertexSpacing
+    void drawTerrain(GLint unitVertexSpacingLocation) const
+    {
+        for (unsigned int level = 0; level < LEVELS; level++)
+        {
+            if (!levelInstances[level].empty())
+            {
+                glUniform1f(unitVertexSpacingLocation, icosphereVertexSpacing(1, LEVEL_SUBDIVISIONS[level]));
+                levelMeshes[level].drawInstanced(levelInstances[level].size());
+            }
+        }
+    }
+
+    // with the program of BodyAtmosphere.vertex.glsl in use
+    void drawAtmospheres() const
+    {
+        if (!atmosphereInstances.empty())
+        {
+            atmosphereMesh.drawInstanced(atmosphereInstances.size());
+        }
+    }
+
+    bool hasAtmospheres() const
+    {
+        return !atmosphereInstances.empty();
+    }
+
+    const StarSystemStatistics &getStatistics() const
+    {
+        return statistics;
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+
+struct BakedTerrainVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    float slope;
+};
+
+// The functions below port TerrainDisplacement.glsl.
+
+inline glm::vec3 terrainOrthogonal(glm::vec3 vector)
+{
+    if (vector.x != 0 || vector.y != 0)
+    {
+        return glm::vec3(-vector.y, vector.x, 0);
+    }
+    else if (vector.z != 0 || vector.y != 0)
+    {
+        return glm::vec3(0, -vector.z, vector.y);
+    }
+    else
+    {
+        return glm::vec3(-vector.z, 0, vector.x);
+    }
+}
+
+inline glm::vec3 terrainNormal(glm::vec3 position, glm::vec3 gradient, float elevation, float &slope)
+{
+    glm::vec3 unitPosition = glm::normalize(position);
+    float radius = glm::length(position);
+    glm::vec3 u = terrainOrthogonal(unitPosition);
+    glm::vec3 v = glm::cross(unitPosition, u);
+    glm::mat3 jacobian;
+    jacobian[0] = (1 + elevation / radius) * glm::vec3(1, 0, 0) + position.x / radius * (gradient - (elevation / (radius * radius)) * position);
+    jacobian[1] = (1 + elevation / radius) * glm::vec3(0, 1, 0) + position.y / radius * (gradient - (elevation / (radius * radius)) * position);
+    jacobian[2] = (1 + elevation / radius) * glm::vec3(0, 0, 1) + position.z / radius * (gradient - (elevation / (radius * radius)) * position);
+    glm::vec3 uTangent = glm::normalize(u) * jacobian;
+    glm::vec3 vTangent = glm::normalize(v) * jacobian;
+    slope = glm::length(gradient);
+    return glm::normalize(glm::cross(uTangent, vTangent));
+}
+
+inline void bakeTerrainRange(const std::vector<glm::vec3> &spherePositions, const TerrainNoiseParameters &parameters, float footprint,
+                             size_t begin, size_t end, BakedTerrainVertex *vertices)
+{
+    const size_t blockSize = 256;
+    float x[blockSize], y[blockSize], z[blockSize];
+    float elevation[blockSize], gradientX[blockSize], gradientY[blockSize], gradientZ[blockSize];
+
+    for (size_t blockBegin = begin; blockBegin < end; blockBegin += blockSize)
+    {
+        const size_t count = std::min(blockSize, end - blockBegin);
+        for (size_t i = 0; i < count; i++)
+        {
+            const glm::vec3 &position = spherePositions[blockBegin + i];
+            x[i] = position.x;
+            y[i] = position.y;
+            z[i] = position.z;
+        }
+
+        terrainElevation(TerrainSampleBatch{
+                             .x = x,
+                             .y = y,
+                             .z = z,
+                             .elevation = elevation,
+                             .gradientX = gradientX,
+                             .gradientY = gradientY,
+                             .gradientZ = gradientZ,
+                             .count = count,
+                             .footprint = footprint,
+                         },
+                         parameters);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const glm::vec3 &position = spherePositions[blockBegin + i];
+            const glm::vec3 gradient(gradientX[i], gradientY[i], gradientZ[i]);
+            BakedTerrainVertex &vertex = vertices[blockBegin + i];
+            vertex.position = position * (1 + elevation[i] / glm::length(position));
+            vertex.normal = terrainNormal(position, gradient, elevation[i], vertex.slope);
+        }
+    }
+}
+
+// Displaces the undisplaced sphere positions as the terrain vertex shader would. The
+// footprint is the spacing of the positions, see icosphereVertexSpacing(), which the
+// shader's footprints never fall below.
+inline std::vector<BakedTerrainVertex> bakeTerrain(const std::vector<glm::vec3> &spherePositions, const TerrainNoiseParameters &parameters, float footprint,
+                                                   ThreadPool &threadPool)
+{
+    std::vector<BakedTerrainVertex> vertices(spherePositions.size());
+    threadPool.parallelFor(spherePositions.size(), [&](size_t begin, size_t end)
+                           { bakeTerrainRange(spherePositions, parameters, footprint, begin, end, vertices.data()); });
+    return vertices;
+}
+
+inline std::optional<std::vector<BakedTerrainVertex>> bakeTerrain(const std::vector<glm::vec3> &spherePositions, const TerrainNoiseParameters &parameters, float footprint,
+                                                                  ThreadPool &threadPool, const CancellationToken &cancellation)
+{
+    std::vector<BakedTerrainVertex> vertices(spherePositions.size());
+    threadPool.parallelFor(spherePositions.size(), [&](size_t begin, size_t end)
+                           {
+        if (!cancellation.isCancelled())
+        {
+            bakeTerrainRange(spherePositions, parameters, footprint, begin, end, vertices.data());
+        } });
+    if (cancellation.isCancelled())
+    {
+        return std::nullopt;
+    }
+    return vertices;
+}
+
+inline std::vector<BakedTerrainVertex> bakeTerrain(const std::vector<glm::vec3> &spherePositions, const TerrainNoiseParameters &parameters, float footprint)
+{
+    std::vector<BakedTerrainVertex> vertices(spherePositions.size());
+    bakeTerrainRange(spherePositions, parameters, footprint, 0, spherePositions.size(), vertices.data());
+    return vertices;
+}
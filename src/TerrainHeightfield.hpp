@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "TerrainNoise.hpp"
+#include "ThreadPool.hpp"
+
+// The terrain of a whole planet as a cube map: elevation and its gradient, as computed by
+// TerrainGenerator.vertex.glsl, and the noise that TerrainGenerator.fragment.glsl adds to
+// the height when it picks a color. Faces come in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X
+// and following, rows of texels in the order of increasing t.
+struct TerrainHeightfield
+{
+    TerrainNoiseParameters parameters;
+    unsigned int resolution;
+    // elevation in x and its gradient in yzw
+    std::vector<glm::vec4> elevation[6];
+    std::vector<float> colorNoise[6];
+    double bakeMilliseconds;
+};
+
+inline bool operator==(const TerrainNoiseParameters &a, const TerrainNoiseParameters &b)
+{
+    return a.noiseOffset == b.noiseOffset && a.minElevation == b.minElevation && a.maxElevation == b.maxElevation;
+}
+
+// the direction that samplerCube lookups map to the given face and texture coordinates,
+// following the table of cube map face selection in the OpenGL specification
+inline glm::vec3 cubeMapDirection(unsigned int face, float s, float t)
+{
+    const float sc = 2 * s - 1;
+    const float tc = 2 * t - 1;
+    switch (face)
+    {
+    case 0:
+        return glm::vec3(1, -tc, -sc);
+    case 1:
+        return glm::vec3(-1, -tc, sc);
+    case 2:
+        return glm::vec3(sc, 1, tc);
+    case 3:
+        return glm::vec3(sc, -1, -tc);
+    case 4:
+        return glm::vec3(sc, -tc, 1);
+    default:
+        return glm::vec3(-sc, -tc, -1);
+    }
+}
+
+// the largest distance between the centers of adjacent texels on the sphere, which those
+// at the centers of the faces have
+inline float heightfieldTexelFootprint(float baseRadius, unsigned int resolution)
+{
+    return 2 * baseRadius / resolution;
+}
+
+// One row of one face: the elevation with the SIMD kernel, summing the octaves that the
+// texels resolve, then the color noise at the displaced position, where the fragments of
+// that texel lie.
+inline void bakeTerrainHeightfieldRow(TerrainHeightfield &heightfield, float baseRadius, unsigned int face, unsigned int row,
+                                      std::vector<float> &scratch)
+{
+    const unsigned int resolution = heightfield.resolution;
+    scratch.resize(7 * resolution);
+    float *x = &scratch[0], *y = &scratch[resolution], *z = &scratch[2 * resolution];
+    float *elevation = &scratch[3 * resolution];
+    float *gradientX = &scratch[4 * resolution], *gradientY = &scratch[5 * resolution], *gradientZ = &scratch[6 * resolution];
+    for (unsigned int column = 0; column < resolution; column++)
+    {
+        glm::vec3 position = baseRadius * glm::normalize(cubeMapDirection(face, (column + 0.5f) / resolution, (row + 0.5f) / resolution));
+        x[column] = position.x;
+        y[column] = position.y;
+        z[column] = position.z;
+    }
+
+    terrainElevation(TerrainSampleBatch{
+                         .x = x,
+                         .y = y,
+                         .z = z,
+                         .elevation = elevation,
+                         .gradientX = gradientX,
+                         .gradientY = gradientY,
+                         .gradientZ = gradientZ,
+                         .count = resolution,
+                         .footprint = heightfieldTexelFootprint(baseRadius, resolution),
+                     },
+                     heightfield.parameters);
+
+    for (unsigned int column = 0; column < resolution; column++)
+    {
+        const size_t texel = size_t(row) * resolution + column;
+        heightfield.elevation[face][texel] = glm::vec4(elevation[column], gradientX[column], gradientY[column], gradientZ[column]);
+
+        const glm::vec3 position(x[column], y[column], z[column]);
+        const glm::vec3 displacedPosition = position * (1 + elevation[column] / baseRadius);
+        glm::vec3 gradient;
+        heightfield.colorNoise[face][texel] = psrdnoise(displacedPosition + heightfield.parameters.noiseOffset, glm::vec3(100), 0, gradient);
+    }
+}
+
+inline std::optional<TerrainHeightfield> bakeTerrainHeightfield(unsigned int resolution, float baseRadius, const TerrainNoiseParameters &parameters,
+                                                                ThreadPool &threadPool, const CancellationToken &cancellation)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    TerrainHeightfield heightfield{.parameters = parameters, .resolution = resolution, .elevation = {}, .colorNoise = {}, .bakeMilliseconds = 0};
+    for (unsigned int face = 0; face < 6; face++)
+    {
+        heightfield.elevation[face].resize(size_t(resolution) * resolution);
+        heightfield.colorNoise[face].resize(size_t(resolution) * resolution);
+    }
+
+    threadPool.parallelFor(6 * resolution, 8, [&](size_t begin, size_t end)
+                           {
+        std::vector<float> scratch;
+        for (size_t faceRow = begin; faceRow < end && !cancellation.isCancelled(); faceRow++)
+        {
+            bakeTerrainHeightfieldRow(heightfield, baseRadius, faceRow / resolution, faceRow % resolution, scratch);
+        } });
+    if (cancellation.isCancelled())
+    {
+        return std::nullopt;
+    }
+
+    heightfield.bakeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return heightfield;
+}
+
+inline TerrainHeightfield bakeTerrainHeightfield(unsigned int resolution, float baseRadius, const TerrainNoiseParameters &parameters, ThreadPool &threadPool)
+{
+    return *bakeTerrainHeightfield(resolution, baseRadius, parameters, threadPool, CancellationToken());
+}
@@ -0,0 +1,318 @@
+#include "TerrainNoise.hpp"
+#include "TerrainNoiseKernel.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TERRAIN_NOISE_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define TERRAIN_NOISE_X86 0
+#endif
+
+// psrdnoise (c) Stefan Gustavson and Ian McEwan,
+// ver. 2021-12-02, published under the MIT license:
+// https://github.com/stegu/psrdnoise/
+
+static glm::vec4 glslMod(glm::vec4 x, float y)
+{
+    return x - y * glm::floor(x / y);
+}
+
+static glm::vec4 permute(glm::vec4 i)
+{
+    glm::vec4 im = glslMod(i, 289.0f);
+    return glslMod(((im * 34.0f) + 10.0f) * im, 289.0f);
+}
+
+static void psrdnoiseGradients(glm::vec4 hash, float alpha, glm::vec4 &gx, glm::vec4 &gy, glm::vec4 &gz)
+{
+    glm::vec4 theta = hash * 3.883222077f;
+    glm::vec4 sz = hash * -0.006920415f + 0.996539792f;
+    glm::vec4 psi = hash * 0.108705628f;
+    glm::vec4 Ct = glm::cos(theta), St = glm::sin(theta);
+    glm::vec4 sz_prime = glm::sqrt(1.0f - sz * sz);
+    if (alpha != 0.0f)
+    {
+        glm::vec4 px = Ct * sz_prime, py = St * sz_prime, pz = sz;
+        glm::vec4 Sp = glm::sin(psi), Cp = glm::cos(psi), Ctp = St * Sp - Ct * Cp;
+        glm::vec4 qx = glm::mix(Ctp * St, Sp, sz), qy = glm::mix(-Ctp * Ct, Cp, sz);
+        glm::vec4 qz = -(py * Cp + px * Sp);
+        glm::vec4 Sa = glm::vec4(glm::sin(alpha)), Ca = glm::vec4(glm::cos(alpha));
+        gx = Ca * px + Sa * qx;
+        gy = Ca * py + Sa * qy;
+        gz = Ca * pz + Sa * qz;
+    }
+    else
+    {
+        gx = Ct * sz_prime;
+        gy = St * sz_prime;
+        gz = sz;
+    }
+}
+
+float psrdnoise(glm::vec3 x, glm::vec3 period, float alpha, glm::vec3 &gradient)
+{
+    const glm::mat3 M = glm::mat3(0.0, 1.0, 1.0, 1.0, 0.0, 1.0, 1.0, 1.0, 0.0);
+    const glm::mat3 Mi = glm::mat3(-0.5, 0.5, 0.5, 0.5, -0.5, 0.5, 0.5, 0.5, -0.5);
+    glm::vec3 uvw = M * x;
+    glm::vec3 i0 = glm::floor(uvw), f0 = glm::fract(uvw);
+    glm::vec3 g_ = glm::step(glm::vec3(f0.x, f0.y, f0.x), glm::vec3(f0.y, f0.z, f0.z)), l_ = 1.0f - g_;
+    glm::vec3 g = glm::vec3(l_.z, g_.x, g_.y), l = glm::vec3(l_.x, l_.y, g_.z);
+    glm::vec3 o1 = glm::min(g, l), o2 = glm::max(g, l);
+    glm::vec3 i1 = i0 + o1, i2 = i0 + o2, i3 = i0 + glm::vec3(1.0);
+    glm::vec3 v0 = Mi * i0, v1 = Mi * i1, v2 = Mi * i2, v3 = Mi * i3;
+    glm::vec3 x0 = x - v0, x1 = x - v1, x2 = x - v2, x3 = x - v3;
+    if (glm::any(glm::greaterThan(period, glm::vec3(0.0))))
+    {
+        glm::vec4 vx = glm::vec4(v0.x, v1.x, v2.x, v3.x);
+        glm::vec4 vy = glm::vec4(v0.y, v1.y, v2.y, v3.y);
+        glm::vec4 vz = glm::vec4(v0.z, v1.z, v2.z, v3.z);
+        if (period.x > 0.0)
+            vx = glslMod(vx, period.x);
+        if (period.y > 0.0)
+            vy = glslMod(vy, period.y);
+        if (period.z > 0.0)
+            vz = glslMod(vz, period.z);
+        i0 = glm::floor(M * glm::vec3(vx.x, vy.x, vz.x) + 0.5f);
+        i1 = glm::floor(M * glm::vec3(vx.y, vy.y, vz.y) + 0.5f);
+        i2 = glm::floor(M * glm::vec3(vx.z, vy.z, vz.z) + 0.5f);
+        i3 = glm::floor(M * glm::vec3(vx.w, vy.w, vz.w) + 0.5f);
+    }
+    glm::vec4 hash = permute(permute(permute(glm::vec4(i0.z, i1.z, i2.z, i3.z)) + glm::vec4(i0.y, i1.y, i2.y, i3.y)) + glm::vec4(i0.x, i1.x, i2.x, i3.x));
+    glm::vec4 gx, gy, gz;
+    psrdnoiseGradients(hash, alpha, gx, gy, gz);
+    glm::vec3 g0 = glm::vec3(gx.x, gy.x, gz.x), g1 = glm::vec3(gx.y, gy.y, gz.y);
+    glm::vec3 g2 = glm::vec3(gx.z, gy.z, gz.z), g3 = glm::vec3(gx.w, gy.w, gz.w);
+    glm::vec4 w = 0.5f - glm::vec4(glm::dot(x0, x0), glm::dot(x1, x1), glm::dot(x2, x2), glm::dot(x3, x3));
+    w = glm::max(w, 0.0f);
+    glm::vec4 w2 = w * w, w3 = w2 * w;
+    glm::vec4 gdotx = glm::vec4(glm::dot(g0, x0), glm::dot(g1, x1), glm::dot(g2, x2), glm::dot(g3, x3));
+    float n = glm::dot(w3, gdotx);
+    glm::vec4 dw = -6.0f * w2 * gdotx;
+    glm::vec3 dn0 = w3.x * g0 + dw.x * x0;
+    glm::vec3 dn1 = w3.y * g1 + dw.y * x1;
+    glm::vec3 dn2 = w3.z * g2 + dw.z * x2;
+    glm::vec3 dn3 = w3.w * g3 + dw.w * x3;
+    gradient = 39.5f * (dn0 + dn1 + dn2 + dn3);
+    return 39.5f * n;
+}
+
+static float map(float value, float inMin, float inMax, float outMin, float outMax)
+{
+    return outMin + (outMax - outMin) * (value - inMin) / (inMax - inMin);
+}
+
+static float noise(glm::vec3 position, glm::vec3 noiseOffset, glm::vec3 &gradient)
+{
+    return psrdnoise(position + noiseOffset, glm::vec3(TERRAIN_NOISE_PERIOD), TERRAIN_NOISE_ALPHA, gradient);
+}
+
+static float smax(float a, float b, float k, float &h)
+{
+    float res = glm::exp(k * a) + glm::exp(k * b);
+    float result = glm::log(res) / k;
+    h = glm::clamp(0.5f + 0.5f * (a - b) / 5, 0.0f, 1.0f);
+    return result;
+}
+
+float terrainElevation(glm::vec3 position, const TerrainNoiseParameters &parameters, float octaves, glm::vec3 &gradient)
+{
+    float totalElevation = 0;
+    gradient = glm::vec3(0, 0, 0);
+    float totalAmplitude = 0;
+    for (unsigned int i = 0; i < TERRAIN_OCTAVE_COUNT; i++)
+    {
+        totalAmplitude += TERRAIN_AMPLITUDES[i];
+    }
+    for (unsigned int i = 0; i < evaluatedTerrainOctaves(octaves); i++)
+    {
+        const float amplitude = TERRAIN_AMPLITUDES[i] * terrainOctaveWeight(octaves, i);
+        glm::vec3 innerGradient;
+        totalElevation += amplitude * noise(position * TERRAIN_FREQUENCIES[i], parameters.noiseOffset, innerGradient);
+        gradient += amplitude * TERRAIN_FREQUENCIES[i] * innerGradient;
+    }
+
+    float elevationValue = map(totalElevation, -totalAmplitude, totalAmplitude, parameters.minElevation, parameters.maxElevation);
+    gradient *= (parameters.maxElevation - parameters.minElevation) / (2 * totalAmplitude);
+
+    float threshold = 0;
+    float interpolationFactor;
+    elevationValue = smax(elevationValue, threshold, 3, interpolationFactor);
+    gradient = glm::mix(glm::vec3(0, 0, 0), gradient, interpolationFactor);
+    return elevationValue;
+}
+
+static PsrdnoiseGradientTable makePsrdnoiseGradientTable(float alpha)
+{
+    PsrdnoiseGradientTable table;
+    for (int hash = 0; hash < PSRDNOISE_HASH_COUNT; hash += 4)
+    {
+        glm::vec4 gx, gy, gz;
+        psrdnoiseGradients(glm::vec4(hash, hash + 1, hash + 2, hash + 3), alpha, gx, gy, gz);
+        for (int i = 0; i < 4 && hash + i < PSRDNOISE_HASH_COUNT; i++)
+        {
+            table.x[hash + i] = gx[i];
+            table.y[hash + i] = gy[i];
+            table.z[hash + i] = gz[i];
+        }
+    }
+    return table;
+}
+
+const PsrdnoiseGradientTable &psrdnoiseGradientTable(float alpha)
+{
+    static const PsrdnoiseGradientTable withoutRotation = makePsrdnoiseGradientTable(0);
+    static const PsrdnoiseGradientTable terrainRotation = makePsrdnoiseGradientTable(TERRAIN_NOISE_ALPHA);
+    if (alpha == 0)
+    {
+        return withoutRotation;
+    }
+    if (alpha == TERRAIN_NOISE_ALPHA)
+    {
+        return terrainRotation;
+    }
+    thread_local PsrdnoiseGradientTable table;
+    table = makePsrdnoiseGradientTable(alpha);
+    return table;
+}
+
+const PsrdnoisePermutationTable &psrdnoisePermutationTable()
+{
+    static const PsrdnoisePermutationTable table = []
+    {
+        PsrdnoisePermutationTable table;
+        for (int i = 0; i < PSRDNOISE_PERMUTATION_COUNT; i++)
+        {
+            const int im = i % PSRDNOISE_HASH_COUNT;
+            table.hash[i] = float((im * 34 + 10) * im % PSRDNOISE_HASH_COUNT);
+        }
+        return table;
+    }();
+    return table;
+}
+
+SimdInstructionSet supportedSimdInstructionSet()
+{
+#if TERRAIN_NOISE_X86 && defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 1);
+    const bool hasSse41 = (registers[2] & (1 << 19)) != 0;
+    const bool hasFma = (registers[2] & (1 << 12)) != 0;
+    const bool hasAvx = (registers[2] & (1 << 28)) != 0 && (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(registers, 7, 0);
+    const bool hasAvx2 = (registers[1] & (1 << 5)) != 0;
+    if (hasAvx && hasAvx2 && hasFma)
+    {
+        return SimdInstructionSet::Avx2;
+    }
+    if (hasSse41)
+    {
+        return SimdInstructionSet::Sse41;
+    }
+#elif TERRAIN_NOISE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return SimdInstructionSet::Avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return SimdInstructionSet::Sse41;
+    }
+#endif
+    return SimdInstructionSet::Scalar;
+}
+
+const char *simdInstructionSetName(SimdInstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case SimdInstructionSet::Avx2:
+        return "AVX2";
+    case SimdInstructionSet::Sse41:
+        return "SSE4.1";
+    default:
+        return "scalar";
+    }
+}
+
+void terrainElevation(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters, SimdInstructionSet instructionSet)
+{
+#if TERRAIN_NOISE_X86
+    if (instructionSet == SimdInstructionSet::Avx2)
+    {
+        terrainElevationAvx2(batch, parameters);
+        return;
+    }
+    if (instructionSet == SimdInstructionSet::Sse41)
+    {
+        terrainElevationSse41(batch, parameters);
+        return;
+    }
+#endif
+    const float octaves = terrainOctaves(batch.footprint);
+    for (size_t i = 0; i < batch.count; i++)
+    {
+        glm::vec3 gradient;
+        batch.elevation[i] = terrainElevation(glm::vec3(batch.x[i], batch.y[i], batch.z[i]), parameters, octaves, gradient);
+        batch.gradientX[i] = gradient.x;
+        batch.gradientY[i] = gradient.y;
+        batch.gradientZ[i] = gradient.z;
+    }
+}
+
+void terrainElevation(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters)
+{
+    static const SimdInstructionSet instructionSet = supportedSimdInstructionSet();
+    terrainElevation(batch, parameters, instructionSet);
+}
+
+TerrainNoiseParity checkTerrainNoiseParity(SimdInstructionSet instructionSet, size_t samples, unsigned int seed, float minRadius, float maxRadius, float footprint)
+{
+    std::mt19937 generator(seed);
+    std::normal_distribution<float> direction(0, 1);
+    std::uniform_real_distribution<float> radius(minRadius, maxRadius);
+    std::uniform_real_distribution<float> offset(-10, 10);
+
+    TerrainNoiseParameters parameters;
+    parameters.noiseOffset = glm::vec3(offset(generator), offset(generator), offset(generator));
+
+    std::vector<float> x(samples), y(samples), z(samples);
+    std::vector<float> elevation(samples), gradientX(samples), gradientY(samples), gradientZ(samples);
+    for (size_t i = 0; i < samples; i++)
+    {
+        glm::vec3 position = glm::normalize(glm::vec3(direction(generator), direction(generator), direction(generator))) * radius(generator);
+        x[i] = position.x;
+        y[i] = position.y;
+        z[i] = position.z;
+    }
+
+    terrainElevation(TerrainSampleBatch{
+                         .x = x.data(),
+                         .y = y.data(),
+                         .z = z.data(),
+                         .elevation = elevation.data(),
+                         .gradientX = gradientX.data(),
+                         .gradientY = gradientY.data(),
+                         .gradientZ = gradientZ.data(),
+                         .count = samples,
+                         .footprint = footprint,
+                     },
+                     parameters, instructionSet);
+
+    const float octaves = terrainOctaves(footprint);
+    TerrainNoiseParity parity = {.samples = samples, .maxElevationError = 0, .maxGradientError = 0};
+    for (size_t i = 0; i < samples; i++)
+    {
+        glm::vec3 gradient;
+        const float expectedElevation = terrainElevation(glm::vec3(x[i], y[i], z[i]), parameters, octaves, gradient);
+        parity.maxElevationError = std::max(parity.maxElevationError, glm::abs(elevation[i] - expectedElevation));
+        parity.maxGradientError = std::max(parity.maxGradientError, glm::length(glm::vec3(gradientX[i], gradientY[i], gradientZ[i]) - gradient));
+    }
+    return parity;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Host implementation of the terrain noise in TerrainNoise.glsl, which the terrain shaders
+// include.
+// The scalar functions are line-by-line ports of the GLSL and serve as reference; the
+// batched functions evaluate the same formulas on structure-of-arrays positions with
+// AVX2 or SSE4.1, chosen at runtime.
+
+const unsigned int TERRAIN_OCTAVE_COUNT = 11;
+static const float TERRAIN_AMPLITUDES[TERRAIN_OCTAVE_COUNT] = {2, 2, 4, 3, 1, 1, 0.5, 0.2, 0.05, 0.02, 0.02};
+static const float TERRAIN_FREQUENCIES[TERRAIN_OCTAVE_COUNT] = {4 / 1000.0f, 8 / 1000.0f, 16 / 1000.0f, 32 / 1000.0f, 64 / 1000.0f, 128 / 1000.0f, 256 / 1000.0f, 512 / 1000.0f, 1024 / 1000.0f, 2048 / 1000.0f, 4096 / 1000.0f};
+const float TERRAIN_NOISE_PERIOD = 200;
+const float TERRAIN_NOISE_ALPHA = 1;
+
+// Octaves finer than the noise is sampled at only alias, so each evaluation sums as many
+// octaves as its footprint resolves: the size in model space that one sample stands for,
+// such as a pixel, the spacing of a mesh's vertices or a heightfield texel. An octave needs
+// TERRAIN_MIN_SAMPLES_PER_WAVELENGTH samples per wavelength and fades in over the octave
+// above that, as the frequencies double from one octave to the next, so that a moving
+// footprint never pops. The first TERRAIN_MIN_OCTAVES octaves carry 93% of the variance of
+// the elevation and are always summed, which keeps the elevations, and with them the
+// colors, of far terrain. The octaves left out still count in the normalization.
+const float TERRAIN_MIN_SAMPLES_PER_WAVELENGTH = 2;
+const unsigned int TERRAIN_MIN_OCTAVES = 4;
+
+// the fractional number of octaves to sum, where the last one is weighted by the fraction;
+// a footprint of 0 sums all of them
+inline float terrainOctaves(float footprint)
+{
+    const float octaves = -std::log2(TERRAIN_MIN_SAMPLES_PER_WAVELENGTH * TERRAIN_FREQUENCIES[0] * footprint);
+    return glm::clamp(octaves, float(TERRAIN_MIN_OCTAVES), float(TERRAIN_OCTAVE_COUNT));
+}
+
+inline float terrainOctaveWeight(float octaves, unsigned int octave)
+{
+    return glm::clamp(octaves - float(octave), 0.0f, 1.0f);
+}
+
+// the octaves that are evaluated, including the one that fades in
+inline unsigned int evaluatedTerrainOctaves(float octaves)
+{
+    return (unsigned int)std::ceil(octaves);
+}
+
+// How many vertices had how many octaves evaluated.
+struct TerrainOctaveHistogram
+{
+    size_t vertices[TERRAIN_OCTAVE_COUNT + 1] = {};
+
+    void add(float octaves, size_t count)
+    {
+        vertices[evaluatedTerrainOctaves(octaves)] += count;
+    }
+
+    void add(const TerrainOctaveHistogram &other)
+    {
+        for (unsigned int octaves = 0; octaves <= TERRAIN_OCTAVE_COUNT; octaves++)
+        {
+            vertices[octaves] += other.vertices[octaves];
+        }
+    }
+
+    size_t totalVertices() const
+    {
+        size_t total = 0;
+        for (size_t count : vertices)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    size_t noiseEvaluations() const
+    {
+        size_t evaluations = 0;
+        for (unsigned int octaves = 0; octaves <= TERRAIN_OCTAVE_COUNT; octaves++)
+        {
+            evaluations += octaves * vertices[octaves];
+        }
+        return evaluations;
+    }
+};
+
+struct TerrainNoiseParameters
+{
+    glm::vec3 noiseOffset = glm::vec3(0, 0, 0);
+    float minElevation = -20;
+    float maxElevation = 15;
+};
+
+// Positions in model space go in, elevation above the base radius and its gradient
+// with respect to the position come out. All arrays hold count floats, and all positions
+// share the footprint, see terrainOctaves().
+struct TerrainSampleBatch
+{
+    const float *x;
+    const float *y;
+    const float *z;
+    float *elevation;
+    float *gradientX;
+    float *gradientY;
+    float *gradientZ;
+    size_t count;
+    float footprint = 0;
+};
+
+enum class SimdInstructionSet
+{
+    Scalar,
+    Sse41,
+    Avx2,
+};
+
+SimdInstructionSet supportedSimdInstructionSet();
+const char *simdInstructionSetName(SimdInstructionSet instructionSet);
+
+float psrdnoise(glm::vec3 x, glm::vec3 period, float alpha, glm::vec3 &gradient);
+float terrainElevation(glm::vec3 position, const TerrainNoiseParameters &parameters, float octaves, glm::vec3 &gradient);
+
+void terrainElevation(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters);
+void terrainElevation(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters, SimdInstructionSet instructionSet);
+
+struct TerrainNoiseParity
+{
+    size_t samples;
+    float maxElevationError;
+    float maxGradientError;
+};
+
+// Compares the batched kernel against the scalar port on random positions within the
+// given radius range, sampled with the given footprint.
+TerrainNoiseParity checkTerrainNoiseParity(SimdInstructionSet instructionSet, size_t samples, unsigned int seed, float minRadius, float maxRadius, float footprint);
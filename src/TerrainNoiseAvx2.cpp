@@ -0,0 +1,57 @@
+#include "TerrainNoiseKernel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <immintrin.h>
+
+namespace
+{
+    struct Float8
+    {
+        static const size_t width = 8;
+        __m256 v;
+
+        Float8() = default;
+        Float8(__m256 v) : v(v) {}
+        Float8(float s) : v(_mm256_set1_ps(s)) {}
+
+        static Float8 load(const float *p)
+        {
+            return _mm256_loadu_ps(p);
+        }
+
+        void store(float *p) const
+        {
+            _mm256_storeu_ps(p, v);
+        }
+    };
+
+    inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.v, b.v); }
+    inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Float8 floor(Float8 a) { return _mm256_floor_ps(a.v); }
+    inline Float8 min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+    inline Float8 max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+    inline Float8 less(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline Float8 greaterEqual(Float8 a, Float8 b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+    inline Float8 select(Float8 mask, Float8 a, Float8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+    inline Float8 ones(Float8 mask) { return _mm256_and_ps(mask.v, _mm256_set1_ps(1.0f)); }
+
+    inline Float8 gather(const float *table, Float8 index)
+    {
+        return _mm256_i32gather_ps(table, _mm256_cvtps_epi32(index.v), 4);
+    }
+
+    inline Float8 exp2i(Float8 exponent)
+    {
+        const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(exponent.v), _mm256_set1_epi32(127)), 23);
+        return _mm256_castsi256_ps(bits);
+    }
+}
+
+void terrainElevationAvx2(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters)
+{
+    terrainElevationBatch<Float8>(batch, parameters);
+}
+
+#endif
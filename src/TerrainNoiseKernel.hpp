@@ -0,0 +1,258 @@
+#pragma once
+
+// Batched terrain kernel shared by the SSE4.1 and AVX2 translation units. It is
+// written against a vector type Float that provides arithmetic operators, set1 through
+// its float constructor, load/store and the free functions floor, min, max,
+// less, greaterEqual, select, ones (mask to 1.0/0.0), gather and exp2i. Each
+// translation unit defines its Float in an anonymous namespace so that the
+// instantiations never mix between instruction sets.
+
+#include <cstring>
+
+#include "TerrainNoise.hpp"
+
+const int PSRDNOISE_HASH_COUNT = 289;
+
+// Gradient vectors of psrdnoise depend only on the permutation hash and on alpha, so
+// they are tabulated once instead of evaluating sin and cos per corner.
+struct PsrdnoiseGradientTable
+{
+    float x[PSRDNOISE_HASH_COUNT];
+    float y[PSRDNOISE_HASH_COUNT];
+    float z[PSRDNOISE_HASH_COUNT];
+};
+
+const PsrdnoiseGradientTable &psrdnoiseGradientTable(float alpha);
+
+// permute(i) for i in [0, PSRDNOISE_PERMUTATION_COUNT). With a period the hashed lattice
+// coordinates are below 2 * period, so up to a period of 289 the three permutations of a
+// corner are three lookups instead of six exact floating point modulos.
+const int PSRDNOISE_PERMUTATION_COUNT = 3 * PSRDNOISE_HASH_COUNT;
+
+struct PsrdnoisePermutationTable
+{
+    float hash[PSRDNOISE_PERMUTATION_COUNT];
+};
+
+const PsrdnoisePermutationTable &psrdnoisePermutationTable();
+
+void terrainElevationSse41(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters);
+void terrainElevationAvx2(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters);
+
+// x mod y as defined by GLSL, exact for values on a half-integer grid
+template <typename Float>
+inline Float glslMod(Float x, float y)
+{
+    Float remainder = x - Float(y) * floor(x * Float(1.0f / y));
+    remainder = select(greaterEqual(remainder, Float(y)), remainder - Float(y), remainder);
+    return select(less(remainder, Float(0)), remainder + Float(y), remainder);
+}
+
+template <typename Float>
+inline Float permute(Float i)
+{
+    Float im = glslMod(i, 289.0f);
+    return glslMod((im * Float(34.0f) + Float(10.0f)) * im, 289.0f);
+}
+
+template <typename Float>
+inline void psrdnoiseKernel(Float x, Float y, Float z, float period, const PsrdnoiseGradientTable &table,
+                            const PsrdnoisePermutationTable &permutation, Float &noise, Float &gradientX, Float &gradientY, Float &gradientZ)
+{
+    const Float u = y + z;
+    const Float v = x + z;
+    const Float w = x + y;
+    const Float i0u = floor(u), i0v = floor(v), i0w = floor(w);
+    const Float f0u = u - i0u, f0v = v - i0v, f0w = w - i0w;
+
+    const Float gx_ = ones(greaterEqual(f0v, f0u));
+    const Float gy_ = ones(greaterEqual(f0w, f0v));
+    const Float gz_ = ones(greaterEqual(f0w, f0u));
+    const Float lx_ = Float(1.0f) - gx_, ly_ = Float(1.0f) - gy_, lz_ = Float(1.0f) - gz_;
+
+    // g = (l_.z, g_.x, g_.y), l = (l_.x, l_.y, g_.z)
+    const Float o1u = min(lz_, lx_), o1v = min(gx_, ly_), o1w = min(gy_, gz_);
+    const Float o2u = max(lz_, lx_), o2v = max(gx_, ly_), o2w = max(gy_, gz_);
+
+    const Float iu[4] = {i0u, i0u + o1u, i0u + o2u, i0u + Float(1.0f)};
+    const Float iv[4] = {i0v, i0v + o1v, i0v + o2v, i0v + Float(1.0f)};
+    const Float iw[4] = {i0w, i0w + o1w, i0w + o2w, i0w + Float(1.0f)};
+
+    Float n = Float(0.0f);
+    Float dx = Float(0.0f), dy = Float(0.0f), dz = Float(0.0f);
+    for (int corner = 0; corner < 4; corner++)
+    {
+        // v = Mi * i
+        Float vx = Float(0.5f) * (iv[corner] + iw[corner] - iu[corner]);
+        Float vy = Float(0.5f) * (iu[corner] + iw[corner] - iv[corner]);
+        Float vz = Float(0.5f) * (iu[corner] + iv[corner] - iw[corner]);
+        const Float x0 = x - vx, y0 = y - vy, z0 = z - vz;
+
+        Float hash;
+        if (period > 0 && 2 * period + PSRDNOISE_HASH_COUNT <= PSRDNOISE_PERMUTATION_COUNT)
+        {
+            vx = glslMod(vx, period);
+            vy = glslMod(vy, period);
+            vz = glslMod(vz, period);
+            const Float hashU = floor(vy + vz + Float(0.5f));
+            const Float hashV = floor(vx + vz + Float(0.5f));
+            const Float hashW = floor(vx + vy + Float(0.5f));
+            hash = gather(permutation.hash, gather(permutation.hash, gather(permutation.hash, hashW) + hashV) + hashU);
+        }
+        else
+        {
+            Float hashU = iu[corner], hashV = iv[corner], hashW = iw[corner];
+            if (period > 0)
+            {
+                vx = glslMod(vx, period);
+                vy = glslMod(vy, period);
+                vz = glslMod(vz, period);
+                hashU = floor(vy + vz + Float(0.5f));
+                hashV = floor(vx + vz + Float(0.5f));
+                hashW = floor(vx + vy + Float(0.5f));
+            }
+            hash = permute(permute(permute(hashW) + hashV) + hashU);
+        }
+        const Float gx = gather(table.x, hash);
+        const Float gy = gather(table.y, hash);
+        const Float gz = gather(table.z, hash);
+
+        const Float falloff = max(Float(0.5f) - (x0 * x0 + y0 * y0 + z0 * z0), Float(0.0f));
+        const Float falloff2 = falloff * falloff;
+        const Float falloff3 = falloff2 * falloff;
+        const Float gdotx = gx * x0 + gy * y0 + gz * z0;
+        n = n + falloff3 * gdotx;
+        const Float dw = Float(-6.0f) * falloff2 * gdotx;
+        dx = dx + falloff3 * gx + dw * x0;
+        dy = dy + falloff3 * gy + dw * y0;
+        dz = dz + falloff3 * gz + dw * z0;
+    }
+
+    noise = Float(39.5f) * n;
+    gradientX = Float(39.5f) * dx;
+    gradientY = Float(39.5f) * dy;
+    gradientZ = Float(39.5f) * dz;
+}
+
+// cephes expf
+template <typename Float>
+inline Float vectorExp(Float x)
+{
+    x = max(min(x, Float(88.3f)), Float(-87.3f));
+    const Float fx = floor(x * Float(1.44269504088896341f) + Float(0.5f));
+    x = x - fx * Float(0.693359375f);
+    x = x - fx * Float(-2.12194440e-4f);
+    const Float z = x * x;
+    Float y = Float(1.9875691500e-4f);
+    y = y * x + Float(1.3981999507e-3f);
+    y = y * x + Float(8.3334519073e-3f);
+    y = y * x + Float(4.1665795894e-2f);
+    y = y * x + Float(1.6666665459e-1f);
+    y = y * x + Float(5.0000001201e-1f);
+    y = y * z + x + Float(1.0f);
+    return y * exp2i(fx);
+}
+
+// cephes logf for arguments in [1, 2]
+template <typename Float>
+inline Float logBetweenOneAndTwo(Float x)
+{
+    const Float isUpperHalf = greaterEqual(x, Float(1.41421356237f));
+    const Float e = ones(isUpperHalf);
+    x = select(isUpperHalf, x * Float(0.5f), x) - Float(1.0f);
+    const Float z = x * x;
+    Float y = Float(7.0376836292e-2f);
+    y = y * x + Float(-1.1514610310e-1f);
+    y = y * x + Float(1.1676998740e-1f);
+    y = y * x + Float(-1.2420140846e-1f);
+    y = y * x + Float(1.4249322787e-1f);
+    y = y * x + Float(-1.6668057665e-1f);
+    y = y * x + Float(2.0000714765e-1f);
+    y = y * x + Float(-2.4999993993e-1f);
+    y = y * x + Float(3.3333331174e-1f);
+    y = y * x * z;
+    y = y + e * Float(-2.12194440e-4f);
+    y = y - Float(0.5f) * z;
+    return x + y + e * Float(0.693359375f);
+}
+
+template <typename Float>
+inline void terrainElevationKernel(const float *positionX, const float *positionY, const float *positionZ,
+                                   float *elevationOut, float *gradientXOut, float *gradientYOut, float *gradientZOut,
+                                   const TerrainNoiseParameters &parameters, float octaves, const PsrdnoiseGradientTable &table,
+                                   const PsrdnoisePermutationTable &permutation)
+{
+    const Float x = Float::load(positionX);
+    const Float y = Float::load(positionY);
+    const Float z = Float::load(positionZ);
+
+    Float totalElevation = Float(0.0f);
+    Float gradientX = Float(0.0f), gradientY = Float(0.0f), gradientZ = Float(0.0f);
+    float totalAmplitude = 0;
+    for (unsigned int i = 0; i < TERRAIN_OCTAVE_COUNT; i++)
+    {
+        totalAmplitude += TERRAIN_AMPLITUDES[i];
+    }
+    for (unsigned int i = 0; i < evaluatedTerrainOctaves(octaves); i++)
+    {
+        const Float frequency = Float(TERRAIN_FREQUENCIES[i]);
+        Float noise, innerGradientX, innerGradientY, innerGradientZ;
+        psrdnoiseKernel(x * frequency + Float(parameters.noiseOffset.x),
+                        y * frequency + Float(parameters.noiseOffset.y),
+                        z * frequency + Float(parameters.noiseOffset.z),
+                        TERRAIN_NOISE_PERIOD, table, permutation, noise, innerGradientX, innerGradientY, innerGradientZ);
+        const float weightedAmplitude = TERRAIN_AMPLITUDES[i] * terrainOctaveWeight(octaves, i);
+        const Float amplitude = Float(weightedAmplitude);
+        const Float gradientScale = Float(weightedAmplitude * TERRAIN_FREQUENCIES[i]);
+        totalElevation = totalElevation + amplitude * noise;
+        gradientX = gradientX + gradientScale * innerGradientX;
+        gradientY = gradientY + gradientScale * innerGradientY;
+        gradientZ = gradientZ + gradientScale * innerGradientZ;
+    }
+
+    const float elevationRange = parameters.maxElevation - parameters.minElevation;
+    const Float elevation = Float(parameters.minElevation) + Float(elevationRange) * (totalElevation + Float(totalAmplitude)) * Float(1.0f / (2 * totalAmplitude));
+    const Float gradientScale = Float(elevationRange / (2 * totalAmplitude));
+
+    // smax(elevation, 0, 3) = log(exp(3 * elevation) + 1) / 3, evaluated as a softplus
+    const Float scaledElevation = Float(3.0f) * elevation;
+    const Float absoluteScaledElevation = max(scaledElevation, Float(0.0f) - scaledElevation);
+    const Float smoothMaximum = (max(scaledElevation, Float(0.0f)) + logBetweenOneAndTwo(Float(1.0f) + vectorExp(Float(0.0f) - absoluteScaledElevation))) * Float(1.0f / 3.0f);
+    const Float interpolationFactor = min(max(Float(0.5f) + Float(0.5f / 5.0f) * elevation, Float(0.0f)), Float(1.0f));
+    const Float finalGradientScale = gradientScale * interpolationFactor;
+
+    smoothMaximum.store(elevationOut);
+    (gradientX * finalGradientScale).store(gradientXOut);
+    (gradientY * finalGradientScale).store(gradientYOut);
+    (gradientZ * finalGradientScale).store(gradientZOut);
+}
+
+template <typename Float>
+inline void terrainElevationBatch(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters)
+{
+    const PsrdnoiseGradientTable &table = psrdnoiseGradientTable(TERRAIN_NOISE_ALPHA);
+    const PsrdnoisePermutationTable &permutation = psrdnoisePermutationTable();
+    const float octaves = terrainOctaves(batch.footprint);
+    const size_t width = Float::width;
+    size_t i = 0;
+    for (; i + width <= batch.count; i += width)
+    {
+        terrainElevationKernel<Float>(batch.x + i, batch.y + i, batch.z + i,
+                                      batch.elevation + i, batch.gradientX + i, batch.gradientY + i, batch.gradientZ + i,
+                                      parameters, octaves, table, permutation);
+    }
+
+    if (i < batch.count)
+    {
+        const size_t remaining = batch.count - i;
+        float lanes[7][width] = {};
+        memcpy(lanes[0], batch.x + i, remaining * sizeof(float));
+        memcpy(lanes[1], batch.y + i, remaining * sizeof(float));
+        memcpy(lanes[2], batch.z + i, remaining * sizeof(float));
+        terrainElevationKernel<Float>(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], parameters, octaves, table, permutation);
+        memcpy(batch.elevation + i, lanes[3], remaining * sizeof(float));
+        memcpy(batch.gradientX + i, lanes[4], remaining * sizeof(float));
+        memcpy(batch.gradientY + i, lanes[5], remaining * sizeof(float));
+        memcpy(batch.gradientZ + i, lanes[6], remaining * sizeof(float));
+    }
+}
@@ -0,0 +1,59 @@
+#include "TerrainNoiseKernel.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include <smmintrin.h>
+
+namespace
+{
+    struct Float4
+    {
+        static const size_t width = 4;
+        __m128 v;
+
+        Float4() = default;
+        Float4(__m128 v) : v(v) {}
+        Float4(float s) : v(_mm_set1_ps(s)) {}
+
+        static Float4 load(const float *p)
+        {
+            return _mm_loadu_ps(p);
+        }
+
+        void store(float *p) const
+        {
+            _mm_storeu_ps(p, v);
+        }
+    };
+
+    inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+    inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+    inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+    inline Float4 floor(Float4 a) { return _mm_floor_ps(a.v); }
+    inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+    inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+    inline Float4 less(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    inline Float4 greaterEqual(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_blendv_ps(b.v, a.v, mask.v); }
+    inline Float4 ones(Float4 mask) { return _mm_and_ps(mask.v, _mm_set1_ps(1.0f)); }
+
+    inline Float4 gather(const float *table, Float4 index)
+    {
+        alignas(16) int indices[4];
+        _mm_store_si128((__m128i *)indices, _mm_cvtps_epi32(index.v));
+        return _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+    }
+
+    inline Float4 exp2i(Float4 exponent)
+    {
+        const __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(exponent.v), _mm_set1_epi32(127)), 23);
+        return _mm_castsi128_ps(bits);
+    }
+}
+
+void terrainElevationSse41(const TerrainSampleBatch &batch, const TerrainNoiseParameters &parameters)
+{
+    terrainElevationBatch<Float4>(batch, parameters);
+}
+
+#endif
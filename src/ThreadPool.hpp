@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Shared between a job and whoever submitted it. Long running jobs poll isCancelled()
+// and give up early once their result is no longer wanted.
+class CancellationToken
+{
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+
+public:
+    void cancel() const
+    {
+        cancelled->store(true, std::memory_order_relaxed);
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled->load(std::memory_order_relaxed);
+    }
+};
+
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(tasksMutex);
+                tasksAvailable.wait(lock, [this]
+                                    { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned int numberOfThreads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            workers.emplace_back([this]
+                                 { work(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            stopping = true;
+        }
+        tasksAvailable.notify_all();
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int size() const
+    {
+        return workers.size();
+    }
+
+    template <typename Task>
+    auto submit(Task task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packagedTask->get_future();
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            tasks.push([packagedTask]
+                       { (*packagedTask)(); });
+        }
+        tasksAvailable.notify_one();
+        return result;
+    }
+
+    // Calls body(begin, end) for consecutive chunks of [0, count). The calling thread
+    // takes chunks as well, so parallelFor may be nested inside pool tasks without
+    // waiting on workers that are busy elsewhere.
+    template <typename Body>
+    void parallelFor(size_t count, size_t chunkSize, const Body &body)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        chunkSize = std::max<size_t>(1, chunkSize);
+        const size_t numberOfChunks = (count + chunkSize - 1) / chunkSize;
+        if (numberOfChunks == 1 || workers.empty())
+        {
+            body(size_t(0), count);
+            return;
+        }
+
+        struct Progress
+        {
+            std::atomic<size_t> nextChunk = 0;
+            std::atomic<size_t> finishedChunks = 0;
+        };
+        auto progress = std::make_shared<Progress>();
+
+        auto runChunks = [progress, count, chunkSize, numberOfChunks, &body]
+        {
+            size_t chunk;
+            while ((chunk = progress->nextChunk.fetch_add(1)) < numberOfChunks)
+            {
+                const size_t begin = chunk * chunkSize;
+                body(begin, std::min(count, begin + chunkSize));
+                if (progress->finishedChunks.fetch_add(1) + 1 == numberOfChunks)
+                {
+                    progress->finishedChunks.notify_all();
+                }
+            }
+        };
+
+        const size_t numberOfHelpers = std::min<size_t>(workers.size(), numberOfChunks - 1);
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            for (size_t i = 0; i < numberOfHelpers; i++)
+            {
+                tasks.push(runChunks);
+            }
+        }
+        tasksAvailable.notify_all();
+
+        runChunks();
+
+        size_t finishedChunks;
+        while ((finishedChunks = progress->finishedChunks.load()) < numberOfChunks)
+        {
+            progress->finishedChunks.wait(finishedChunks);
+        }
+    }
+
+    template <typename Body>
+    void parallelFor(size_t count, const Body &body)
+    {
+        const size_t chunksPerThread = 4;
+        const size_t chunkSize = std::max<size_t>(1024, count / ((workers.size() + 1) * chunksPerThread));
+        parallelFor(count, chunkSize, body);
+    }
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free hand-over of the latest value from exactly one producer thread to exactly one
+// consumer thread. Each side owns one of three slots and the third one is shared:
+// publishing swaps the producer's slot with the shared one, and the consumer swaps the
+// shared one in when it holds a newer value. Neither side ever waits, and the consumer
+// skips the values that were replaced before it looked.
+template <typename T>
+class TripleBuffer
+{
+private:
+    // set on the shared slot index while the slot holds a value that the consumer has not taken
+    static const unsigned int FRESH = 4;
+
+    T slots[3];
+    alignas(64) std::atomic<unsigned int> sharedSlot = 1;
+    alignas(64) unsigned int producerSlot = 0;
+    alignas(64) unsigned int consumerSlot = 2;
+
+public:
+    explicit TripleBuffer(const T &initial) : slots{initial, initial, initial}
+    {
+    }
+
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    // producer only; the slot to write the next value into, which holds an older value
+    T &back()
+    {
+        return slots[producerSlot];
+    }
+
+    // producer only
+    void publish()
+    {
+        producerSlot = sharedSlot.exchange(producerSlot | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    // consumer only; takes the latest published value, if there is one it has not taken yet
+    bool update()
+    {
+        if ((sharedSlot.load(std::memory_order_relaxed) & FRESH) == 0)
+        {
+            return false;
+        }
+        consumerSlot = sharedSlot.exchange(consumerSlot, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    // consumer only
+    const T &front() const
+    {
+        return slots[consumerSlot];
+    }
+};